@@ -0,0 +1,403 @@
+/**
+ * @file crawler_page_server.c
+ * @brief An HTTP server that serves crawled pages back by their original URL.
+ *
+ * This program loads the output of a crawl into an in-memory URL index and
+ * serves each page straight from disk with sendfile(), so downstream tools
+ * and regression tests can read pages back by URL instead of hunting for
+ * the randomly named files the crawler writes.
+ *
+ * Two kinds of crawl output can be loaded, any number of each:
+ * - Page indexes written with glib_web_crawler --page-index=FILE, one
+ *   "URL<TAB>path<TAB>offset<TAB>length" line per saved page.
+ * - Crawl archives written with glib_web_crawler --record=FILE. Bodies are
+ *   served from their offset in the archive, with the recorded status and
+ *   Content-Type.
+ * When a URL appears more than once, the last one loaded wins.
+ *
+ * Features:
+ * - One thread per connection with GThreadedSocketService, with keep-alive.
+ * - Page bodies go from the page cache to the socket with sendfile(); the
+ *   server never copies them into user space.
+ * - Archives stay open once; page files are opened per request.
+ *
+ * Requests name the page either as a proxy-style absolute URL or with a
+ * url query parameter:
+ * GET http://example.com/about.html HTTP/1.1
+ * GET /page?url=http%3A%2F%2Fexample.com%2Fabout.html HTTP/1.1
+ *
+ * Compilation:
+ * gcc -o crawler_page_server crawler_page_server.c `pkg-config --cflags --libs glib-2.0 gio-2.0`
+ *
+ * Execution:
+ * ./crawler_page_server [--port=8081] [--index=FILE ...] [--archive=FILE ...] [--quiet]
+ *
+ * Example:
+ * ./glib_web_crawler --page-index=pages.tsv --record=crawl.crwa https://example.com
+ * ./crawler_page_server --index=pages.tsv --archive=crawl.crwa
+ * curl -x http://127.0.0.1:8081 http://example.com/
+ *
+ * @author: Nelson Chung
+ * @date: 2024.11.23
+ */
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+// Crawl archive layout, as written by glib_web_crawler --record
+#define ARCHIVE_MAGIC "CRWA"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_RECORD_HEADER_SIZE (3 * sizeof(guint32) + sizeof(guint64))
+
+// Where the body of one crawled page is stored
+typedef struct {
+    const gchar *path;          // File holding the body (string chunk)
+    gint fd;                    // Open descriptor of path, or -1 to open per request
+    goffset offset;
+    gsize length;
+    guint status;
+    const gchar *content_type;  // String chunk, or NULL
+} PageLocation;
+
+static GHashTable *pages;       // URL -> PageLocation, read-only once serving starts
+static GStringChunk *strings;   // Paths and content types shared by the locations
+
+static gint port = 8081;
+static gchar **index_files = NULL;
+static gchar **archive_files = NULL;
+static gboolean quiet = FALSE;
+
+static void add_page(const gchar *url, const gchar *path, gint fd, goffset offset, gsize length,
+                     guint status, const gchar *content_type) {
+    PageLocation *page = g_new(PageLocation, 1);
+    page->path = g_string_chunk_insert_const(strings, path);
+    page->fd = fd;
+    page->offset = offset;
+    page->length = length;
+    page->status = status;
+    page->content_type = content_type ? g_string_chunk_insert_const(strings, content_type) : NULL;
+    g_hash_table_replace(pages, g_strdup(url), page);
+}
+
+/**
+ * @brief Load a page index written by the crawler's --page-index option.
+ */
+static gboolean load_page_index(const gchar *filename, GError **error) {
+    gchar *contents;
+    if (!g_file_get_contents(filename, &contents, NULL, error)) {
+        return FALSE;
+    }
+
+    guint loaded = 0;
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    for (gchar **line = lines; *line; line++) {
+        gchar **fields = g_strsplit(*line, "\t", 4);
+        if (g_strv_length(fields) == 4) {
+            add_page(fields[0], fields[1], -1, g_ascii_strtoll(fields[2], NULL, 10),
+                     g_ascii_strtoull(fields[3], NULL, 10), 200, NULL);
+            loaded++;
+        }
+        g_strfreev(fields);
+    }
+    g_strfreev(lines);
+    g_free(contents);
+
+    g_print("Loaded %u pages from index %s\n", loaded, filename);
+    return TRUE;
+}
+
+/**
+ * @brief Copy the value of the Content-Type line of recorded headers.
+ */
+static gchar* find_content_type(const gchar *headers, gsize length) {
+    const gchar *end = headers + length;
+    const gchar *line = headers;
+    while (line < end) {
+        const gchar *eol = memchr(line, '\n', end - line);
+        if (eol == NULL) eol = end;
+        if (eol - line > 13 && g_ascii_strncasecmp(line, "Content-Type:", 13) == 0) {
+            return g_strstrip(g_strndup(line + 13, eol - line - 13));
+        }
+        line = eol + 1;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Index the records of a crawl archive by URL.
+ *
+ * The archive is only mapped while it is scanned; bodies are later sent
+ * from the descriptor that stays open for the life of the server.
+ */
+static gboolean load_archive(const gchar *filename, GError **error) {
+    GMappedFile *file = g_mapped_file_new(filename, FALSE, error);
+    if (!file) {
+        return FALSE;
+    }
+
+    const gchar *data = g_mapped_file_get_contents(file);
+    gsize length = g_mapped_file_get_length(file);
+    guint32 version = 0;
+    if (length < 8 || memcmp(data, ARCHIVE_MAGIC, 4) != 0 ||
+        (memcpy(&version, data + 4, sizeof(version)), version != ARCHIVE_VERSION)) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "not a crawl archive");
+        g_mapped_file_unref(file);
+        return FALSE;
+    }
+
+    gint fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno), "%s", g_strerror(errno));
+        g_mapped_file_unref(file);
+        return FALSE;
+    }
+
+    guint loaded = 0;
+    gsize offset = 8;
+    while (length - offset >= ARCHIVE_RECORD_HEADER_SIZE) {
+        guint32 url_len, status, headers_len;
+        guint64 body_len;
+        memcpy(&url_len, data + offset, sizeof(url_len));
+        memcpy(&status, data + offset + 4, sizeof(status));
+        memcpy(&headers_len, data + offset + 8, sizeof(headers_len));
+        memcpy(&body_len, data + offset + 12, sizeof(body_len));
+
+        gsize payload = length - offset - ARCHIVE_RECORD_HEADER_SIZE;
+        if (url_len > payload || headers_len > payload - url_len || body_len > payload - url_len - headers_len) break;
+
+        // Transport failures are recorded with libsoup's pseudo status codes below 100
+        if (status >= 100) {
+            const gchar *record = data + offset + ARCHIVE_RECORD_HEADER_SIZE;
+            gchar *url = g_strndup(record, url_len);
+            gchar *content_type = find_content_type(record + url_len, headers_len);
+            add_page(url, filename, fd, offset + ARCHIVE_RECORD_HEADER_SIZE + url_len + headers_len,
+                     body_len, status, content_type);
+            g_free(content_type);
+            g_free(url);
+            loaded++;
+        }
+        offset += ARCHIVE_RECORD_HEADER_SIZE + url_len + headers_len + body_len;
+    }
+    if (offset != length) {
+        g_printerr("%s: ignoring truncated record at offset %" G_GSIZE_FORMAT "\n", filename, offset);
+    }
+    g_mapped_file_unref(file);
+
+    g_print("Loaded %u pages from archive %s\n", loaded, filename);
+    return TRUE;
+}
+
+/**
+ * @brief Extract the URL a request target asks for.
+ *
+ * @return A newly allocated URL, or NULL if the target names none.
+ */
+static gchar* target_to_url(const gchar *target) {
+    if (g_str_has_prefix(target, "http://") || g_str_has_prefix(target, "https://") ||
+        g_str_has_prefix(target, "file:")) {
+        return g_strdup(target);
+    }
+
+    const gchar *query = strchr(target, '?');
+    if (query == NULL) return NULL;
+    gchar **params = g_strsplit(query + 1, "&", -1);
+    gchar *url = NULL;
+    for (gchar **param = params; *param && !url; param++) {
+        if (g_str_has_prefix(*param, "url=")) {
+            url = g_uri_unescape_string(*param + 4, NULL);
+        }
+    }
+    g_strfreev(params);
+    return url;
+}
+
+/**
+ * @brief Send length bytes of fd from offset to the socket with sendfile().
+ *
+ * GSocket keeps its descriptor non-blocking, so a full socket buffer is
+ * waited out with g_socket_condition_wait().
+ */
+static gboolean send_body(GSocket *socket, gint fd, goffset offset, gsize length) {
+    off_t position = offset;
+    while (length > 0) {
+        ssize_t sent = sendfile(g_socket_get_fd(socket), fd, &position, MIN(length, G_MAXSSIZE));
+        if (sent > 0) {
+            length -= sent;
+        } else if (sent < 0 && errno == EAGAIN) {
+            if (!g_socket_condition_wait(socket, G_IO_OUT, NULL, NULL)) return FALSE;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return FALSE; // Error, or the file is shorter than indexed
+        }
+    }
+    return TRUE;
+}
+
+static gboolean send_error(GOutputStream *output, guint status, const gchar *reason) {
+    gchar *response = g_strdup_printf("HTTP/1.1 %u %s\r\nContent-Type: text/plain\r\n"
+                                      "Content-Length: %" G_GSIZE_FORMAT "\r\n\r\n%s\n",
+                                      status, reason, strlen(reason) + 1, reason);
+    gboolean ok = g_output_stream_write_all(output, response, strlen(response), NULL, NULL, NULL);
+    g_free(response);
+    return ok;
+}
+
+/**
+ * @brief Serve one request. Returns FALSE once the connection can't be reused.
+ */
+static gboolean serve_request(GSocketConnection *connection, GOutputStream *output,
+                              const gchar *method, const gchar *target) {
+    gboolean head = g_strcmp0(method, "HEAD") == 0;
+    if (!head && g_strcmp0(method, "GET") != 0) {
+        return send_error(output, 405, "Method Not Allowed");
+    }
+
+    gchar *url = target_to_url(target);
+    PageLocation *page = url ? g_hash_table_lookup(pages, url) : NULL;
+    if (!quiet) {
+        g_print("%s %s -> %s\n", method, url ? url : target, page ? page->path : "not found");
+    }
+    g_free(url);
+    if (page == NULL) {
+        return send_error(output, 404, "Not Found");
+    }
+
+    gint fd = page->fd >= 0 ? page->fd : open(page->path, O_RDONLY);
+    if (fd < 0) {
+        return send_error(output, 410, "Gone");
+    }
+
+    gchar *headers = g_strdup_printf("HTTP/1.1 %u %s\r\nContent-Type: %s\r\nContent-Length: %" G_GSIZE_FORMAT "\r\n\r\n",
+                                     page->status, page->status == 200 ? "OK" : "Recorded",
+                                     page->content_type ? page->content_type : "application/octet-stream",
+                                     page->length);
+    gboolean ok = g_output_stream_write_all(output, headers, strlen(headers), NULL, NULL, NULL);
+    g_free(headers);
+
+    if (ok && !head) {
+        ok = send_body(g_socket_connection_get_socket(connection), fd, page->offset, page->length);
+    }
+    if (page->fd < 0) {
+        close(fd);
+    }
+    return ok;
+}
+
+/**
+ * @brief Handle one connection: serve requests until the client closes it.
+ */
+static gboolean handle_connection(GThreadedSocketService *service, GSocketConnection *connection,
+                                  GObject *source_object, gpointer user_data) {
+    GInputStream *input = g_io_stream_get_input_stream(G_IO_STREAM(connection));
+    GOutputStream *output = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+    GDataInputStream *reader = g_data_input_stream_new(input);
+    g_data_input_stream_set_newline_type(reader, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+
+    gchar *request_line;
+    while ((request_line = g_data_input_stream_read_line(reader, NULL, NULL, NULL)) != NULL) {
+        gchar **request = g_strsplit(request_line, " ", 3);
+        gboolean keep_alive = g_strv_length(request) == 3 && g_strcmp0(request[2], "HTTP/1.1") == 0;
+
+        // Headers up to the blank line; only Connection matters here
+        gchar *header;
+        while ((header = g_data_input_stream_read_line(reader, NULL, NULL, NULL)) != NULL && *header) {
+            if (g_ascii_strncasecmp(header, "Connection:", 11) == 0) {
+                gchar *value = g_strstrip(header + 11);
+                keep_alive = g_ascii_strcasecmp(value, "keep-alive") == 0 ||
+                             (keep_alive && g_ascii_strcasecmp(value, "close") != 0);
+            }
+            g_free(header);
+        }
+
+        gboolean ok = header != NULL;
+        g_free(header);
+        if (ok && g_strv_length(request) >= 2) {
+            ok = serve_request(connection, output, request[0], request[1]);
+        } else if (ok) {
+            send_error(output, 400, "Bad Request");
+            ok = FALSE;
+        }
+
+        g_strfreev(request);
+        g_free(request_line);
+        if (!ok || !keep_alive) break;
+    }
+
+    g_object_unref(reader);
+    return TRUE;
+}
+
+static GOptionEntry option_entries[] = {
+    { "port", 'p', 0, G_OPTION_ARG_INT, &port, "Port to listen on (default 8081)", "PORT" },
+    { "index", 'i', 0, G_OPTION_ARG_FILENAME_ARRAY, &index_files, "Page index written by glib_web_crawler --page-index", "FILE" },
+    { "archive", 'a', 0, G_OPTION_ARG_FILENAME_ARRAY, &archive_files, "Crawl archive written by glib_web_crawler --record", "FILE" },
+    { "quiet", 'q', 0, G_OPTION_ARG_NONE, &quiet, "Do not log requests", NULL },
+    { NULL }
+};
+
+int main(int argc, char *argv[]) {
+    GError *error = NULL;
+    GOptionContext *context = g_option_context_new("- serve crawled pages by URL");
+    g_option_context_add_main_entries(context, option_entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    pages = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    strings = g_string_chunk_new(4096);
+    for (gchar **file = archive_files; file && *file; file++) {
+        if (!load_archive(*file, &error)) {
+            g_printerr("Failed to load archive %s: %s\n", *file, error->message);
+            g_error_free(error);
+            return 1;
+        }
+    }
+    // Saved pages take precedence over archived responses for the same URL
+    for (gchar **file = index_files; file && *file; file++) {
+        if (!load_page_index(*file, &error)) {
+            g_printerr("Failed to load page index %s: %s\n", *file, error->message);
+            g_error_free(error);
+            return 1;
+        }
+    }
+    if (g_hash_table_size(pages) == 0) {
+        g_printerr("No pages to serve; pass --index or --archive\n");
+        return 1;
+    }
+
+    // Listen on the loopback interface only
+    GSocketService *service = g_threaded_socket_service_new(256);
+    GInetAddress *loopback = g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4);
+    GSocketAddress *address = g_inet_socket_address_new(loopback, port);
+    if (!g_socket_listener_add_address(G_SOCKET_LISTENER(service), address, G_SOCKET_TYPE_STREAM,
+                                       G_SOCKET_PROTOCOL_TCP, NULL, NULL, &error)) {
+        g_printerr("Failed to listen on port %d: %s\n", port, error->message);
+        g_error_free(error);
+        return 1;
+    }
+    g_object_unref(address);
+    g_object_unref(loopback);
+
+    g_signal_connect(service, "run", G_CALLBACK(handle_connection), NULL);
+    g_socket_service_start(service);
+    g_print("Page server listening on http://127.0.0.1:%d/ with %u pages\n", port, g_hash_table_size(pages));
+
+    GMainLoop *main_loop = g_main_loop_new(NULL, FALSE);
+    g_main_loop_run(main_loop);
+
+    g_main_loop_unref(main_loop);
+    g_object_unref(service);
+    return 0;
+}
@@ -0,0 +1,448 @@
+/**
+ * @file crawler_test_server.c
+ * @brief A loopback HTTP server with latency and failure injection for crawler testing.
+ *
+ * This program serves an endless synthetic site on 127.0.0.1 so the web crawler
+ * can be exercised without touching real websites. Every page links to a few
+ * child pages. A profile file selects, per path pattern, how the server should
+ * misbehave: added latency drawn from a distribution, slow-drip bodies,
+ * connection resets, bursts of 5xx errors, redirect loops and huge responses.
+ *
+ * Features:
+ * - One thread per connection with GThreadedSocketService.
+ * - Rules matched against the request path with GPatternSpec globs, first match wins.
+ * - Latency distributions: fixed, uniform, exponential, lognormal and pareto.
+ * - Profiles are GKeyFile files, one group per rule.
+ *
+ * Compilation:
+ * gcc -o crawler_test_server crawler_test_server.c `pkg-config --cflags --libs glib-2.0 gio-2.0` -lm
+ *
+ * Execution:
+ * ./crawler_test_server [--port=8080] [--profile=FILE] [--seed=N] [--quiet]
+ *
+ * Example profile:
+ * [slow-pages]
+ * pattern=/slow*
+ * # Median 200 ms, written 512 bytes every 100 ms
+ * latency=lognormal:200:0.8
+ * drip=512:100
+ *
+ * [flaky]
+ * pattern=/flaky*
+ * # Reset 20% of connections; the first 5 of every 20 requests get a 503
+ * reset=0.2
+ * error_burst=503:5:20
+ *
+ * [loop]
+ * pattern=/loop*
+ * # 302 to the same path with ?hop=N+1, forever
+ * redirect=loop
+ *
+ * [huge]
+ * pattern=/huge*
+ * # 100 MB body, reset after the first 1 MB
+ * size=104857600
+ * reset_after=1048576
+ *
+ * Then crawl it with:
+ * ./glib_web_crawler http://127.0.0.1:8080/
+ *
+ * @author: Nelson Chung
+ * @date: 2024.11.23
+ */
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+// Shape of the latency added before a response
+typedef enum {
+    LATENCY_NONE,
+    LATENCY_FIXED,       // fixed:MS
+    LATENCY_UNIFORM,     // uniform:MIN_MS:MAX_MS
+    LATENCY_EXPONENTIAL, // exponential:MEAN_MS
+    LATENCY_LOGNORMAL,   // lognormal:MEDIAN_MS:SIGMA
+    LATENCY_PARETO,      // pareto:MIN_MS:ALPHA
+} LatencyKind;
+
+typedef struct {
+    LatencyKind kind;
+    gdouble a;
+    gdouble b;
+} Latency;
+
+// One profile rule, applied to requests whose path matches pattern
+typedef struct {
+    gchar *name;
+    GPatternSpec *pattern;
+    Latency latency;
+    guint drip_bytes;      // Write the body in chunks of this size...
+    guint drip_interval;   // ...pausing this many milliseconds in between
+    gdouble reset_probability;
+    guint64 reset_after;   // Reset after this many body bytes (0 = never)
+    guint burst_status;    // Error status for the first burst_length of
+    guint burst_length;    // every burst_period requests
+    guint burst_period;
+    gboolean redirect_loop;
+    guint status;          // Fixed status code for every request (0 = 200)
+    guint64 size;          // Pad the page body to this many bytes
+    guint links;           // Child links per generated page
+    gint requests;         // Requests matched so far
+} Rule;
+
+static GPtrArray *rules;
+static Rule default_rule = { .name = "default", .links = 5 };
+static GMutex rand_mutex;
+static GRand *rand_source;
+
+static gint port = 8080;
+static gchar *profile_file = NULL;
+static gint seed = 0;
+static gboolean quiet = FALSE;
+
+/**
+ * @brief Parse a latency specification such as "uniform:10:50".
+ *
+ * @return TRUE on success, FALSE if the specification is not understood.
+ */
+static gboolean parse_latency(const gchar *spec, Latency *latency) {
+    gchar **parts = g_strsplit(spec, ":", 3);
+    guint count = g_strv_length(parts);
+    gboolean ok = TRUE;
+
+    latency->a = count > 1 ? g_ascii_strtod(parts[1], NULL) : 0;
+    latency->b = count > 2 ? g_ascii_strtod(parts[2], NULL) : 0;
+
+    if (g_strcmp0(parts[0], "fixed") == 0 && count == 2) {
+        latency->kind = LATENCY_FIXED;
+    } else if (g_strcmp0(parts[0], "uniform") == 0 && count == 3) {
+        latency->kind = LATENCY_UNIFORM;
+    } else if (g_strcmp0(parts[0], "exponential") == 0 && count == 2) {
+        latency->kind = LATENCY_EXPONENTIAL;
+    } else if (g_strcmp0(parts[0], "lognormal") == 0 && count == 3) {
+        latency->kind = LATENCY_LOGNORMAL;
+    } else if (g_strcmp0(parts[0], "pareto") == 0 && count == 3 && latency->b > 0) {
+        latency->kind = LATENCY_PARETO;
+    } else {
+        ok = FALSE;
+    }
+
+    g_strfreev(parts);
+    return ok;
+}
+
+/**
+ * @brief Draw a uniform random number in (0, 1).
+ */
+static gdouble random_unit(void) {
+    g_mutex_lock(&rand_mutex);
+    gdouble value = g_rand_double(rand_source);
+    g_mutex_unlock(&rand_mutex);
+    return value > 0 ? value : G_MINDOUBLE;
+}
+
+/**
+ * @brief Sample a delay in milliseconds from a latency distribution.
+ */
+static gdouble sample_latency(const Latency *latency) {
+    switch (latency->kind) {
+    case LATENCY_FIXED:
+        return latency->a;
+    case LATENCY_UNIFORM:
+        return latency->a + (latency->b - latency->a) * random_unit();
+    case LATENCY_EXPONENTIAL:
+        return -latency->a * log(random_unit());
+    case LATENCY_LOGNORMAL: {
+        // Box-Muller transform for a standard normal sample
+        gdouble normal = sqrt(-2.0 * log(random_unit())) * cos(2.0 * G_PI * random_unit());
+        return latency->a * exp(latency->b * normal);
+    }
+    case LATENCY_PARETO:
+        return latency->a / pow(random_unit(), 1.0 / latency->b);
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Load the rules of a profile file, one GKeyFile group per rule.
+ */
+static gboolean load_profile(const gchar *filename, GError **error) {
+    GKeyFile *key_file = g_key_file_new();
+    if (!g_key_file_load_from_file(key_file, filename, G_KEY_FILE_NONE, error)) {
+        g_key_file_free(key_file);
+        return FALSE;
+    }
+
+    gchar **groups = g_key_file_get_groups(key_file, NULL);
+    for (gchar **group = groups; *group; group++) {
+        gchar *pattern = g_key_file_get_string(key_file, *group, "pattern", NULL);
+        if (!pattern) {
+            g_printerr("Rule [%s] has no pattern, skipped\n", *group);
+            continue;
+        }
+
+        Rule *rule = g_new0(Rule, 1);
+        rule->name = g_strdup(*group);
+        rule->pattern = g_pattern_spec_new(pattern);
+        rule->links = default_rule.links;
+        g_free(pattern);
+
+        gchar *value;
+        if ((value = g_key_file_get_string(key_file, *group, "latency", NULL))) {
+            if (!parse_latency(value, &rule->latency)) {
+                g_printerr("Rule [%s]: bad latency \"%s\"\n", *group, value);
+            }
+            g_free(value);
+        }
+        if ((value = g_key_file_get_string(key_file, *group, "drip", NULL))) {
+            sscanf(value, "%u:%u", &rule->drip_bytes, &rule->drip_interval);
+            g_free(value);
+        }
+        if ((value = g_key_file_get_string(key_file, *group, "error_burst", NULL))) {
+            sscanf(value, "%u:%u:%u", &rule->burst_status, &rule->burst_length, &rule->burst_period);
+            g_free(value);
+        }
+        if ((value = g_key_file_get_string(key_file, *group, "redirect", NULL))) {
+            rule->redirect_loop = g_strcmp0(value, "loop") == 0;
+            g_free(value);
+        }
+        if (g_key_file_has_key(key_file, *group, "reset", NULL)) {
+            rule->reset_probability = g_key_file_get_double(key_file, *group, "reset", NULL);
+        }
+        if (g_key_file_has_key(key_file, *group, "reset_after", NULL)) {
+            rule->reset_after = g_key_file_get_uint64(key_file, *group, "reset_after", NULL);
+        }
+        if (g_key_file_has_key(key_file, *group, "status", NULL)) {
+            rule->status = g_key_file_get_integer(key_file, *group, "status", NULL);
+        }
+        if (g_key_file_has_key(key_file, *group, "size", NULL)) {
+            rule->size = g_key_file_get_uint64(key_file, *group, "size", NULL);
+        }
+        if (g_key_file_has_key(key_file, *group, "links", NULL)) {
+            rule->links = g_key_file_get_integer(key_file, *group, "links", NULL);
+        }
+
+        g_ptr_array_add(rules, rule);
+    }
+
+    g_strfreev(groups);
+    g_key_file_free(key_file);
+    return TRUE;
+}
+
+/**
+ * @brief Find the first rule whose pattern matches the path.
+ */
+static Rule* match_rule(const gchar *path) {
+    for (guint i = 0; i < rules->len; i++) {
+        Rule *rule = g_ptr_array_index(rules, i);
+        if (g_pattern_spec_match_string(rule->pattern, path)) {
+            return rule;
+        }
+    }
+    return &default_rule;
+}
+
+/**
+ * @brief Abort the connection with a TCP reset instead of an orderly close.
+ */
+static void reset_connection(GSocketConnection *connection) {
+    GSocket *socket = g_socket_connection_get_socket(connection);
+    struct linger linger = { 1, 0 };
+    setsockopt(g_socket_get_fd(socket), SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+    g_socket_close(socket, NULL);
+}
+
+/**
+ * @brief Generate the HTML page for a path, linking to its child pages.
+ */
+static GString* generate_page(const gchar *path, guint links) {
+    GString *page = g_string_new("<html><body>\n");
+    const gchar *separator = g_str_has_suffix(path, "/") ? "" : "/";
+    g_string_append_printf(page, "<h1>%s</h1>\n", path);
+    for (guint i = 0; i < links; i++) {
+        g_string_append_printf(page, "<a href=\"%s%spage%u.html\">page %u</a>\n", path, separator, i, i);
+    }
+    g_string_append(page, "</body></html>\n");
+    return page;
+}
+
+/**
+ * @brief Write the response body, honouring drip, padding and reset settings.
+ *
+ * @return FALSE if the connection was reset or broke while writing.
+ */
+static gboolean write_body(GOutputStream *output, GSocketConnection *connection,
+                           const Rule *rule, const GString *page, guint64 size) {
+    static const gchar filler[4096] = { [0 ... 4095] = ' ' };
+    guint64 written = 0;
+
+    while (written < size) {
+        guint64 chunk = size - written;
+        const gchar *data;
+        if (written < page->len) {
+            data = page->str + written;
+            chunk = MIN(chunk, page->len - written);
+        } else {
+            data = filler;
+            chunk = MIN(chunk, sizeof(filler));
+        }
+        if (rule->drip_bytes > 0) chunk = MIN(chunk, rule->drip_bytes);
+        if (rule->reset_after > 0 && written + chunk > rule->reset_after) {
+            chunk = rule->reset_after - written;
+        }
+
+        if (chunk > 0 && !g_output_stream_write_all(output, data, chunk, NULL, NULL, NULL)) {
+            return FALSE;
+        }
+        written += chunk;
+
+        if (rule->reset_after > 0 && written >= rule->reset_after) {
+            reset_connection(connection);
+            return FALSE;
+        }
+        if (rule->drip_bytes > 0 && written < size) {
+            g_output_stream_flush(output, NULL, NULL);
+            g_usleep((gulong)rule->drip_interval * 1000);
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * @brief Handle one connection: read the request, apply the matching rule, respond.
+ */
+static gboolean handle_connection(GThreadedSocketService *service, GSocketConnection *connection,
+                                  GObject *source_object, gpointer user_data) {
+    GInputStream *input = g_io_stream_get_input_stream(G_IO_STREAM(connection));
+    GOutputStream *output = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+    GDataInputStream *reader = g_data_input_stream_new(input);
+    g_data_input_stream_set_newline_type(reader, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+
+    // Request line, then skip headers up to the blank line
+    gchar *request_line = g_data_input_stream_read_line(reader, NULL, NULL, NULL);
+    gchar *header;
+    while ((header = g_data_input_stream_read_line(reader, NULL, NULL, NULL)) != NULL && *header) {
+        g_free(header);
+    }
+    g_free(header);
+
+    gchar **request = request_line ? g_strsplit(request_line, " ", 3) : NULL;
+    if (!request || g_strv_length(request) < 2) {
+        g_strfreev(request);
+        g_free(request_line);
+        g_object_unref(reader);
+        return TRUE;
+    }
+
+    gchar *target = request[1];
+    gchar *query = strchr(target, '?');
+    gchar *path = g_strndup(target, query ? (gsize)(query - target) : strlen(target));
+    Rule *rule = match_rule(path);
+    gint request_number = g_atomic_int_add(&rule->requests, 1);
+
+    gdouble delay = sample_latency(&rule->latency);
+    if (!quiet) {
+        g_print("%s %s -> rule [%s], delay %.1f ms\n", request[0], target, rule->name, delay);
+    }
+    if (delay > 0) {
+        g_usleep((gulong)(delay * 1000));
+    }
+
+    if (rule->reset_probability > 0 && random_unit() < rule->reset_probability) {
+        reset_connection(connection);
+        goto out;
+    }
+
+    guint status = rule->status ? rule->status : 200;
+    if (rule->burst_period > 0 && (guint)request_number % rule->burst_period < rule->burst_length) {
+        status = rule->burst_status;
+    }
+
+    GString *headers = g_string_new(NULL);
+    if (rule->redirect_loop && status == 200) {
+        guint hop = query && g_str_has_prefix(query, "?hop=") ? atoi(query + 5) : 0;
+        g_string_append_printf(headers, "HTTP/1.1 302 Found\r\nLocation: %s?hop=%u\r\n"
+                               "Content-Length: 0\r\nConnection: close\r\n\r\n", path, hop + 1);
+        g_output_stream_write_all(output, headers->str, headers->len, NULL, NULL, NULL);
+        g_string_free(headers, TRUE);
+        goto out;
+    }
+
+    GString *page = generate_page(path, status == 200 ? rule->links : 0);
+    guint64 size = MAX(rule->size, page->len);
+    g_string_append_printf(headers, "HTTP/1.1 %u %s\r\nContent-Type: text/html\r\n"
+                           "Content-Length: %" G_GUINT64_FORMAT "\r\nConnection: close\r\n\r\n",
+                           status, status == 200 ? "OK" : "Injected Error", size);
+
+    if (g_output_stream_write_all(output, headers->str, headers->len, NULL, NULL, NULL)) {
+        write_body(output, connection, rule, page, size);
+    }
+    g_string_free(headers, TRUE);
+    g_string_free(page, TRUE);
+
+out:
+    g_free(path);
+    g_strfreev(request);
+    g_free(request_line);
+    g_object_unref(reader);
+    return TRUE;
+}
+
+static GOptionEntry option_entries[] = {
+    { "port", 'p', 0, G_OPTION_ARG_INT, &port, "Port to listen on (default 8080)", "PORT" },
+    { "profile", 0, 0, G_OPTION_ARG_FILENAME, &profile_file, "Latency and failure injection profile", "FILE" },
+    { "seed", 0, 0, G_OPTION_ARG_INT, &seed, "Random seed, for repeatable runs", "N" },
+    { "quiet", 'q', 0, G_OPTION_ARG_NONE, &quiet, "Do not log requests", NULL },
+    { NULL }
+};
+
+int main(int argc, char *argv[]) {
+    GError *error = NULL;
+    GOptionContext *context = g_option_context_new("- loopback HTTP server for crawler testing");
+    g_option_context_add_main_entries(context, option_entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    rand_source = seed ? g_rand_new_with_seed(seed) : g_rand_new();
+    rules = g_ptr_array_new();
+    if (profile_file && !load_profile(profile_file, &error)) {
+        g_printerr("Failed to load profile %s: %s\n", profile_file, error->message);
+        g_error_free(error);
+        return 1;
+    }
+
+    // Listen on the loopback interface only
+    GSocketService *service = g_threaded_socket_service_new(256);
+    GInetAddress *loopback = g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4);
+    GSocketAddress *address = g_inet_socket_address_new(loopback, port);
+    if (!g_socket_listener_add_address(G_SOCKET_LISTENER(service), address, G_SOCKET_TYPE_STREAM,
+                                       G_SOCKET_PROTOCOL_TCP, NULL, NULL, &error)) {
+        g_printerr("Failed to listen on port %d: %s\n", port, error->message);
+        g_error_free(error);
+        return 1;
+    }
+    g_object_unref(address);
+    g_object_unref(loopback);
+
+    g_signal_connect(service, "run", G_CALLBACK(handle_connection), NULL);
+    g_socket_service_start(service);
+    g_print("Test server listening on http://127.0.0.1:%d/ with %u rules\n", port, rules->len);
+
+    GMainLoop *main_loop = g_main_loop_new(NULL, FALSE);
+    g_main_loop_run(main_loop);
+
+    g_main_loop_unref(main_loop);
+    g_object_unref(service);
+    return 0;
+}
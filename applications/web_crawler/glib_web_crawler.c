@@ -10,38 +10,314 @@
  * - URL deduplication using GHashTable.
  * - Depth control to limit recursive crawling.
  * - Resolving relative URLs to absolute URLs.
+ * - Link graph recording, exported as a gap-encoded CSR graph.
+ * - Multi-threaded PageRank/HITS over the link graph, optionally used to
+ *   prioritise the crawl frontier.
+ * - Per-thread tracing of every URL's stages, exported as Chrome trace-event
+ *   JSON for Perfetto or chrome://tracing.
+ * - Recording fetched responses to an archive and replaying a crawl from it
+ *   without touching the network.
+ * - Crawling file:// URLs and offline site mirrors straight from memory-mapped
+ *   files.
+ * - A memory governor that keeps response bodies, the frontier and the
+ *   visited set within a budget by pausing dispatch, shrinking concurrency
+ *   and spilling the frontier to disk.
+ * - Per-host rate limiting in the dispatcher, which skips over throttled
+ *   hosts instead of putting fetch threads to sleep.
+ * - A UNIX control socket to retune, pause, resume or drain a running crawl
+ *   and to query its statistics.
+ * - Fixed-memory sketches of the crawl: HyperLogLog counts of distinct URLs
+ *   and hosts, and count-min heavy hitters among hosts and path prefixes,
+ *   to spot crawler traps and skewed hosts while the crawl runs.
+ * - An embedding API (glib_web_crawler.h) with zero-copy page and link
+ *   callbacks; build with -DCRAWLER_NO_MAIN to link it into another program.
  *
  * Compilation:
- * gcc -o glib_web_crawler glib_web_crawler.c `pkg-config --cflags --libs glib-2.0 libsoup-2.4`
+ * gcc -o glib_web_crawler glib_web_crawler.c `pkg-config --cflags --libs glib-2.0 gio-unix-2.0 libsoup-2.4` -lm
  *
  * Execution:
- * ./glib_web_crawler <start_url1> [<start_url2> ...] [max_threads]
+ * ./glib_web_crawler [options] <start_url1> [<start_url2> ...] [max_threads]
+ *
+ * Options:
+ * -t, --threads=N        Number of fetch threads (default 5)
+ * -d, --max-depth=N      Maximum crawl depth (default 3)
+ * --graph-out=FILE       Write the link graph to FILE (CSR) and FILE.nodes (URLs and scores)
+ * --rank-interval=N      Recompute PageRank every N fetched pages and crawl high-rank URLs first.
+ *                        Each pass rebuilds the whole graph on the dispatcher, so N is at
+ *                        least 100 and passes space out to a quarter of the pages fetched
+ *                        so far; exact re-ranking is only practical for small crawls
+ * --trace=FILE           Record queued/fetching/parsing/saving spans and write them to FILE
+ * --record=FILE          Append every response (status, headers, body) to the archive FILE
+ * --page-index=FILE      Append "URL<TAB>path<TAB>offset<TAB>length" for every saved page to FILE,
+ *                        for crawler_page_server
+ * --replay=FILE          Serve responses from the archive FILE instead of the network
+ * --mirror-root=DIR      Serve http(s) URLs from the wget-style mirror in DIR
+ *                        (DIR/HOST/PATH) and resolve root-relative links of
+ *                        file:// pages against DIR
+ * --memory-budget=MB     Keep bodies, frontier and visited set under MB megabytes
+ * --max-body-size=BYTES  Give up on responses larger than BYTES (default 16 MB, 0 = no limit)
+ * --host-rate=N          Fetch at most N pages per second from each host (0 = no limit)
+ * --control-socket=PATH  Accept control commands on a UNIX socket at PATH
+ * --stats-interval=SEC   Print the crawl statistics and sketches every SEC seconds
+ *
+ * Control commands (one per line, e.g. with `socat - UNIX-CONNECT:PATH`):
+ * threads N | depth N | rate HOST|* N | pause | resume | drain | stats | help
  *
  * Example:
  * ./glib_web_crawler https://example.com https://another.com 10
+ * ./glib_web_crawler --graph-out=crawl.csr --rank-interval=100 https://example.com
+ * ./glib_web_crawler --mirror-root=mirror https://example.com
+ * ./glib_web_crawler --mirror-root=mirror file://$PWD/mirror/index.html
  *
  * @author: Nelson Chung
  * @date: 2024.11.23*/
 
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
 #include <libsoup/soup.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h> // For rand()
+#include <string.h>
+#include "glib_web_crawler.h"
 
 // Structure to represent a URL with its crawling depth
 typedef struct {
     gchar *url;
     int depth;
+    guint32 node_id; // Node of this URL in the link graph
+    gint64 queued_at; // Monotonic time the URL entered the frontier
 } UrlItem;
 
-// URL queue, mutex, and visited URLs hash table
-GQueue *url_queue;
-GMutex queue_mutex;
-GHashTable *visited_urls;
+// A directed link between two link graph nodes
+typedef struct {
+    guint32 src;
+    guint32 dst;
+} LinkEdge;
+
+/*
+ * Compressed sparse row graph. The neighbours of node v are stored as
+ * varints in adjacency[offsets[v] .. offsets[v + 1]): the first one as the
+ * zigzag-encoded difference to v, the rest as the gap to the previous
+ * neighbour minus one (neighbour lists are sorted and deduplicated).
+ */
+typedef struct {
+    guint32 num_nodes;
+    guint64 num_edges;
+    guint64 *offsets;  // num_nodes + 1 byte offsets into adjacency
+    guint32 *degrees;  // Number of neighbours of each node
+    guint8 *adjacency;
+    gsize adjacency_len;
+} CsrGraph;
+
+// Trace events recorded by one thread; only that thread appends to it
+typedef struct {
+    guint tid;
+    GArray *events;       // TraceEvent list
+    GStringChunk *urls;   // Storage for the URLs referenced by events
+} TraceBuffer;
+
+// A completed span of one crawl stage for one URL
+typedef struct {
+    const gchar *stage;   // Static stage name
+    const gchar *url;     // Owned by the buffer's string chunk
+    gint64 start;         // Monotonic start time in microseconds
+    gint64 duration;
+} TraceEvent;
+
+/*
+ * A fetched response. body and headers are views owned by the backend
+ * and stay valid until fetch_result_clear(); body is not NUL-terminated.
+ * headers holds "Name: value\r\n" lines.
+ */
+typedef struct {
+    guint status;
+    const gchar *reason;
+    const gchar *headers;
+    gsize headers_len;
+    const gchar *body;
+    gsize body_len;
+    gpointer owner;               // Backend object keeping the views alive
+    GDestroyNotify release_owner;
+} FetchResult;
+
+// A fetch backend fills in result for url; it must always set a status
+typedef void (*FetchFunc)(Crawler *crawler, const gchar *url, FetchResult *result);
+
+/*
+ * Crawl archive: "CRWA" and a guint32 version, followed by one record per
+ * response: guint32 url_len, guint32 status, guint32 headers_len,
+ * guint64 body_len, then the URL, headers and body bytes. Integers are in
+ * host byte order.
+ */
+#define ARCHIVE_MAGIC "CRWA"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_RECORD_HEADER_SIZE (3 * sizeof(guint32) + sizeof(guint64))
+
+// A replay archive mapped into memory, indexed by URL
+typedef struct {
+    GMappedFile *file;
+    GHashTable *records; // URL -> offset of the record in the mapping
+} ReplayArchive;
+
+/*
+ * Memory governor. Byte counts are estimates of heap use including
+ * per-entry overhead. Dispatch pauses above the high watermark and
+ * resumes below the low one.
+ */
+typedef struct {
+    gsize budget;           // 0 disables the governor
+    gssize body_bytes;      // Response bodies held by fetches (atomic)
+    gsize frontier_bytes;   // UrlItems in url_queue (queue_mutex)
+    gsize visited_bytes;    // visited_urls and link graph nodes (queue_mutex)
+    guint concurrency;      // Current limit on fetches in flight (queue_mutex)
+    gboolean over_budget;   // Above the high watermark (queue_mutex)
+    FILE *spill_file;       // Frontier entries moved out of memory
+    goffset spill_read;     // Offset of the next spilled entry to reload
+    goffset spill_write;    // End of the spilled entries
+    guint spilled;          // Entries currently in the spill file
+} MemoryGovernor;
+
+#define GOVERNOR_HIGH_WATERMARK 0.90
+#define GOVERNOR_LOW_WATERMARK 0.75
+#define HASH_ENTRY_OVERHEAD (4 * sizeof(gpointer))
+
+// Rate limit state of one host. Protected by rate_mutex.
+typedef struct {
+    gdouble rate;      // Pages per second, 0 = use host_rate
+    gint64 last_start; // Monotonic time the last fetch was dispatched, 0 = never
+} HostRate;
+
+// Control socket service running on its own thread and main context
+typedef struct {
+    Crawler *crawler;
+    gchar *path;
+    GThread *thread;
+    GMainContext *context;
+    GMainLoop *loop;
+    GSocketService *service;
+    GCancellable *cancellable; // Cancelled to end the client connections
+    GMutex mutex;
+    GCond cond;
+    guint connections;         // Accepted connections not yet finished
+} ControlSocket;
+
+// Link graph recorded while crawling. Protected by queue_mutex.
+typedef struct {
+    GPtrArray *node_urls; // Node id -> URL (strings owned by visited_urls)
+    GArray *edges;        // LinkEdge list, in discovery order
+    GByteArray *queued;   // Node id -> non-zero once the URL was queued for crawling
+    gdouble *ranks;       // Last PageRank result, indexed by node id
+    guint32 ranked_nodes; // Number of entries in ranks
+} LinkGraph;
+
+/*
+ * Crawl sketches, updated by the fetch threads for every link found.
+ * Their memory is fixed whatever the crawl size and all counters are
+ * updated with atomics, so extract_urls() takes no extra lock except
+ * when a heavy hitter enters or moves in a top list.
+ */
+#define HLL_PRECISION 14
+#define HLL_REGISTERS (1 << HLL_PRECISION) // Standard error 1.04 / sqrt(16384) = 0.8%
+#define CMS_DEPTH 4
+#define CMS_WIDTH 4096
+#define TOPK_SIZE 10
+
+typedef struct {
+    gint registers[HLL_REGISTERS]; // Largest leading-zero rank seen per bucket (atomic)
+} HyperLogLog;
+
+typedef struct {
+    gchar *key;
+    gint count;
+} HeavyHitter;
+
+// Count-min sketch plus the TOPK_SIZE keys with the largest estimates
+typedef struct {
+    gint counters[CMS_DEPTH][CMS_WIDTH]; // (atomic)
+    GMutex mutex;                        // Protects top
+    HeavyHitter top[TOPK_SIZE];
+    gint threshold;                      // Smallest count in a full top list (atomic)
+} HeavyHitters;
+
+typedef struct {
+    HyperLogLog urls;
+    HyperLogLog hosts;
+    HeavyHitters top_hosts;     // Keyed by host
+    HeavyHitters top_prefixes;  // Keyed by host and first path segment
+} CrawlSketches;
+
+// Per-thread trace buffers, registered in the crawler's trace_buffers on
+// first use. Pool threads outlive a crawl, so each thread remembers which
+// crawl (trace generation) its buffer belongs to.
+typedef struct {
+    guint generation;
+    TraceBuffer *buffer;
+} TraceThreadSlot;
+
+static GPrivate trace_buffer_key = G_PRIVATE_INIT(g_free);
+static gint trace_generation = 0; // Last generation handed out (atomic)
+
+struct _Crawler {
+    CrawlerConfig config; // threads, max_depth and host_rate change at runtime
+
+    // URL queue, mutex, and visited URLs hash table (URL -> node id + 1)
+    GQueue *url_queue;
+    GMutex queue_mutex;
+    GCond queue_cond;
+    GHashTable *visited_urls;
+    LinkGraph link_graph;
+    CrawlSketches *sketches;
+
+    GThreadPool *thread_pool;
+
+    // Dispatcher state, protected by queue_mutex
+    guint active_fetches;
+    guint pages_fetched;
+    guint pages_failed;
+    gboolean dispatch_paused;
+    gboolean draining;
+    gint64 crawl_started;
+
+    // Per-host rate limits
+    GHashTable *host_rates;
+    GMutex rate_mutex;
+
+    // Fetch backend, archive being recorded and archive being replayed
+    FetchFunc fetch_backend;
+    FILE *record_file;
+    GMutex record_mutex;
+    ReplayArchive *replay_archive;
+    FILE *page_index;     // Where saved pages are listed, protected by record_mutex
+    gchar *mirror_root_uri; // file:// URI of the mirror root, ending in '/'
+    gboolean allow_file_urls; // Seeded with file:// URLs or serving a mirror
+
+    MemoryGovernor governor;
+    ControlSocket *control_socket;
 
-// Thread pool and depth limit
-GThreadPool *thread_pool;
-int max_depth = 3;
+    // Trace buffers of the current crawl
+    GPtrArray *trace_buffers;
+    GMutex trace_mutex;
+    guint trace_generation;
+    gint64 trace_epoch;
+
+    // Embedder callbacks, run on the fetch threads
+    CrawlerPageFunc page_func;
+    gpointer page_data;
+    GDestroyNotify page_destroy;
+    CrawlerLinkFunc link_func;
+    gpointer link_data;
+    GDestroyNotify link_destroy;
+};
+
+#define PAGERANK_DAMPING 0.85
+#define PAGERANK_MAX_ITERATIONS 50
+#define PAGERANK_TOLERANCE 1e-9
+#define RANK_MIN_INTERVAL 100 // Fewest fetched pages between two ranking passes
+#define RANK_GROWTH_DIVISOR 4 // Passes are at least pages_fetched / 4 apart
+#define HITS_ITERATIONS 30
 
 /**
  * @brief Generate a unique filename for each URL.
@@ -49,7 +325,7 @@ int max_depth = 3;
  * @param url The URL being saved.
  * @return A dynamically allocated string containing the filename.
  */
-gchar* generate_filename(const gchar *url) {
+static gchar* generate_filename(const gchar *url) {
     // Extract basename from URL and append a random number for uniqueness
     gchar *basename = g_path_get_basename(url);
     gchar *filename = g_strdup_printf("fetched_content_%s_%d.html", basename, rand());
@@ -60,16 +336,29 @@ gchar* generate_filename(const gchar *url) {
 /**
  * @brief Save content to a file with a unique name.
  *
+ * With --page-index the file is also listed in the page index, so the
+ * page can be found by URL later.
+ *
  * @param url The URL of the content (used for generating the filename).
  * @param content The content to save.
+ * @param length Length of content in bytes.
  */
-void save_to_file(const gchar *url, const gchar *content) {
+static void save_to_file(Crawler *crawler, const gchar *url, const gchar *content, gsize length) {
     gchar *filename = generate_filename(url);
     FILE *file = fopen(filename, "w");
     if (file) {
-        fprintf(file, "%s", content);
+        fwrite(content, 1, length, file);
         fclose(file);
         g_print("Content saved to %s\n", filename);
+
+        if (crawler->page_index) {
+            gchar *path = g_canonicalize_filename(filename, NULL);
+            g_mutex_lock(&crawler->record_mutex);
+            fprintf(crawler->page_index, "%s\t%s\t0\t%" G_GSIZE_FORMAT "\n", url, path, length);
+            fflush(crawler->page_index);
+            g_mutex_unlock(&crawler->record_mutex);
+            g_free(path);
+        }
     } else {
         g_printerr("Failed to save content to %s\n", filename);
     }
@@ -83,7 +372,7 @@ void save_to_file(const gchar *url, const gchar *content) {
  * @param relative_url The relative URL to resolve.
  * @return A dynamically allocated string containing the resolved URL.
  */
-gchar* resolve_url(const gchar *base_url, const gchar *relative_url) {
+static gchar* resolve_url(const gchar *base_url, const gchar *relative_url) {
     SoupURI *base = soup_uri_new(base_url);
     SoupURI *resolved = soup_uri_new_with_base(base, relative_url);
     gchar *resolved_url = soup_uri_to_string(resolved, FALSE);
@@ -93,149 +382,2198 @@ gchar* resolve_url(const gchar *base_url, const gchar *relative_url) {
 }
 
 /**
- * @brief Extract URLs from HTML content and add them to the queue.
+ * @brief Resolve a link found on base_url.
  *
- * @param content The HTML content to scan.
- * @param base_url The base URL for resolving relative URLs.
- * @param depth The current depth of crawling.
+ * Root-relative links on file:// pages point at the mirror root rather
+ * than the filesystem root when --mirror-root is set.
  */
-void extract_urls(const gchar *content, const gchar *base_url, int depth) {
-    if (depth >= max_depth) return;
+static gchar* resolve_link(Crawler *crawler, const gchar *base_url, const gchar *link) {
+    if (crawler->mirror_root_uri && link[0] == '/' && link[1] != '/' && g_str_has_prefix(base_url, "file:")) {
+        gchar *rooted = g_strconcat(crawler->mirror_root_uri, link + 1, NULL);
+        gchar *resolved = resolve_url(rooted, "");
+        g_free(rooted);
+        return resolved;
+    }
+    return resolve_url(base_url, link);
+}
 
-    GRegex *regex = g_regex_new("href=[\"']?([^\"'>]+)", 0, 0, NULL);
-    GMatchInfo *match_info;
+/**
+ * @brief Get the calling thread's trace buffer, creating it on first use.
+ *
+ * Only buffer creation takes trace_mutex; recording into the buffer is
+ * lock-free since no other thread touches it until the crawl is over.
+ */
+static TraceBuffer* trace_buffer_get(Crawler *crawler) {
+    TraceThreadSlot *slot = g_private_get(&trace_buffer_key);
+    if (slot == NULL) {
+        slot = g_new0(TraceThreadSlot, 1);
+        g_private_set(&trace_buffer_key, slot);
+    }
 
-    g_regex_match(regex, content, 0, &match_info);
+    TraceBuffer *buffer = slot->buffer;
+    if (buffer == NULL || slot->generation != crawler->trace_generation) {
+        buffer = g_new(TraceBuffer, 1);
+        buffer->events = g_array_sized_new(FALSE, FALSE, sizeof(TraceEvent), 1024);
+        buffer->urls = g_string_chunk_new(64 * 1024);
 
-    while (g_match_info_matches(match_info)) {
-        gchar *url = g_match_info_fetch(match_info, 1);
-        gchar *absolute_url = resolve_url(base_url, url);
+        g_mutex_lock(&crawler->trace_mutex);
+        buffer->tid = crawler->trace_buffers->len + 1;
+        g_ptr_array_add(crawler->trace_buffers, buffer);
+        g_mutex_unlock(&crawler->trace_mutex);
 
-        g_mutex_lock(&queue_mutex);
-        if (!g_hash_table_contains(visited_urls, absolute_url)) {
-            g_hash_table_add(visited_urls, g_strdup(absolute_url));
+        slot->buffer = buffer;
+        slot->generation = crawler->trace_generation;
+    }
+    return buffer;
+}
 
-            UrlItem *item = g_new(UrlItem, 1);
-            item->url = g_strdup(absolute_url);
-            item->depth = depth + 1;
+/**
+ * @brief Record a span of a crawl stage that started at start and ends now.
+ *
+ * Does nothing unless tracing was enabled with --trace.
+ *
+ * @param stage A static stage name ("queued", "fetching", ...).
+ * @param url The URL being processed.
+ * @param start Monotonic start time from g_get_monotonic_time().
+ */
+static void trace_span(Crawler *crawler, const gchar *stage, const gchar *url, gint64 start) {
+    if (crawler->config.trace_output == NULL) return;
 
-            g_queue_push_tail(url_queue, item);
-            g_print("Discovered URL: %s (Depth: %d)\n", absolute_url, depth + 1);
+    TraceBuffer *buffer = trace_buffer_get(crawler);
+    TraceEvent event;
+    event.stage = stage;
+    event.url = g_string_chunk_insert_const(buffer->urls, url);
+    event.start = start;
+    event.duration = g_get_monotonic_time() - start;
+    g_array_append_val(buffer->events, event);
+}
+
+/**
+ * @brief Write a string as a JSON string literal.
+ */
+static void json_write_string(FILE *file, const gchar *string) {
+    fputc('"', file);
+    for (const guchar *p = (const guchar *)string; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(file, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(file, "\\u%04x", *p);
+        } else {
+            fputc(*p, file);
         }
-        g_mutex_unlock(&queue_mutex);
+    }
+    fputc('"', file);
+}
 
-        g_free(url);
-        g_free(absolute_url);
-        g_match_info_next(match_info, NULL);
+/**
+ * @brief Write all recorded spans as Chrome trace-event JSON.
+ *
+ * Must only be called once the worker threads have finished. Each buffer
+ * becomes one track named after its thread; timestamps are relative to
+ * the start of the crawl.
+ */
+static void trace_write(Crawler *crawler, const gchar *filename) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        g_printerr("Failed to write trace to %s\n", filename);
+        return;
     }
 
-    g_match_info_free(match_info);
-    g_regex_unref(regex);
+    guint64 count = 0;
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (guint i = 0; i < crawler->trace_buffers->len; i++) {
+        TraceBuffer *buffer = g_ptr_array_index(crawler->trace_buffers, i);
+        gchar *name = buffer->tid == 1 ? g_strdup("dispatcher") : g_strdup_printf("worker %u", buffer->tid - 1);
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                i == 0 ? "" : ",\n", buffer->tid, name);
+        g_free(name);
+
+        for (guint j = 0; j < buffer->events->len; j++) {
+            TraceEvent *event = &g_array_index(buffer->events, TraceEvent, j);
+            gint64 ts = event->start - crawler->trace_epoch;
+
+            if (g_strcmp0(event->stage, "queued") == 0) {
+                // Time in the frontier overlaps other work of this thread,
+                // so it is written as an async begin/end pair
+                fprintf(file, ",\n{\"name\":\"queued\",\"cat\":\"frontier\",\"ph\":\"b\",\"id\":\"%u.%u\",\"pid\":1,\"tid\":%u,"
+                        "\"ts\":%" G_GINT64_FORMAT ",\"args\":{\"url\":", buffer->tid, j, buffer->tid, ts);
+                json_write_string(file, event->url);
+                fprintf(file, "}},\n{\"name\":\"queued\",\"cat\":\"frontier\",\"ph\":\"e\",\"id\":\"%u.%u\",\"pid\":1,\"tid\":%u,"
+                        "\"ts\":%" G_GINT64_FORMAT "}", buffer->tid, j, buffer->tid, ts + event->duration);
+                continue;
+            }
+
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"crawl\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                    "\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT ",\"args\":{\"url\":",
+                    event->stage, buffer->tid, ts, event->duration);
+            json_write_string(file, event->url);
+            fprintf(file, "}}");
+        }
+        count += buffer->events->len;
+    }
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) == 0) {
+        g_print("Trace with %" G_GUINT64_FORMAT " spans saved to %s\n", count, filename);
+    } else {
+        g_printerr("Failed to write trace to %s\n", filename);
+    }
+}
+
+static void trace_buffer_free(gpointer data) {
+    TraceBuffer *buffer = data;
+    g_array_free(buffer->events, TRUE);
+    g_string_chunk_free(buffer->urls);
+    g_free(buffer);
+}
+
+static gsize url_item_bytes(const UrlItem *item) {
+    return sizeof(UrlItem) + sizeof(GList) + strlen(item->url) + 1;
 }
 
 /**
- * @brief Fetch webpage content and process it.
+ * @brief Add an item to the end of the frontier. Must hold queue_mutex.
+ */
+static void frontier_push(Crawler *crawler, UrlItem *item) {
+    crawler->governor.frontier_bytes += url_item_bytes(item);
+    g_queue_push_tail(crawler->url_queue, item);
+    g_cond_signal(&crawler->queue_cond);
+}
+
+/**
+ * @brief Take the next item off the frontier. Must hold queue_mutex.
+ */
+static UrlItem* frontier_pop(Crawler *crawler) {
+    UrlItem *item = g_queue_pop_head(crawler->url_queue);
+    if (item) crawler->governor.frontier_bytes -= url_item_bytes(item);
+    return item;
+}
+
+/**
+ * @brief Estimated bytes currently held by the crawl. Must hold queue_mutex.
+ */
+static gsize governor_usage(Crawler *crawler) {
+    gssize bodies = (gssize)g_atomic_pointer_get(&crawler->governor.body_bytes);
+    return crawler->governor.frontier_bytes + crawler->governor.visited_bytes + MAX(bodies, 0);
+}
+
+/**
+ * @brief Move the back half of the frontier to the spill file. Must hold queue_mutex.
  *
- * @param data Pointer to UrlItem containing the URL and depth.
+ * Entries are appended as guint32 depth, node id and URL length followed
+ * by the URL, and reloaded in the same order.
  */
-void fetch_url(gpointer data, gpointer user_data) {
-    UrlItem *item = (UrlItem *)data;
-    gchar *url = item->url;
-    int depth = item->depth;
+static void governor_spill_frontier(Crawler *crawler) {
+    if (crawler->governor.spill_file == NULL) {
+        crawler->governor.spill_file = tmpfile();
+        if (crawler->governor.spill_file == NULL) {
+            g_printerr("Memory governor: cannot create spill file\n");
+            return;
+        }
+    }
 
-    g_print("Fetching URL: %s (Depth: %d)\n", url, depth);
+    guint count = g_queue_get_length(crawler->url_queue) / 2;
+    GQueue spilled = G_QUEUE_INIT;
+    for (guint i = 0; i < count; i++) {
+        g_queue_push_head(&spilled, g_queue_pop_tail(crawler->url_queue));
+    }
 
-    SoupSession *session = soup_session_new();
-    SoupMessage *msg = soup_message_new("GET", url);
+    fseeko(crawler->governor.spill_file, crawler->governor.spill_write, SEEK_SET);
+    UrlItem *item;
+    while ((item = g_queue_pop_head(&spilled)) != NULL) {
+        guint32 record[3] = { item->depth, item->node_id, strlen(item->url) };
+        fwrite(record, sizeof(record), 1, crawler->governor.spill_file);
+        fwrite(item->url, 1, record[2], crawler->governor.spill_file);
+        crawler->governor.frontier_bytes -= url_item_bytes(item);
+        g_free(item->url);
+        g_free(item);
+    }
+    fflush(crawler->governor.spill_file);
+    crawler->governor.spill_write = ftello(crawler->governor.spill_file);
+    crawler->governor.spilled += count;
+
+    g_print("Memory governor: spilled %u frontier URLs to disk (%u on disk)\n", count, crawler->governor.spilled);
+}
 
-    soup_session_send_message(session, msg);
+/**
+ * @brief Reload spilled entries until the frontier uses a quarter of the
+ * budget or the spill file is empty. Must hold queue_mutex.
+ */
+static void governor_reload_frontier(Crawler *crawler) {
+    guint loaded = 0;
+    fseeko(crawler->governor.spill_file, crawler->governor.spill_read, SEEK_SET);
 
-    if (msg->status_code == SOUP_STATUS_OK) {
-        g_print("Successfully fetched: %s (Status: %d)\n", url, msg->status_code);
+    while (crawler->governor.spilled > 0 && crawler->governor.frontier_bytes < crawler->governor.budget / 4) {
+        guint32 record[3];
+        if (fread(record, sizeof(record), 1, crawler->governor.spill_file) != 1) break;
 
-        gchar *response = g_strdup(msg->response_body->data);
+        UrlItem *item = g_new(UrlItem, 1);
+        item->url = g_malloc(record[2] + 1);
+        if (fread(item->url, 1, record[2], crawler->governor.spill_file) != record[2]) {
+            g_free(item->url);
+            g_free(item);
+            break;
+        }
+        item->url[record[2]] = '\0';
+        item->depth = record[0];
+        item->node_id = record[1];
+        item->queued_at = g_get_monotonic_time();
+        frontier_push(crawler, item);
 
-        // Save content to a unique file
-        save_to_file(url, response);
+        crawler->governor.spilled--;
+        loaded++;
+    }
+    crawler->governor.spill_read = ftello(crawler->governor.spill_file);
 
-        // Extract URLs from the content
-        extract_urls(response, url, depth);
+    if (crawler->governor.spilled == 0) {
+        // Everything is back in memory; start the spill file over
+        crawler->governor.spill_read = crawler->governor.spill_write = 0;
+    }
+    g_print("Memory governor: reloaded %u frontier URLs (%u still on disk)\n", loaded, crawler->governor.spilled);
+}
 
-        g_free(response);
-    } else {
-        g_printerr("Failed to fetch %s: %s (Status: %d)\n", url, msg->reason_phrase, msg->status_code);
+/**
+ * @brief Re-evaluate memory use and adjust dispatch. Must hold queue_mutex.
+ *
+ * Above the high watermark concurrency is halved, the frontier is spilled
+ * if it is the larger share, and dispatch pauses while fetches are in
+ * flight. Below the low watermark concurrency doubles back up to the
+ * configured thread count. Spilled URLs are reloaded once the frontier runs dry.
+ *
+ * @return TRUE if no new fetch should be started right now.
+ */
+static gboolean governor_update(Crawler *crawler) {
+    if (crawler->governor.budget == 0) return FALSE;
+
+    gsize usage = governor_usage(crawler);
+    gsize high = crawler->governor.budget * GOVERNOR_HIGH_WATERMARK;
+    gsize low = crawler->governor.budget * GOVERNOR_LOW_WATERMARK;
+
+    // Never end the crawl with URLs left on disk
+    if (g_queue_is_empty(crawler->url_queue) && crawler->governor.spilled > 0 && (usage <= low || crawler->active_fetches == 0)) {
+        governor_reload_frontier(crawler);
+        usage = governor_usage(crawler);
     }
 
-    g_object_unref(msg);
-    g_object_unref(session);
-    g_free(item->url);
-    g_free(item);
+    if (usage >= high) {
+        if (!crawler->governor.over_budget) {
+            crawler->governor.over_budget = TRUE;
+            crawler->governor.concurrency = MAX(crawler->governor.concurrency / 2, 1);
+            g_thread_pool_set_max_threads(crawler->thread_pool, crawler->governor.concurrency, NULL);
+            g_print("Memory governor: %" G_GSIZE_FORMAT " of %" G_GSIZE_FORMAT " bytes used, pausing dispatch, concurrency %u\n",
+                    usage, crawler->governor.budget, crawler->governor.concurrency);
+        }
+        if (crawler->governor.frontier_bytes > usage / 2 && g_queue_get_length(crawler->url_queue) > 1) {
+            governor_spill_frontier(crawler);
+        }
+        return TRUE;
+    }
+
+    if (usage <= low) {
+        if (crawler->governor.over_budget) {
+            crawler->governor.over_budget = FALSE;
+            g_print("Memory governor: %" G_GSIZE_FORMAT " bytes used, resuming dispatch\n", usage);
+        }
+        if (crawler->governor.concurrency < (guint)crawler->config.threads) {
+            crawler->governor.concurrency = MIN(crawler->governor.concurrency * 2, (guint)crawler->config.threads);
+            g_thread_pool_set_max_threads(crawler->thread_pool, crawler->governor.concurrency, NULL);
+        }
+    }
+    return crawler->governor.over_budget;
+}
+
+/**
+ * @brief Look up the link graph node of a URL, adding the URL if it is new.
+ *
+ * Must be called with queue_mutex held.
+ *
+ * @param url The absolute URL.
+ * @return The node id of the URL.
+ */
+static guint32 intern_url(Crawler *crawler, const gchar *url) {
+    gpointer value = g_hash_table_lookup(crawler->visited_urls, url);
+    if (value != NULL) {
+        return GPOINTER_TO_UINT(value) - 1;
+    }
+
+    gchar *key = g_strdup(url);
+    guint8 not_queued = 0;
+    guint32 node_id = crawler->link_graph.node_urls->len;
+    g_hash_table_insert(crawler->visited_urls, key, GUINT_TO_POINTER(node_id + 1));
+    g_ptr_array_add(crawler->link_graph.node_urls, key);
+    g_byte_array_append(crawler->link_graph.queued, &not_queued, 1);
+    crawler->governor.visited_bytes += strlen(key) + 1 + HASH_ENTRY_OVERHEAD + sizeof(gpointer) + 1;
+    return node_id;
 }
 
+/**
+ * @brief 64-bit FNV-1a with a splitmix64 finaliser, so every bit is usable.
+ */
+static guint64 sketch_hash(const gchar *data, gsize length) {
+    guint64 hash = G_GUINT64_CONSTANT(14695981039346656037);
+    for (gsize i = 0; i < length; i++) {
+        hash ^= (guchar)data[i];
+        hash *= G_GUINT64_CONSTANT(1099511628211);
+    }
+    hash ^= hash >> 30;
+    hash *= G_GUINT64_CONSTANT(0xbf58476d1ce4e5b9);
+    hash ^= hash >> 27;
+    hash *= G_GUINT64_CONSTANT(0x94d049bb133111eb);
+    hash ^= hash >> 31;
+    return hash;
+}
 
 /**
- * @brief Start the web crawler with the given URLs and thread count.
+ * @brief Add a key to a HyperLogLog.
  *
- * @param start_urls A NULL-terminated array of initial URLs.
- * @param thread_count The maximum number of threads.
+ * The top HLL_PRECISION bits of the hash pick the register; the register
+ * keeps the largest position of the first set bit in the rest.
  */
-void start_crawler(const gchar **start_urls, int thread_count) {
-    url_queue = g_queue_new();
-    g_mutex_init(&queue_mutex);
-    visited_urls = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+static void hll_add(HyperLogLog *hll, const gchar *key, gsize length) {
+    guint64 hash = sketch_hash(key, length);
+    guint index = hash >> (64 - HLL_PRECISION);
+    guint64 rest = hash << HLL_PRECISION;
+    gint rank = 1;
+    while (rank <= 64 - HLL_PRECISION && !(rest & G_GUINT64_CONSTANT(0x8000000000000000))) {
+        rest <<= 1;
+        rank++;
+    }
 
-    // Add initial URLs to the queue
-    for (int i = 0; start_urls[i] != NULL; i++) {
-        g_mutex_lock(&queue_mutex);
-        g_hash_table_add(visited_urls, g_strdup(start_urls[i]));
+    gint current = g_atomic_int_get(&hll->registers[index]);
+    while (rank > current && !g_atomic_int_compare_and_exchange(&hll->registers[index], current, rank)) {
+        current = g_atomic_int_get(&hll->registers[index]);
+    }
+}
 
-        UrlItem *item = g_new(UrlItem, 1);
-        item->url = g_strdup(start_urls[i]);
-        item->depth = 0;
+/**
+ * @brief Estimate the number of distinct keys added, with linear counting
+ * for small cardinalities.
+ */
+static gdouble hll_estimate(HyperLogLog *hll) {
+    gdouble m = HLL_REGISTERS;
+    gdouble sum = 0;
+    guint zeros = 0;
+    for (guint i = 0; i < HLL_REGISTERS; i++) {
+        gint rank = g_atomic_int_get(&hll->registers[i]);
+        sum += ldexp(1.0, -rank);
+        if (rank == 0) zeros++;
+    }
 
-        g_queue_push_tail(url_queue, item);
-        g_mutex_unlock(&queue_mutex);
+    gdouble estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * log(m / zeros);
     }
+    return estimate;
+}
 
-    // Initialize the thread pool
-    thread_pool = g_thread_pool_new(fetch_url, NULL, thread_count, FALSE, NULL);
+/**
+ * @brief Count one occurrence of a key and keep the top list up to date.
+ *
+ * Rows of the count-min sketch are indexed by double hashing of one 64-bit
+ * hash. The estimate is checked against the top list's threshold before
+ * taking its lock, so keys outside the top list cost only the atomic adds.
+ */
+static void heavy_hitters_add(HeavyHitters *hitters, const gchar *key, gsize length) {
+    guint64 hash = sketch_hash(key, length);
+    guint32 h1 = (guint32)hash;
+    guint32 h2 = (guint32)(hash >> 32) | 1;
+    gint estimate = G_MAXINT;
+    for (guint row = 0; row < CMS_DEPTH; row++) {
+        gint *counter = &hitters->counters[row][(h1 + row * h2) % CMS_WIDTH];
+        estimate = MIN(estimate, g_atomic_int_add(counter, 1) + 1);
+    }
+    if (estimate <= g_atomic_int_get(&hitters->threshold)) return;
 
-    // Process the queue
-    while (!g_queue_is_empty(url_queue)) {
-        g_mutex_lock(&queue_mutex);
-        UrlItem *item = g_queue_pop_head(url_queue);
-        g_mutex_unlock(&queue_mutex);
+    g_mutex_lock(&hitters->mutex);
+    HeavyHitter *slot = NULL;
+    HeavyHitter *smallest = &hitters->top[0];
+    for (guint i = 0; i < TOPK_SIZE; i++) {
+        HeavyHitter *entry = &hitters->top[i];
+        if (entry->key && strlen(entry->key) == length && memcmp(entry->key, key, length) == 0) {
+            slot = entry;
+            break;
+        }
+        if (entry->count < smallest->count) smallest = entry;
+    }
+    if (slot == NULL && estimate > smallest->count) {
+        g_free(smallest->key);
+        smallest->key = g_strndup(key, length);
+        slot = smallest;
+    }
+    if (slot) {
+        slot->count = MAX(slot->count, estimate);
 
-        g_thread_pool_push(thread_pool, item, NULL);
+        gint threshold = G_MAXINT;
+        for (guint i = 0; i < TOPK_SIZE; i++) {
+            threshold = MIN(threshold, hitters->top[i].key ? hitters->top[i].count : 0);
+        }
+        g_atomic_int_set(&hitters->threshold, threshold);
     }
+    g_mutex_unlock(&hitters->mutex);
+}
 
-    // Wait for all threads to finish
-    g_thread_pool_free(thread_pool, FALSE, TRUE);
+static gint compare_heavy_hitters(gconstpointer a, gconstpointer b) {
+    const HeavyHitter *x = a;
+    const HeavyHitter *y = b;
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+/**
+ * @brief Append "name: key=count ..." with the top list, largest first.
+ */
+static void heavy_hitters_append(HeavyHitters *hitters, const gchar *name, GString *out) {
+    HeavyHitter top[TOPK_SIZE];
+    g_mutex_lock(&hitters->mutex);
+    for (guint i = 0; i < TOPK_SIZE; i++) {
+        top[i].key = g_strdup(hitters->top[i].key);
+        top[i].count = hitters->top[i].count;
+    }
+    g_mutex_unlock(&hitters->mutex);
 
-    g_queue_free(url_queue);
-    g_hash_table_destroy(visited_urls);
-    g_mutex_clear(&queue_mutex);
+    qsort(top, TOPK_SIZE, sizeof(HeavyHitter), compare_heavy_hitters);
+    g_string_append_printf(out, "%s:", name);
+    for (guint i = 0; i < TOPK_SIZE; i++) {
+        if (top[i].key) g_string_append_printf(out, " %s=%d", top[i].key, top[i].count);
+        g_free(top[i].key);
+    }
+    g_string_append_c(out, '\n');
 }
 
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        g_print("Usage: %s <start_url1> [<start_url2> ...] [max_threads]\n", argv[0]);
-        return 1;
+static CrawlSketches* crawl_sketches_new(void) {
+    CrawlSketches *sketches = g_new0(CrawlSketches, 1);
+    g_mutex_init(&sketches->top_hosts.mutex);
+    g_mutex_init(&sketches->top_prefixes.mutex);
+    return sketches;
+}
+
+static void crawl_sketches_free(CrawlSketches *sketches) {
+    for (guint i = 0; i < TOPK_SIZE; i++) {
+        g_free(sketches->top_hosts.top[i].key);
+        g_free(sketches->top_prefixes.top[i].key);
     }
+    g_mutex_clear(&sketches->top_hosts.mutex);
+    g_mutex_clear(&sketches->top_prefixes.mutex);
+    g_free(sketches);
+}
 
-    int thread_count = (argc > 2) ? atoi(argv[argc - 1]) : 5;
+/**
+ * @brief Count a discovered link in the crawl sketches.
+ *
+ * The host and the path prefix (host plus first path segment) are
+ * sliced out of the URL in place rather than parsed into a SoupURI.
+ */
+static void crawl_sketches_add_link(CrawlSketches *sketches, const gchar *url) {
+    hll_add(&sketches->urls, url, strlen(url));
 
-    // Create a NULL-terminated array of start URLs
-    const gchar **start_urls = (const gchar **)g_malloc((argc - 1) * sizeof(gchar *));
-    for (int i = 1; i < argc - 1; i++) {
-        start_urls[i - 1] = argv[i];
+    const gchar *scheme_end = strstr(url, "://");
+    if (scheme_end == NULL) return;
+    const gchar *host = scheme_end + 3;
+    gsize host_len = strcspn(host, "/?#");
+    gsize prefix_len = host_len;
+    if (host[host_len] == '/') {
+        prefix_len += 1 + strcspn(host + host_len + 1, "/?#");
     }
-    start_urls[argc - 2] = NULL;
 
-    g_print("Starting crawler with %d threads...\n", thread_count);
-    start_crawler(start_urls, thread_count);
-    g_print("Crawling finished.\n");
+    if (host_len > 0) {
+        hll_add(&sketches->hosts, host, host_len);
+        heavy_hitters_add(&sketches->top_hosts, host, host_len);
+    }
+    heavy_hitters_add(&sketches->top_prefixes, host, prefix_len);
+}
 
-    g_free(start_urls);
-    return 0;
+/**
+ * @brief Extract URLs from HTML content and add them to the queue.
+ *
+ * Every link found is recorded as an edge of the link graph; only URLs
+ * that have not been queued before are queued for crawling. Links the
+ * link callback rejects are neither recorded nor followed.
+ *
+ * @param content The HTML content to scan; it need not be NUL-terminated.
+ * @param length Length of content in bytes.
+ * @param base_url The base URL for resolving relative URLs.
+ * @param depth The current depth of crawling.
+ * @param node_id The link graph node of base_url.
+ */
+static void extract_urls(Crawler *crawler, const gchar *content, gsize length, const gchar *base_url, int depth, guint32 node_id) {
+    // Pages at the depth limit are still scanned when the link graph is exported
+    gboolean enqueue = depth < g_atomic_int_get(&crawler->config.max_depth);
+    if (!enqueue && crawler->config.graph_output == NULL && crawler->link_func == NULL) return;
+
+    GRegex *regex = g_regex_new("href=[\"']?([^\"'>]+)", 0, 0, NULL);
+    GMatchInfo *match_info;
+
+    g_regex_match_full(regex, content, length, 0, 0, &match_info, NULL);
+
+    while (g_match_info_matches(match_info)) {
+        gchar *url = g_match_info_fetch(match_info, 1);
+        gchar *absolute_url = resolve_link(crawler, base_url, url);
+
+        // A remote page must not lead the crawler to local files
+        if (g_str_has_prefix(absolute_url, "file:") && !g_str_has_prefix(base_url, "file:")) {
+            g_free(url);
+            g_free(absolute_url);
+            g_match_info_next(match_info, NULL);
+            continue;
+        }
+
+        if (crawler->link_func && !crawler->link_func(crawler, base_url, absolute_url, depth + 1, crawler->link_data)) {
+            g_free(url);
+            g_free(absolute_url);
+            g_match_info_next(match_info, NULL);
+            continue;
+        }
+
+        crawl_sketches_add_link(crawler->sketches, absolute_url);
+
+        g_mutex_lock(&crawler->queue_mutex);
+        LinkEdge edge = { node_id, intern_url(crawler, absolute_url) };
+        g_array_append_val(crawler->link_graph.edges, edge);
+
+        if (enqueue && !crawler->link_graph.queued->data[edge.dst]) {
+            crawler->link_graph.queued->data[edge.dst] = 1;
+
+            UrlItem *item = g_new(UrlItem, 1);
+            item->url = g_strdup(absolute_url);
+            item->depth = depth + 1;
+            item->node_id = edge.dst;
+            item->queued_at = g_get_monotonic_time();
+
+            frontier_push(crawler, item);
+            g_print("Discovered URL: %s (Depth: %d)\n", absolute_url, depth + 1);
+        }
+        g_mutex_unlock(&crawler->queue_mutex);
+
+        g_free(url);
+        g_free(absolute_url);
+        g_match_info_next(match_info, NULL);
+    }
+
+    g_match_info_free(match_info);
+    g_regex_unref(regex);
+}
+
+static void append_header(const char *name, const char *value, gpointer data) {
+    g_string_append_printf((GString *)data, "%s: %s\r\n", name, value);
+}
+
+// Backend data of a network FetchResult
+typedef struct {
+    Crawler *crawler;
+    SoupSession *session;
+    SoupMessage *msg;
+    GString *headers;
+    GByteArray *body;
+} NetworkResponse;
+
+static void release_network_result(gpointer data) {
+    NetworkResponse *response = data;
+    g_atomic_pointer_add(&response->crawler->governor.body_bytes, -(gssize)response->body->len);
+    g_byte_array_free(response->body, TRUE);
+    g_string_free(response->headers, TRUE);
+    g_object_unref(response->msg);
+    g_object_unref(response->session);
+    g_free(response);
 }
+
+/**
+ * @brief Fetch a URL over the network with libsoup.
+ *
+ * The body is streamed into a buffer counted by the memory governor and
+ * the fetch fails once it grows past --max-body-size. The body view and
+ * the message are released by fetch_result_clear().
+ */
+static void fetch_from_network(Crawler *crawler, const gchar *url, FetchResult *result) {
+    SoupSession *session = soup_session_new();
+    SoupMessage *msg = soup_message_new("GET", url);
+    if (msg == NULL) {
+        g_object_unref(session);
+        result->status = SOUP_STATUS_MALFORMED;
+        result->reason = soup_status_get_phrase(result->status);
+        return;
+    }
+
+    NetworkResponse *response = g_new(NetworkResponse, 1);
+    response->crawler = crawler;
+    response->session = session;
+    response->msg = msg;
+    response->headers = g_string_new(NULL);
+    response->body = g_byte_array_new();
+    result->owner = response;
+    result->release_owner = release_network_result;
+
+    GError *error = NULL;
+    GInputStream *stream = soup_session_send(session, msg, NULL, &error);
+    if (stream == NULL) {
+        result->status = SOUP_STATUS_IO_ERROR;
+        result->reason = soup_status_get_phrase(result->status);
+        g_printerr("Failed to fetch %s: %s\n", url, error->message);
+        g_error_free(error);
+        return;
+    }
+
+    result->status = msg->status_code;
+    result->reason = msg->reason_phrase;
+    soup_message_headers_foreach(msg->response_headers, append_header, response->headers);
+
+    goffset declared = soup_message_headers_get_content_length(msg->response_headers);
+    if (crawler->config.max_body_size > 0 && declared > crawler->config.max_body_size) {
+        result->status = SOUP_STATUS_IO_ERROR;
+        result->reason = "Body exceeds --max-body-size";
+    } else {
+        guint8 chunk[64 * 1024];
+        gssize n;
+        while ((n = g_input_stream_read(stream, chunk, sizeof(chunk), NULL, &error)) > 0) {
+            g_byte_array_append(response->body, chunk, n);
+            g_atomic_pointer_add(&crawler->governor.body_bytes, n);
+            if (crawler->config.max_body_size > 0 && response->body->len > crawler->config.max_body_size) {
+                result->status = SOUP_STATUS_IO_ERROR;
+                result->reason = "Body exceeds --max-body-size";
+                break;
+            }
+        }
+        if (n < 0) {
+            result->status = SOUP_STATUS_IO_ERROR;
+            result->reason = soup_status_get_phrase(result->status);
+            g_printerr("Failed to read %s: %s\n", url, error->message);
+            g_error_free(error);
+        }
+    }
+    g_input_stream_close(stream, NULL, NULL);
+    g_object_unref(stream);
+
+    result->headers = response->headers->str;
+    result->headers_len = response->headers->len;
+    result->body = (const gchar *)response->body->data;
+    result->body_len = response->body->len;
+}
+
+/**
+ * @brief Release the backend data behind a FetchResult.
+ */
+static void fetch_result_clear(FetchResult *result) {
+    if (result->release_owner) {
+        result->release_owner(result->owner);
+    }
+    memset(result, 0, sizeof(*result));
+}
+
+/**
+ * @brief Append a response to the record archive.
+ */
+static void archive_append(Crawler *crawler, const gchar *url, const FetchResult *result) {
+    FILE *file = crawler->record_file;
+    guint32 url_len = strlen(url);
+    guint32 status = result->status;
+    guint32 headers_len = result->headers_len;
+    guint64 body_len = result->body_len;
+
+    g_mutex_lock(&crawler->record_mutex);
+    fwrite(&url_len, sizeof(url_len), 1, file);
+    fwrite(&status, sizeof(status), 1, file);
+    fwrite(&headers_len, sizeof(headers_len), 1, file);
+    fwrite(&body_len, sizeof(body_len), 1, file);
+    fwrite(url, 1, url_len, file);
+    if (headers_len) fwrite(result->headers, 1, headers_len, file);
+    if (body_len) fwrite(result->body, 1, body_len, file);
+    g_mutex_unlock(&crawler->record_mutex);
+}
+
+/**
+ * @brief Open an archive for recording, writing the header if it is new.
+ */
+static FILE* archive_open_for_record(const gchar *filename) {
+    FILE *file = fopen(filename, "ab");
+    if (!file) {
+        g_printerr("Failed to open archive %s for recording\n", filename);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    if (ftell(file) == 0) {
+        guint32 version = ARCHIVE_VERSION;
+        fwrite(ARCHIVE_MAGIC, 1, 4, file);
+        fwrite(&version, sizeof(version), 1, file);
+    }
+    return file;
+}
+
+static void replay_archive_free(ReplayArchive *archive) {
+    g_hash_table_destroy(archive->records);
+    g_mapped_file_unref(archive->file);
+    g_free(archive);
+}
+
+/**
+ * @brief Map an archive and index its records by URL.
+ *
+ * When a URL was recorded more than once the last record wins.
+ *
+ * @return The archive, or NULL if it cannot be read or is malformed.
+ */
+static ReplayArchive* replay_archive_open(const gchar *filename) {
+    GError *error = NULL;
+    GMappedFile *file = g_mapped_file_new(filename, FALSE, &error);
+    if (!file) {
+        g_printerr("Failed to open archive %s: %s\n", filename, error->message);
+        g_error_free(error);
+        return NULL;
+    }
+
+    const gchar *data = g_mapped_file_get_contents(file);
+    gsize length = g_mapped_file_get_length(file);
+    guint32 version = 0;
+    if (length < 8 || memcmp(data, ARCHIVE_MAGIC, 4) != 0 ||
+        (memcpy(&version, data + 4, sizeof(version)), version != ARCHIVE_VERSION)) {
+        g_printerr("%s is not a crawl archive\n", filename);
+        g_mapped_file_unref(file);
+        return NULL;
+    }
+
+    ReplayArchive *archive = g_new(ReplayArchive, 1);
+    archive->file = file;
+    archive->records = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    gsize offset = 8;
+    while (offset < length) {
+        guint32 url_len, headers_len;
+        guint64 body_len;
+        if (length - offset < ARCHIVE_RECORD_HEADER_SIZE) break;
+        memcpy(&url_len, data + offset, sizeof(url_len));
+        memcpy(&headers_len, data + offset + 8, sizeof(headers_len));
+        memcpy(&body_len, data + offset + 12, sizeof(body_len));
+
+        gsize payload = length - offset - ARCHIVE_RECORD_HEADER_SIZE;
+        if (url_len > payload || headers_len > payload - url_len || body_len > payload - url_len - headers_len) break;
+
+        gchar *url = g_strndup(data + offset + ARCHIVE_RECORD_HEADER_SIZE, url_len);
+        g_hash_table_replace(archive->records, url, GSIZE_TO_POINTER(offset));
+        offset += ARCHIVE_RECORD_HEADER_SIZE + url_len + headers_len + body_len;
+    }
+
+    if (offset != length) {
+        g_printerr("%s: truncated record at offset %" G_GSIZE_FORMAT "\n", filename, offset);
+        replay_archive_free(archive);
+        return NULL;
+    }
+
+    g_print("Replaying %u recorded responses from %s\n", g_hash_table_size(archive->records), filename);
+    return archive;
+}
+
+/**
+ * @brief Serve a URL from the replay archive; unknown URLs get a 404.
+ *
+ * Headers and body are views into the mapped archive, so nothing is copied.
+ */
+static void fetch_from_archive(Crawler *crawler, const gchar *url, FetchResult *result) {
+    gpointer offset_ptr;
+    if (!g_hash_table_lookup_extended(crawler->replay_archive->records, url, NULL, &offset_ptr)) {
+        result->status = SOUP_STATUS_NOT_FOUND;
+        result->reason = "Not found in replay archive";
+        return;
+    }
+
+    const gchar *record = g_mapped_file_get_contents(crawler->replay_archive->file) + GPOINTER_TO_SIZE(offset_ptr);
+    guint32 url_len, status, headers_len;
+    guint64 body_len;
+    memcpy(&url_len, record, sizeof(url_len));
+    memcpy(&status, record + 4, sizeof(status));
+    memcpy(&headers_len, record + 8, sizeof(headers_len));
+    memcpy(&body_len, record + 12, sizeof(body_len));
+
+    result->status = status;
+    result->reason = soup_status_get_phrase(status);
+    result->headers = record + ARCHIVE_RECORD_HEADER_SIZE + url_len;
+    result->headers_len = headers_len;
+    result->body = result->headers + headers_len;
+    result->body_len = body_len;
+}
+
+/**
+ * @brief Map a URL to a local file.
+ *
+ * file:// URLs name the file directly; with --mirror-root, http(s) URLs
+ * map to DIR/HOST[:PORT]/PATH[?QUERY] as laid out by wget --mirror.
+ * Directories map to their index.html. Mirror filenames must stay inside
+ * DIR, so hosts such as ".." are rejected.
+ *
+ * @return A newly allocated filename, or NULL if the URL has no local file.
+ */
+static gchar* local_path_for_url(Crawler *crawler, const gchar *url) {
+    SoupURI *uri = soup_uri_new(url);
+    if (uri == NULL) return NULL;
+
+    gchar *path = soup_uri_decode(soup_uri_get_path(uri));
+    gchar *filename = NULL;
+    if (soup_uri_get_scheme(uri) == SOUP_URI_SCHEME_FILE) {
+        filename = g_strdup(path);
+    } else if (crawler->config.mirror_root && SOUP_URI_VALID_FOR_HTTP(uri) &&
+               !g_str_equal(soup_uri_get_host(uri), ".") && !g_str_equal(soup_uri_get_host(uri), "..") &&
+               strchr(soup_uri_get_host(uri), G_DIR_SEPARATOR) == NULL) {
+        gchar *host = soup_uri_uses_default_port(uri) ? g_strdup(soup_uri_get_host(uri))
+                                                      : g_strdup_printf("%s:%u", soup_uri_get_host(uri), soup_uri_get_port(uri));
+        gchar *file = soup_uri_get_query(uri) ? g_strconcat(path, "?", soup_uri_get_query(uri), NULL) : g_strdup(path);
+        filename = g_build_filename(crawler->config.mirror_root, host, file, NULL);
+        g_free(host);
+        g_free(file);
+
+        // Dot segments the URI parser left in place must not climb out of DIR
+        gchar *root = g_canonicalize_filename(crawler->config.mirror_root, NULL);
+        gchar *canonical = g_canonicalize_filename(filename, NULL);
+        gsize root_len = strlen(root);
+        if (!g_str_has_prefix(canonical, root) ||
+            (canonical[root_len] != G_DIR_SEPARATOR && root[root_len - 1] != G_DIR_SEPARATOR)) {
+            g_free(filename);
+            filename = NULL;
+        }
+        g_free(root);
+        g_free(canonical);
+    }
+    g_free(path);
+    soup_uri_free(uri);
+
+    if (filename && g_file_test(filename, G_FILE_TEST_IS_DIR)) {
+        gchar *index = g_build_filename(filename, "index.html", NULL);
+        g_free(filename);
+        filename = index;
+    }
+    return filename;
+}
+
+/**
+ * @brief Serve a URL from the local filesystem.
+ *
+ * The file is memory-mapped and the body is a view of the mapping, so
+ * link extraction runs directly over the page cache.
+ */
+static void fetch_from_file(Crawler *crawler, const gchar *url, FetchResult *result) {
+    gchar *filename = local_path_for_url(crawler, url);
+    if (filename == NULL) {
+        result->status = SOUP_STATUS_NOT_FOUND;
+        result->reason = "No local file for URL";
+        return;
+    }
+
+    GError *error = NULL;
+    GMappedFile *file = g_mapped_file_new(filename, FALSE, &error);
+    g_free(filename);
+    if (file == NULL) {
+        result->status = g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT) ? SOUP_STATUS_NOT_FOUND : SOUP_STATUS_FORBIDDEN;
+        result->reason = soup_status_get_phrase(result->status);
+        g_error_free(error);
+        return;
+    }
+
+    const gchar *contents = g_mapped_file_get_contents(file);
+    result->status = SOUP_STATUS_OK;
+    result->reason = soup_status_get_phrase(result->status);
+    result->body = contents ? contents : ""; // Empty files have no mapping
+    result->body_len = g_mapped_file_get_length(file);
+    result->owner = file;
+    result->release_owner = (GDestroyNotify)g_mapped_file_unref;
+}
+
+#define RATE_LOOKAHEAD 1024 // Frontier entries the dispatcher looks at past throttled hosts
+
+/**
+ * @brief Copy the host of url, without port, into buffer.
+ *
+ * The host is sliced out of the URL in place rather than parsed into a
+ * SoupURI, since the dispatcher does this for every entry it looks at.
+ *
+ * @return FALSE if url has no host or it does not fit in buffer.
+ */
+static gboolean url_host(const gchar *url, gchar *buffer, gsize size) {
+    const gchar *scheme_end = strstr(url, "://");
+    if (scheme_end == NULL) return FALSE;
+    const gchar *host = scheme_end + 3;
+    gsize authority_len = strcspn(host, "/?#");
+    const gchar *at = memchr(host, '@', authority_len);
+    if (at) {
+        authority_len -= at + 1 - host;
+        host = at + 1;
+    }
+    gsize host_len = host[0] == '[' ? strcspn(host, "]") + 1 : strcspn(host, ":/?#");
+    host_len = MIN(host_len, authority_len);
+    if (host_len == 0 || host_len >= size) return FALSE;
+    memcpy(buffer, host, host_len);
+    buffer[host_len] = '\0';
+    return TRUE;
+}
+
+/**
+ * @brief Reserve a start slot for the host of url if one is free now. Must hold rate_mutex.
+ *
+ * Starts on each host are spaced at least 1/rate seconds apart. The gap
+ * is computed from the current rate, so a new rate applies at once.
+ *
+ * @return 0 if the URL may be fetched now, otherwise the monotonic time
+ *         at which its host may be fetched again.
+ */
+static gint64 host_rate_reserve(Crawler *crawler, const gchar *url, gint64 now) {
+    gchar host[256];
+    if (!url_host(url, host, sizeof(host))) return 0;
+
+    HostRate *state = g_hash_table_lookup(crawler->host_rates, host);
+    gdouble rate = state && state->rate > 0 ? state->rate : crawler->config.host_rate;
+    if (rate <= 0) return 0;
+    if (state == NULL) {
+        state = g_new0(HostRate, 1);
+        g_hash_table_insert(crawler->host_rates, g_strdup(host), state);
+    }
+
+    gint64 next_start = state->last_start + (gint64)(G_USEC_PER_SEC / rate);
+    if (state->last_start != 0 && next_start > now) return next_start;
+    state->last_start = now;
+    return 0;
+}
+
+/**
+ * @brief Take the first frontier entry whose host may be fetched now. Must hold queue_mutex.
+ *
+ * Entries of throttled hosts keep their place in the frontier, so no
+ * fetch thread sleeps on a rate limit while other hosts have work. Only
+ * the first RATE_LOOKAHEAD entries are considered.
+ *
+ * @param wake_at Set to the time the earliest throttled host frees up when
+ *                nothing can be fetched now, otherwise 0.
+ * @return The entry, or NULL if every entry looked at is throttled.
+ */
+static UrlItem* frontier_pop_ready(Crawler *crawler, gint64 *wake_at) {
+    *wake_at = 0;
+    g_mutex_lock(&crawler->rate_mutex);
+    if (crawler->config.host_rate <= 0 && g_hash_table_size(crawler->host_rates) == 0) {
+        g_mutex_unlock(&crawler->rate_mutex);
+        return frontier_pop(crawler);
+    }
+
+    gint64 now = g_get_monotonic_time();
+    guint looked = 0;
+    for (GList *link = crawler->url_queue->head; link && looked < RATE_LOOKAHEAD; link = link->next, looked++) {
+        UrlItem *item = link->data;
+        gint64 ready_at = host_rate_reserve(crawler, item->url, now);
+        if (ready_at == 0) {
+            g_mutex_unlock(&crawler->rate_mutex);
+            g_queue_delete_link(crawler->url_queue, link);
+            crawler->governor.frontier_bytes -= url_item_bytes(item);
+            return item;
+        }
+        if (*wake_at == 0 || ready_at < *wake_at) *wake_at = ready_at;
+    }
+    g_mutex_unlock(&crawler->rate_mutex);
+    return NULL;
+}
+
+/**
+ * @brief Fetch webpage content and process it.
+ *
+ * The page callback sees the response before it is saved and scanned for
+ * links; the body stays a view into the backend's buffer throughout.
+ *
+ * @param data Pointer to UrlItem containing the URL and depth.
+ * @param user_data The Crawler.
+ */
+static void fetch_url(gpointer data, gpointer user_data) {
+    Crawler *crawler = user_data;
+    UrlItem *item = (UrlItem *)data;
+    gchar *url = item->url;
+    int depth = item->depth;
+    gint64 stage_start = g_get_monotonic_time();
+
+    trace_span(crawler, "queued", url, item->queued_at);
+    g_print("Fetching URL: %s (Depth: %d)\n", url, depth);
+
+    stage_start = g_get_monotonic_time();
+    FetchResult result = { 0 };
+    if (g_str_has_prefix(url, "file:") && !crawler->allow_file_urls) {
+        // Local files are only read in crawls of local files
+        result.status = SOUP_STATUS_MALFORMED;
+        result.reason = soup_status_get_phrase(result.status);
+    } else if (crawler->fetch_backend == fetch_from_network && g_str_has_prefix(url, "file:")) {
+        fetch_from_file(crawler, url, &result);
+    } else {
+        crawler->fetch_backend(crawler, url, &result);
+    }
+    trace_span(crawler, "fetching", url, stage_start);
+
+    if (crawler->record_file) {
+        archive_append(crawler, url, &result);
+    }
+
+    if (crawler->page_func) {
+        CrawlerPage page = { url, depth, result.status, result.headers, result.headers_len, result.body, result.body_len };
+        stage_start = g_get_monotonic_time();
+        crawler->page_func(crawler, &page, crawler->page_data);
+        trace_span(crawler, "callback", url, stage_start);
+    }
+
+    if (result.status == SOUP_STATUS_OK) {
+        g_print("Successfully fetched: %s (Status: %d)\n", url, result.status);
+
+        // Save content to a unique file
+        if (crawler->config.save_pages) {
+            stage_start = g_get_monotonic_time();
+            save_to_file(crawler, url, result.body, result.body_len);
+            trace_span(crawler, "saving", url, stage_start);
+        }
+
+        // Extract URLs from the content
+        stage_start = g_get_monotonic_time();
+        extract_urls(crawler, result.body, result.body_len, url, depth, item->node_id);
+        trace_span(crawler, "parsing", url, stage_start);
+    } else {
+        g_printerr("Failed to fetch %s: %s (Status: %d)\n", url, result.reason, result.status);
+    }
+
+    gboolean failed = result.status != SOUP_STATUS_OK;
+    fetch_result_clear(&result);
+    g_free(item->url);
+    g_free(item);
+
+    // Let the dispatcher hand out the next URL
+    g_mutex_lock(&crawler->queue_mutex);
+    crawler->active_fetches--;
+    crawler->pages_fetched++;
+    if (failed) crawler->pages_failed++;
+    g_cond_signal(&crawler->queue_cond);
+    g_mutex_unlock(&crawler->queue_mutex);
+}
+
+/**
+ * @brief Append a varint (7 bits per byte, little endian) to a byte array.
+ */
+static void varint_append(GByteArray *buffer, guint64 value) {
+    guint8 bytes[10];
+    guint n = 0;
+    while (value >= 0x80) {
+        bytes[n++] = (guint8)(value | 0x80);
+        value >>= 7;
+    }
+    bytes[n++] = (guint8)value;
+    g_byte_array_append(buffer, bytes, n);
+}
+
+/**
+ * @brief Decode a varint and advance the read pointer past it.
+ */
+static inline guint64 varint_read(const guint8 **cursor) {
+    const guint8 *p = *cursor;
+    guint64 value = 0;
+    guint shift = 0;
+    while (*p & 0x80) {
+        value |= (guint64)(*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+    value |= (guint64)*p++ << shift;
+    *cursor = p;
+    return value;
+}
+
+static int compare_node_ids(const void *a, const void *b) {
+    guint32 x = *(const guint32 *)a;
+    guint32 y = *(const guint32 *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Build a gap-encoded CSR graph from an edge list.
+ *
+ * Rows are bucketed with a counting sort, then each row is sorted,
+ * deduplicated and varint encoded.
+ *
+ * @param edges The edge list.
+ * @param num_edges Number of entries in edges.
+ * @param num_nodes Number of nodes; all node ids must be below this.
+ * @param transpose If TRUE, build the graph of incoming links instead.
+ * @return A newly allocated CsrGraph, freed with csr_graph_free().
+ */
+static CsrGraph* csr_graph_build(const LinkEdge *edges, guint64 num_edges, guint32 num_nodes, gboolean transpose) {
+    guint64 *row_start = g_new0(guint64, (gsize)num_nodes + 1);
+    guint32 *neighbours = g_new(guint32, MAX(num_edges, 1));
+
+    for (guint64 i = 0; i < num_edges; i++) {
+        row_start[(transpose ? edges[i].dst : edges[i].src) + 1]++;
+    }
+    for (guint32 v = 0; v < num_nodes; v++) {
+        row_start[v + 1] += row_start[v];
+    }
+
+    guint64 *fill = g_memdup2(row_start, ((gsize)num_nodes + 1) * sizeof(guint64));
+    for (guint64 i = 0; i < num_edges; i++) {
+        guint32 from = transpose ? edges[i].dst : edges[i].src;
+        guint32 to = transpose ? edges[i].src : edges[i].dst;
+        neighbours[fill[from]++] = to;
+    }
+    g_free(fill);
+
+    CsrGraph *graph = g_new0(CsrGraph, 1);
+    GByteArray *adjacency = g_byte_array_new();
+    graph->num_nodes = num_nodes;
+    graph->offsets = g_new(guint64, (gsize)num_nodes + 1);
+    graph->degrees = g_new0(guint32, MAX(num_nodes, 1));
+
+    for (guint32 v = 0; v < num_nodes; v++) {
+        guint32 *row = neighbours + row_start[v];
+        guint64 length = row_start[v + 1] - row_start[v];
+        qsort(row, length, sizeof(guint32), compare_node_ids);
+
+        graph->offsets[v] = adjacency->len;
+        for (guint64 i = 0; i < length; i++) {
+            if (i == 0) {
+                gint64 diff = (gint64)row[0] - (gint64)v;
+                varint_append(adjacency, ((guint64)diff << 1) ^ (guint64)(diff >> 63));
+            } else if (row[i] != row[i - 1]) {
+                varint_append(adjacency, row[i] - row[i - 1] - 1);
+            } else {
+                continue; // Duplicate link
+            }
+            graph->degrees[v]++;
+        }
+        graph->num_edges += graph->degrees[v];
+    }
+    graph->offsets[num_nodes] = adjacency->len;
+
+    graph->adjacency_len = adjacency->len;
+    graph->adjacency = g_byte_array_free(adjacency, FALSE);
+    g_free(neighbours);
+    g_free(row_start);
+    return graph;
+}
+
+static void csr_graph_free(CsrGraph *graph) {
+    g_free(graph->offsets);
+    g_free(graph->degrees);
+    g_free(graph->adjacency);
+    g_free(graph);
+}
+
+// Cursor over the neighbours of one node of a CsrGraph
+typedef struct {
+    const guint8 *cursor;
+    guint32 remaining;
+    guint32 node;
+    guint32 previous;
+    gboolean first;
+} CsrIter;
+
+static inline void csr_iter_init(CsrIter *iter, const CsrGraph *graph, guint32 v) {
+    iter->cursor = graph->adjacency + graph->offsets[v];
+    iter->remaining = graph->degrees[v];
+    iter->node = v;
+    iter->first = TRUE;
+}
+
+/**
+ * @brief Decode the next neighbour; returns FALSE once the row is exhausted.
+ */
+static inline gboolean csr_iter_next(CsrIter *iter, guint32 *neighbour) {
+    if (iter->remaining == 0) return FALSE;
+    iter->remaining--;
+
+    guint64 value = varint_read(&iter->cursor);
+    if (iter->first) {
+        gint64 diff = (gint64)(value >> 1) ^ -(gint64)(value & 1);
+        iter->previous = (guint32)((gint64)iter->node + diff);
+        iter->first = FALSE;
+    } else {
+        iter->previous += (guint32)value + 1;
+    }
+    *neighbour = iter->previous;
+    return TRUE;
+}
+
+/**
+ * @brief Write a CSR graph to a binary file.
+ *
+ * Layout: "CSRG", guint32 version, guint32 num_nodes, guint64 num_edges,
+ * guint64 adjacency_len, then offsets, degrees and the adjacency bytes,
+ * all in host byte order.
+ */
+static gboolean csr_graph_save(const CsrGraph *graph, const gchar *filename) {
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        g_printerr("Failed to write graph to %s\n", filename);
+        return FALSE;
+    }
+
+    guint32 version = 1;
+    guint64 adjacency_len = graph->adjacency_len;
+    fwrite("CSRG", 1, 4, file);
+    fwrite(&version, sizeof(version), 1, file);
+    fwrite(&graph->num_nodes, sizeof(graph->num_nodes), 1, file);
+    fwrite(&graph->num_edges, sizeof(graph->num_edges), 1, file);
+    fwrite(&adjacency_len, sizeof(adjacency_len), 1, file);
+    fwrite(graph->offsets, sizeof(guint64), (gsize)graph->num_nodes + 1, file);
+    fwrite(graph->degrees, sizeof(guint32), graph->num_nodes, file);
+    fwrite(graph->adjacency, 1, graph->adjacency_len, file);
+
+    gboolean ok = !ferror(file);
+    if (fclose(file) != 0) ok = FALSE;
+    if (!ok) g_printerr("Failed to write graph to %s\n", filename);
+    return ok;
+}
+
+typedef struct GraphTask GraphTask;
+typedef void (*GraphTaskFunc)(GraphTask *task);
+
+// Work shared by the threads of one parallel pass over the nodes
+struct GraphTask {
+    GraphTaskFunc func;
+    const CsrGraph *in_links;
+    const CsrGraph *out_links;
+    const gdouble *input;   // Per-node values read by this pass
+    gdouble *output;        // Per-node values written by this pass
+    gdouble *contrib;       // PageRank: rank / out-degree of each node
+    gdouble base;           // PageRank: teleport plus dangling mass per node
+    guint32 begin;
+    guint32 end;
+    gdouble sum;            // Partial result returned by the worker
+    gdouble dangling;       // PageRank: partial rank mass of dangling nodes
+};
+
+static gpointer graph_task_thread(gpointer data) {
+    GraphTask *task = data;
+    task->func(task);
+    return NULL;
+}
+
+/**
+ * @brief Run func over [0, num_nodes) split into one range per thread.
+ *
+ * Each task is a copy of template with its own begin/end; the partial
+ * sums of all tasks are added up into template->sum and template->dangling.
+ */
+static void graph_parallel_for(GraphTask *template, guint32 num_nodes, int threads, GraphTaskFunc func) {
+    threads = CLAMP(threads, 1, (int)MAX(num_nodes, 1));
+
+    GraphTask *tasks = g_new(GraphTask, threads);
+    GThread **workers = g_new(GThread *, threads);
+
+    for (int t = 0; t < threads; t++) {
+        GraphTask *task = &tasks[t];
+        *task = *template;
+        task->func = func;
+        task->begin = (guint32)((guint64)num_nodes * t / threads);
+        task->end = (guint32)((guint64)num_nodes * (t + 1) / threads);
+        task->sum = 0;
+        task->dangling = 0;
+        workers[t] = t == 0 ? NULL : g_thread_new("graph", graph_task_thread, task);
+    }
+    func(&tasks[0]); // The calling thread takes the first range
+
+    template->sum = 0;
+    template->dangling = 0;
+    for (int t = 0; t < threads; t++) {
+        GraphTask *task = &tasks[t];
+        if (workers[t]) g_thread_join(workers[t]);
+        template->sum += task->sum;
+        template->dangling += task->dangling;
+    }
+    g_free(workers);
+    g_free(tasks);
+}
+
+// One PageRank iteration over a node range: pull ranks over incoming links
+static void pagerank_pass(GraphTask *task) {
+    for (guint32 v = task->begin; v < task->end; v++) {
+        gdouble incoming = 0;
+        guint32 u;
+        CsrIter iter;
+        csr_iter_init(&iter, task->in_links, v);
+        while (csr_iter_next(&iter, &u)) {
+            incoming += task->contrib[u];
+        }
+        gdouble rank = task->base + PAGERANK_DAMPING * incoming;
+        task->sum += ABS(rank - task->input[v]);
+        task->output[v] = rank;
+    }
+}
+
+// Recompute rank / out-degree for the ranks just written
+static void pagerank_contrib_pass(GraphTask *task) {
+    for (guint32 v = task->begin; v < task->end; v++) {
+        guint32 degree = task->out_links->degrees[v];
+        if (degree == 0) {
+            task->dangling += task->input[v];
+            task->contrib[v] = 0;
+        } else {
+            task->contrib[v] = task->input[v] / degree;
+        }
+    }
+}
+
+/**
+ * @brief Compute PageRank with the given number of threads.
+ *
+ * @return A newly allocated array of num_nodes ranks summing to 1.
+ */
+static gdouble* compute_pagerank(const CsrGraph *in_links, const CsrGraph *out_links, int threads) {
+    guint32 n = in_links->num_nodes;
+    gdouble *rank = g_new(gdouble, MAX(n, 1));
+    gdouble *next = g_new(gdouble, MAX(n, 1));
+    gdouble *contrib = g_new(gdouble, MAX(n, 1));
+
+    for (guint32 v = 0; v < n; v++) rank[v] = 1.0 / n;
+
+    GraphTask task = { .in_links = in_links, .out_links = out_links, .contrib = contrib };
+    for (int iteration = 0; iteration < PAGERANK_MAX_ITERATIONS && n > 0; iteration++) {
+        task.input = rank;
+        graph_parallel_for(&task, n, threads, pagerank_contrib_pass);
+
+        // Rank of dangling pages is spread evenly over all pages
+        task.base = (1.0 - PAGERANK_DAMPING) / n + PAGERANK_DAMPING * task.dangling / n;
+        task.output = next;
+        graph_parallel_for(&task, n, threads, pagerank_pass);
+
+        gdouble *swap = rank;
+        rank = next;
+        next = swap;
+        if (task.sum < PAGERANK_TOLERANCE) break;
+    }
+
+    g_free(next);
+    g_free(contrib);
+    return rank;
+}
+
+// HITS: sum the neighbour scores of each node and accumulate the total
+static void hits_pass(GraphTask *task) {
+    for (guint32 v = task->begin; v < task->end; v++) {
+        gdouble score = 0;
+        guint32 u;
+        CsrIter iter;
+        csr_iter_init(&iter, task->in_links, v);
+        while (csr_iter_next(&iter, &u)) {
+            score += task->input[u];
+        }
+        task->output[v] = score;
+        task->sum += score;
+    }
+}
+
+static void hits_normalize_pass(GraphTask *task) {
+    for (guint32 v = task->begin; v < task->end; v++) {
+        task->output[v] *= task->base;
+    }
+}
+
+/**
+ * @brief Compute HITS hub and authority scores with the given number of threads.
+ *
+ * Scores are normalised to sum to 1 after every step.
+ *
+ * @param hubs Set to a newly allocated array of hub scores.
+ * @param authorities Set to a newly allocated array of authority scores.
+ */
+static void compute_hits(const CsrGraph *in_links, const CsrGraph *out_links, int threads,
+                         gdouble **hubs, gdouble **authorities) {
+    guint32 n = in_links->num_nodes;
+    gdouble *hub = g_new(gdouble, MAX(n, 1));
+    gdouble *authority = g_new(gdouble, MAX(n, 1));
+
+    for (guint32 v = 0; v < n; v++) hub[v] = 1.0;
+
+    GraphTask task = { 0 };
+    for (int iteration = 0; iteration < HITS_ITERATIONS && n > 0; iteration++) {
+        // Authority: sum of hub scores of pages linking here
+        task.in_links = in_links;
+        task.input = hub;
+        task.output = authority;
+        graph_parallel_for(&task, n, threads, hits_pass);
+        task.base = task.sum > 0 ? 1.0 / task.sum : 0;
+        graph_parallel_for(&task, n, threads, hits_normalize_pass);
+
+        // Hub: sum of authority scores of pages linked to
+        task.in_links = out_links;
+        task.input = authority;
+        task.output = hub;
+        graph_parallel_for(&task, n, threads, hits_pass);
+        task.base = task.sum > 0 ? 1.0 / task.sum : 0;
+        graph_parallel_for(&task, n, threads, hits_normalize_pass);
+    }
+
+    *hubs = hub;
+    *authorities = authority;
+}
+
+/**
+ * @brief Snapshot the recorded edges and build both CSR directions.
+ *
+ * The edge list is copied under queue_mutex so crawling can continue
+ * while the graphs are built.
+ */
+static void link_graph_snapshot(Crawler *crawler, CsrGraph **out_links, CsrGraph **in_links) {
+    g_mutex_lock(&crawler->queue_mutex);
+    guint32 num_nodes = crawler->link_graph.node_urls->len;
+    guint64 num_edges = crawler->link_graph.edges->len;
+    LinkEdge *edges = g_memdup2(crawler->link_graph.edges->data, MAX(num_edges, 1) * sizeof(LinkEdge));
+    g_mutex_unlock(&crawler->queue_mutex);
+
+    *out_links = csr_graph_build(edges, num_edges, num_nodes, FALSE);
+    *in_links = csr_graph_build(edges, num_edges, num_nodes, TRUE);
+    g_free(edges);
+}
+
+static gint compare_by_rank(gconstpointer a, gconstpointer b, gpointer user_data) {
+    Crawler *crawler = user_data;
+    const UrlItem *x = a;
+    const UrlItem *y = b;
+    gdouble rx = x->node_id < crawler->link_graph.ranked_nodes ? crawler->link_graph.ranks[x->node_id] : 0;
+    gdouble ry = y->node_id < crawler->link_graph.ranked_nodes ? crawler->link_graph.ranks[y->node_id] : 0;
+    return (rx < ry) - (rx > ry);
+}
+
+/**
+ * @brief Recompute PageRank and reorder the frontier by it, highest first.
+ *
+ * URLs discovered after the ranking keep their FIFO order behind ranked ones.
+ */
+static void update_frontier_priorities(Crawler *crawler) {
+    CsrGraph *out_links, *in_links;
+    link_graph_snapshot(crawler, &out_links, &in_links);
+    gdouble *ranks = compute_pagerank(in_links, out_links, crawler->config.threads);
+
+    g_mutex_lock(&crawler->queue_mutex);
+    g_free(crawler->link_graph.ranks);
+    crawler->link_graph.ranks = ranks;
+    crawler->link_graph.ranked_nodes = in_links->num_nodes;
+    g_queue_sort(crawler->url_queue, compare_by_rank, crawler);
+    g_mutex_unlock(&crawler->queue_mutex);
+
+    g_print("Frontier reprioritised by PageRank over %u pages and %" G_GUINT64_FORMAT " links\n",
+            in_links->num_nodes, in_links->num_edges);
+    csr_graph_free(out_links);
+    csr_graph_free(in_links);
+}
+
+/**
+ * @brief Export the link graph as CSR plus a node table with scores.
+ *
+ * The node table has one "id<TAB>url<TAB>pagerank<TAB>hub<TAB>authority"
+ * line per node.
+ */
+static void export_link_graph(Crawler *crawler, const gchar *filename) {
+    CsrGraph *out_links, *in_links;
+    link_graph_snapshot(crawler, &out_links, &in_links);
+
+    gdouble *ranks = compute_pagerank(in_links, out_links, crawler->config.threads);
+    gdouble *hubs, *authorities;
+    compute_hits(in_links, out_links, crawler->config.threads, &hubs, &authorities);
+
+    if (csr_graph_save(out_links, filename)) {
+        g_print("Link graph saved to %s (%u nodes, %" G_GUINT64_FORMAT " edges, %" G_GSIZE_FORMAT " adjacency bytes)\n",
+                filename, out_links->num_nodes, out_links->num_edges, out_links->adjacency_len);
+    }
+
+    gchar *nodes_filename = g_strconcat(filename, ".nodes", NULL);
+    FILE *file = fopen(nodes_filename, "w");
+    if (file) {
+        for (guint32 v = 0; v < out_links->num_nodes; v++) {
+            fprintf(file, "%u\t%s\t%.9g\t%.9g\t%.9g\n", v,
+                    (const gchar *)g_ptr_array_index(crawler->link_graph.node_urls, v),
+                    ranks[v], hubs[v], authorities[v]);
+        }
+        fclose(file);
+        g_print("Node table saved to %s\n", nodes_filename);
+    } else {
+        g_printerr("Failed to save node table to %s\n", nodes_filename);
+    }
+
+    g_free(nodes_filename);
+    g_free(ranks);
+    g_free(hubs);
+    g_free(authorities);
+    csr_graph_free(out_links);
+    csr_graph_free(in_links);
+}
+
+static void url_item_free(gpointer data) {
+    UrlItem *item = data;
+    g_free(item->url);
+    g_free(item);
+}
+
+void crawler_set_threads(Crawler *crawler, gint threads) {
+    g_return_if_fail(threads > 0);
+    g_mutex_lock(&crawler->queue_mutex);
+    crawler->config.threads = threads;
+    if (crawler->thread_pool) {
+        crawler->governor.concurrency = threads;
+        crawler->governor.over_budget = FALSE; // Let the governor re-evaluate from the new level
+        g_thread_pool_set_max_threads(crawler->thread_pool, threads, NULL);
+        g_cond_signal(&crawler->queue_cond);
+    }
+    g_mutex_unlock(&crawler->queue_mutex);
+}
+
+void crawler_set_max_depth(Crawler *crawler, gint max_depth) {
+    g_return_if_fail(max_depth >= 0);
+    g_atomic_int_set(&crawler->config.max_depth, max_depth);
+}
+
+void crawler_set_host_rate(Crawler *crawler, const gchar *host, gdouble rate) {
+    rate = MAX(rate, 0);
+    g_mutex_lock(&crawler->rate_mutex);
+    if (host == NULL) {
+        crawler->config.host_rate = rate;
+    } else {
+        HostRate *state = g_hash_table_lookup(crawler->host_rates, host);
+        if (state == NULL) {
+            state = g_new0(HostRate, 1);
+            g_hash_table_insert(crawler->host_rates, g_strdup(host), state);
+        }
+        state->rate = rate;
+    }
+    g_mutex_unlock(&crawler->rate_mutex);
+
+    // Let the dispatcher look at throttled hosts again under the new rate
+    g_mutex_lock(&crawler->queue_mutex);
+    g_cond_signal(&crawler->queue_cond);
+    g_mutex_unlock(&crawler->queue_mutex);
+}
+
+static void crawler_set_paused(Crawler *crawler, gboolean paused) {
+    g_mutex_lock(&crawler->queue_mutex);
+    crawler->dispatch_paused = paused;
+    g_cond_signal(&crawler->queue_cond);
+    g_mutex_unlock(&crawler->queue_mutex);
+}
+
+void crawler_pause(Crawler *crawler) {
+    crawler_set_paused(crawler, TRUE);
+}
+
+void crawler_resume(Crawler *crawler) {
+    crawler_set_paused(crawler, FALSE);
+}
+
+guint crawler_drain(Crawler *crawler) {
+    g_mutex_lock(&crawler->queue_mutex);
+    crawler->draining = TRUE;
+    guint dropped = crawler->url_queue ? g_queue_get_length(crawler->url_queue) + crawler->governor.spilled : 0;
+    g_cond_signal(&crawler->queue_cond);
+    g_mutex_unlock(&crawler->queue_mutex);
+    return dropped;
+}
+
+/**
+ * @brief Append a snapshot of the crawl statistics, one "key: value" per line.
+ *
+ * @return FALSE, appending nothing, if crawler_run() is not running.
+ */
+gboolean crawler_append_stats(Crawler *crawler, GString *out) {
+    g_mutex_lock(&crawler->queue_mutex);
+    if (crawler->url_queue == NULL) {
+        g_mutex_unlock(&crawler->queue_mutex);
+        return FALSE;
+    }
+    gdouble elapsed = (g_get_monotonic_time() - crawler->crawl_started) / (gdouble)G_USEC_PER_SEC;
+    g_string_append_printf(out, "elapsed_seconds: %.1f\n", elapsed);
+    g_string_append_printf(out, "pages_fetched: %u\n", crawler->pages_fetched);
+    g_string_append_printf(out, "pages_failed: %u\n", crawler->pages_failed);
+    g_string_append_printf(out, "pages_per_second: %.2f\n", elapsed > 0 ? crawler->pages_fetched / elapsed : 0);
+    g_string_append_printf(out, "in_flight: %u\n", crawler->active_fetches);
+    g_string_append_printf(out, "frontier: %u\n", g_queue_get_length(crawler->url_queue));
+    g_string_append_printf(out, "frontier_spilled: %u\n", crawler->governor.spilled);
+    g_string_append_printf(out, "visited: %u\n", crawler->link_graph.node_urls->len);
+    g_string_append_printf(out, "links: %u\n", crawler->link_graph.edges->len);
+    g_string_append_printf(out, "memory_bytes: %" G_GSIZE_FORMAT "\n", governor_usage(crawler));
+    g_string_append_printf(out, "memory_budget_bytes: %" G_GSIZE_FORMAT "\n", crawler->governor.budget);
+    g_string_append_printf(out, "threads: %d\n", crawler->config.threads);
+    g_string_append_printf(out, "concurrency: %u\n", crawler->governor.concurrency);
+    g_string_append_printf(out, "max_depth: %d\n", g_atomic_int_get(&crawler->config.max_depth));
+    g_string_append_printf(out, "state: %s\n", crawler->draining ? "draining" : crawler->dispatch_paused ? "paused" : "running");
+
+    // Holding queue_mutex keeps crawler_run() from freeing the sketches meanwhile
+    g_string_append_printf(out, "distinct_urls_estimate: %.0f\n", hll_estimate(&crawler->sketches->urls));
+    g_string_append_printf(out, "distinct_hosts_estimate: %.0f\n", hll_estimate(&crawler->sketches->hosts));
+    heavy_hitters_append(&crawler->sketches->top_hosts, "top_hosts", out);
+    heavy_hitters_append(&crawler->sketches->top_prefixes, "top_prefixes", out);
+    g_mutex_unlock(&crawler->queue_mutex);
+    return TRUE;
+}
+
+/**
+ * @brief Execute one control command and append the reply to out.
+ *
+ * Every reply ends with a line starting with "OK" or "ERR".
+ */
+static void control_execute(Crawler *crawler, const gchar *line, GString *out) {
+    gchar **args = g_strsplit_set(line, " \t", 3);
+    guint argc = g_strv_length(args);
+    const gchar *command = argc > 0 ? args[0] : "";
+
+    if (g_strcmp0(command, "threads") == 0 && argc == 2 && atoi(args[1]) > 0) {
+        crawler_set_threads(crawler, atoi(args[1]));
+        g_string_append_printf(out, "OK threads %d\n", atoi(args[1]));
+    } else if (g_strcmp0(command, "depth") == 0 && argc == 2 && atoi(args[1]) >= 0) {
+        crawler_set_max_depth(crawler, atoi(args[1]));
+        g_string_append_printf(out, "OK depth %d\n", atoi(args[1]));
+    } else if (g_strcmp0(command, "rate") == 0 && argc == 3) {
+        gdouble rate = MAX(g_ascii_strtod(args[2], NULL), 0);
+        crawler_set_host_rate(crawler, g_strcmp0(args[1], "*") == 0 ? NULL : args[1], rate);
+        g_string_append_printf(out, "OK rate %s %.2f\n", args[1], rate);
+    } else if (g_strcmp0(command, "pause") == 0) {
+        crawler_pause(crawler);
+        g_string_append_printf(out, "OK %s\n", command);
+    } else if (g_strcmp0(command, "resume") == 0) {
+        crawler_resume(crawler);
+        g_string_append_printf(out, "OK %s\n", command);
+    } else if (g_strcmp0(command, "drain") == 0) {
+        guint dropped = crawler_drain(crawler);
+        g_mutex_lock(&crawler->queue_mutex);
+        guint in_flight = crawler->active_fetches;
+        g_mutex_unlock(&crawler->queue_mutex);
+        g_string_append_printf(out, "OK draining, %u in flight, %u frontier URLs dropped\n", in_flight, dropped);
+    } else if (g_strcmp0(command, "stats") == 0) {
+        g_string_append(out, crawler_append_stats(crawler, out) ? "OK\n" : "ERR no crawl running\n");
+    } else if (g_strcmp0(command, "help") == 0) {
+        g_string_append(out, "threads N | depth N | rate HOST|* N | pause | resume | drain | stats | help\nOK\n");
+    } else {
+        g_string_append_printf(out, "ERR unknown command: %s\n", line);
+    }
+
+    g_strfreev(args);
+}
+
+/**
+ * @brief Count a connection as soon as it is accepted.
+ *
+ * Runs on the control thread before the service hands the connection to
+ * a service thread, so control_socket_stop() sees every connection once
+ * that thread has been joined.
+ */
+static gboolean control_incoming(GSocketService *service, GSocketConnection *connection,
+                                 GObject *source_object, gpointer user_data) {
+    ControlSocket *control = user_data;
+    g_mutex_lock(&control->mutex);
+    control->connections++;
+    g_mutex_unlock(&control->mutex);
+    return FALSE; // Let the threaded service run the connection
+}
+
+/**
+ * @brief Serve one control connection: read commands line by line and reply.
+ */
+static gboolean control_handle_connection(GThreadedSocketService *service, GSocketConnection *connection,
+                                          GObject *source_object, gpointer user_data) {
+    ControlSocket *control = user_data;
+    GDataInputStream *reader = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+    GOutputStream *output = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+    gchar *line;
+
+    while ((line = g_data_input_stream_read_line(reader, NULL, control->cancellable, NULL)) != NULL) {
+        GString *reply = g_string_new(NULL);
+        control_execute(control->crawler, g_strstrip(line), reply);
+        gboolean ok = g_output_stream_write_all(output, reply->str, reply->len, NULL, control->cancellable, NULL);
+        g_string_free(reply, TRUE);
+        g_free(line);
+        if (!ok) break;
+    }
+
+    g_object_unref(reader);
+    g_mutex_lock(&control->mutex);
+    control->connections--;
+    g_cond_signal(&control->cond);
+    g_mutex_unlock(&control->mutex);
+    return TRUE;
+}
+
+static gpointer control_thread(gpointer data) {
+    ControlSocket *control = data;
+    g_main_context_push_thread_default(control->context);
+    g_main_loop_run(control->loop);
+    g_main_context_pop_thread_default(control->context);
+    return NULL;
+}
+
+/**
+ * @brief Listen for control commands on a UNIX socket.
+ *
+ * The listener is driven by a main loop on its own thread; each client
+ * connection is served on a service thread.
+ *
+ * @return The control socket, or NULL if the socket cannot be created.
+ */
+static ControlSocket* control_socket_start(Crawler *crawler, const gchar *path) {
+    GError *error = NULL;
+    ControlSocket *control = g_new0(ControlSocket, 1);
+    control->crawler = crawler;
+    control->path = g_strdup(path);
+    control->cancellable = g_cancellable_new();
+    g_mutex_init(&control->mutex);
+    g_cond_init(&control->cond);
+    control->context = g_main_context_new();
+    control->loop = g_main_loop_new(control->context, FALSE);
+
+    // The service attaches its listening source to the thread-default context
+    g_main_context_push_thread_default(control->context);
+    control->service = g_threaded_socket_service_new(4);
+    g_unlink(path);
+    GSocketAddress *address = g_unix_socket_address_new(path);
+    gboolean ok = g_socket_listener_add_address(G_SOCKET_LISTENER(control->service), address,
+                                                G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT,
+                                                NULL, NULL, &error);
+    g_object_unref(address);
+    if (ok) {
+        g_signal_connect(control->service, "incoming", G_CALLBACK(control_incoming), control);
+        g_signal_connect(control->service, "run", G_CALLBACK(control_handle_connection), control);
+        g_socket_service_start(control->service);
+    }
+    g_main_context_pop_thread_default(control->context);
+
+    if (!ok) {
+        g_printerr("Failed to create control socket %s: %s\n", path, error->message);
+        g_error_free(error);
+        g_object_unref(control->service);
+        g_main_loop_unref(control->loop);
+        g_main_context_unref(control->context);
+        g_object_unref(control->cancellable);
+        g_mutex_clear(&control->mutex);
+        g_cond_clear(&control->cond);
+        g_free(control->path);
+        g_free(control);
+        return NULL;
+    }
+
+    control->thread = g_thread_new("control", control_thread, control);
+    g_print("Control socket listening on %s\n", path);
+    return control;
+}
+
+/**
+ * @brief Stop accepting commands and wait for the connected clients to be dropped.
+ *
+ * Must be called before the crawl state is torn down, since a client may
+ * be in the middle of a command.
+ */
+static void control_socket_stop(ControlSocket *control) {
+    g_socket_service_stop(control->service);
+    g_socket_listener_close(G_SOCKET_LISTENER(control->service));
+    g_main_loop_quit(control->loop);
+    g_thread_join(control->thread);
+
+    // No connection is accepted any more; end the ones in progress
+    g_cancellable_cancel(control->cancellable);
+    g_mutex_lock(&control->mutex);
+    while (control->connections > 0) {
+        g_cond_wait(&control->cond, &control->mutex);
+    }
+    g_mutex_unlock(&control->mutex);
+
+    g_object_unref(control->service);
+    g_object_unref(control->cancellable);
+    g_mutex_clear(&control->mutex);
+    g_cond_clear(&control->cond);
+    g_main_loop_unref(control->loop);
+    g_main_context_unref(control->context);
+    g_unlink(control->path);
+    g_free(control->path);
+    g_free(control);
+}
+
+GQuark crawler_error_quark(void) {
+    return g_quark_from_static_string("crawler-error-quark");
+}
+
+void crawler_config_init(CrawlerConfig *config) {
+    memset(config, 0, sizeof(*config));
+    config->threads = 5;
+    config->max_depth = 3;
+    config->max_body_size = 16 * 1024 * 1024;
+    config->save_pages = TRUE;
+}
+
+/**
+ * @brief Create a crawler. The configuration is copied.
+ */
+Crawler* crawler_new(const CrawlerConfig *config) {
+    Crawler *crawler = g_new0(Crawler, 1);
+    crawler->config = *config;
+    crawler->config.threads = MAX(config->threads, 1);
+    crawler->config.graph_output = g_strdup(config->graph_output);
+    crawler->config.trace_output = g_strdup(config->trace_output);
+    crawler->config.record_output = g_strdup(config->record_output);
+    crawler->config.replay_input = g_strdup(config->replay_input);
+    crawler->config.control_socket_path = g_strdup(config->control_socket_path);
+    crawler->config.mirror_root = g_strdup(config->mirror_root);
+    crawler->config.page_index = g_strdup(config->page_index);
+    g_mutex_init(&crawler->queue_mutex);
+    g_cond_init(&crawler->queue_cond);
+    g_mutex_init(&crawler->rate_mutex);
+    g_mutex_init(&crawler->record_mutex);
+    g_mutex_init(&crawler->trace_mutex);
+    crawler->host_rates = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    return crawler;
+}
+
+void crawler_free(Crawler *crawler) {
+    if (crawler == NULL) return;
+    crawler_set_page_callback(crawler, NULL, NULL, NULL);
+    crawler_set_link_callback(crawler, NULL, NULL, NULL);
+    g_hash_table_destroy(crawler->host_rates);
+    g_mutex_clear(&crawler->trace_mutex);
+    g_mutex_clear(&crawler->record_mutex);
+    g_mutex_clear(&crawler->rate_mutex);
+    g_cond_clear(&crawler->queue_cond);
+    g_mutex_clear(&crawler->queue_mutex);
+    g_free(crawler->config.graph_output);
+    g_free(crawler->config.trace_output);
+    g_free(crawler->config.record_output);
+    g_free(crawler->config.replay_input);
+    g_free(crawler->config.control_socket_path);
+    g_free(crawler->config.mirror_root);
+    g_free(crawler->config.page_index);
+    g_free(crawler);
+}
+
+void crawler_set_page_callback(Crawler *crawler, CrawlerPageFunc func, gpointer user_data, GDestroyNotify destroy) {
+    if (crawler->page_destroy) crawler->page_destroy(crawler->page_data);
+    crawler->page_func = func;
+    crawler->page_data = user_data;
+    crawler->page_destroy = destroy;
+}
+
+void crawler_set_link_callback(Crawler *crawler, CrawlerLinkFunc func, gpointer user_data, GDestroyNotify destroy) {
+    if (crawler->link_destroy) crawler->link_destroy(crawler->link_data);
+    crawler->link_func = func;
+    crawler->link_data = user_data;
+    crawler->link_destroy = destroy;
+}
+
+/**
+ * @brief Find a response header without copying it.
+ *
+ * @param name Header name, matched case-insensitively.
+ * @param value_len Set to the length of the value, which is not NUL-terminated.
+ * @return A pointer to the value inside page->headers, or NULL.
+ */
+const gchar* crawler_page_get_header(const CrawlerPage *page, const gchar *name, gsize *value_len) {
+    gsize name_len = strlen(name);
+    const gchar *line = page->headers;
+    const gchar *end = page->headers + page->headers_len;
+
+    while (line < end) {
+        const gchar *eol = memchr(line, '\n', end - line);
+        if (eol == NULL) eol = end;
+        if ((gsize)(eol - line) > name_len && line[name_len] == ':' && g_ascii_strncasecmp(line, name, name_len) == 0) {
+            const gchar *value = line + name_len + 1;
+            const gchar *value_end = eol;
+            while (value < value_end && *value == ' ') value++;
+            while (value_end > value && (value_end[-1] == '\r' || value_end[-1] == ' ')) value_end--;
+            if (value_len) *value_len = value_end - value;
+            return value;
+        }
+        line = eol + 1;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Crawl from the given URLs until the frontier is empty or the crawl is drained.
+ *
+ * Blocks the calling thread, which acts as the dispatcher. The runtime
+ * controls may be called from other threads meanwhile.
+ *
+ * @param start_urls A NULL-terminated array of initial URLs.
+ * @return FALSE with error set if an archive cannot be opened.
+ */
+gboolean crawler_run(Crawler *crawler, const gchar *const *start_urls, GError **error) {
+    crawler->fetch_backend = crawler->config.mirror_root ? fetch_from_file : fetch_from_network;
+    crawler->allow_file_urls = crawler->config.mirror_root != NULL;
+    for (int i = 0; start_urls[i] != NULL; i++) {
+        if (g_str_has_prefix(start_urls[i], "file:")) crawler->allow_file_urls = TRUE;
+    }
+    if (crawler->config.mirror_root) {
+        gchar *root = g_canonicalize_filename(crawler->config.mirror_root, NULL);
+        gchar *root_uri = g_filename_to_uri(root, NULL, NULL);
+        crawler->mirror_root_uri = g_str_has_suffix(root_uri, "/") ? g_strdup(root_uri) : g_strconcat(root_uri, "/", NULL);
+        g_free(root_uri);
+        g_free(root);
+    }
+    if (crawler->config.replay_input) {
+        crawler->replay_archive = replay_archive_open(crawler->config.replay_input);
+        if (!crawler->replay_archive) {
+            g_set_error(error, CRAWLER_ERROR, CRAWLER_ERROR_ARCHIVE, "Cannot replay archive %s", crawler->config.replay_input);
+            g_clear_pointer(&crawler->mirror_root_uri, g_free);
+            return FALSE;
+        }
+        crawler->fetch_backend = fetch_from_archive;
+    }
+    if (crawler->config.record_output) {
+        crawler->record_file = archive_open_for_record(crawler->config.record_output);
+        if (!crawler->record_file) {
+            g_set_error(error, CRAWLER_ERROR, CRAWLER_ERROR_ARCHIVE, "Cannot record to archive %s", crawler->config.record_output);
+            g_clear_pointer(&crawler->replay_archive, replay_archive_free);
+            g_clear_pointer(&crawler->mirror_root_uri, g_free);
+            return FALSE;
+        }
+    }
+
+    if (crawler->config.page_index) {
+        crawler->page_index = fopen(crawler->config.page_index, "a");
+        if (!crawler->page_index) {
+            g_set_error(error, CRAWLER_ERROR, CRAWLER_ERROR_PAGE_INDEX, "Cannot open page index %s", crawler->config.page_index);
+            if (crawler->record_file) fclose(crawler->record_file);
+            crawler->record_file = NULL;
+            g_clear_pointer(&crawler->replay_archive, replay_archive_free);
+            g_clear_pointer(&crawler->mirror_root_uri, g_free);
+            return FALSE;
+        }
+    }
+
+    crawler->visited_urls = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    crawler->link_graph.node_urls = g_ptr_array_new();
+    crawler->link_graph.edges = g_array_new(FALSE, FALSE, sizeof(LinkEdge));
+    crawler->link_graph.queued = g_byte_array_new();
+    crawler->sketches = crawl_sketches_new();
+    crawler->active_fetches = crawler->pages_fetched = crawler->pages_failed = 0;
+    crawler->dispatch_paused = crawler->draining = FALSE;
+    memset(&crawler->governor, 0, sizeof(crawler->governor));
+    crawler->governor.budget = crawler->config.memory_budget;
+    crawler->crawl_started = g_get_monotonic_time();
+    crawler->trace_buffers = g_ptr_array_new_with_free_func(trace_buffer_free);
+    crawler->trace_generation = (guint)g_atomic_int_add(&trace_generation, 1) + 1;
+    crawler->trace_epoch = g_get_monotonic_time();
+    if (crawler->config.trace_output) {
+        trace_buffer_get(crawler); // The dispatcher's buffer gets the first track
+    }
+
+    // A frontier marks the crawl as running for crawler_append_stats()
+    g_mutex_lock(&crawler->queue_mutex);
+    crawler->url_queue = g_queue_new();
+    g_mutex_unlock(&crawler->queue_mutex);
+
+    // Add initial URLs to the queue
+    for (int i = 0; start_urls[i] != NULL; i++) {
+        g_mutex_lock(&crawler->queue_mutex);
+        guint32 node_id = intern_url(crawler, start_urls[i]);
+
+        if (!crawler->link_graph.queued->data[node_id]) {
+            crawler->link_graph.queued->data[node_id] = 1;
+            crawl_sketches_add_link(crawler->sketches, start_urls[i]);
+
+            UrlItem *item = g_new(UrlItem, 1);
+            item->url = g_strdup(start_urls[i]);
+            item->depth = 0;
+            item->node_id = node_id;
+            item->queued_at = g_get_monotonic_time();
+
+            frontier_push(crawler, item);
+        }
+        g_mutex_unlock(&crawler->queue_mutex);
+    }
+
+    // Initialize the thread pool
+    g_mutex_lock(&crawler->queue_mutex);
+    crawler->thread_pool = g_thread_pool_new(fetch_url, crawler, crawler->config.threads, FALSE, NULL);
+    crawler->governor.concurrency = crawler->config.threads;
+    g_mutex_unlock(&crawler->queue_mutex);
+    if (crawler->config.control_socket_path) {
+        crawler->control_socket = control_socket_start(crawler, crawler->config.control_socket_path);
+    }
+
+    // Process the queue, keeping at most governor.concurrency URLs in flight
+    // so the frontier order decides what is fetched next
+    guint ranked_at = 0;
+    gint64 stats_interval = (gint64)MAX(crawler->config.stats_interval, 0) * G_USEC_PER_SEC;
+    gint64 next_report = stats_interval ? g_get_monotonic_time() + stats_interval : 0;
+    while (TRUE) {
+        g_mutex_lock(&crawler->queue_mutex);
+        guint fetched = crawler->pages_fetched;
+        g_mutex_unlock(&crawler->queue_mutex);
+
+        if (next_report && g_get_monotonic_time() >= next_report) {
+            GString *stats = g_string_new(NULL);
+            crawler_append_stats(crawler, stats);
+            g_print("Crawl statistics:\n%s", stats->str);
+            g_string_free(stats, TRUE);
+            next_report = g_get_monotonic_time() + stats_interval;
+        }
+
+        // A pass copies the edges and rebuilds the graph, so space passes out
+        // geometrically to keep the total ranking cost linear in the crawl size
+        guint rank_interval = MAX(MAX((guint)crawler->config.rank_interval, RANK_MIN_INTERVAL),
+                                  ranked_at / RANK_GROWTH_DIVISOR);
+        if (crawler->config.rank_interval > 0 && fetched - ranked_at >= rank_interval) {
+            gint64 rank_start = g_get_monotonic_time();
+            ranked_at = fetched;
+            update_frontier_priorities(crawler);
+            trace_span(crawler, "ranking", "frontier", rank_start);
+        }
+
+        g_mutex_lock(&crawler->queue_mutex);
+        UrlItem *item = NULL;
+        gboolean finished = FALSE;
+        while (TRUE) {
+            gint64 rate_wake = 0;
+            gboolean paused = governor_update(crawler);
+            if ((g_queue_is_empty(crawler->url_queue) || crawler->draining) && crawler->active_fetches == 0) {
+                finished = TRUE;
+                break;
+            }
+            // When paused with nothing in flight, fetch one URL at a time
+            // rather than stall: the memory left is not held by fetches.
+            if (!g_queue_is_empty(crawler->url_queue) && crawler->active_fetches < crawler->governor.concurrency &&
+                !(paused && crawler->active_fetches > 0) && !crawler->dispatch_paused && !crawler->draining) {
+                item = frontier_pop_ready(crawler, &rate_wake);
+                if (item) {
+                    crawler->active_fetches++;
+                    break;
+                }
+            }
+            // Wake up for the next statistics report or when a throttled host frees up
+            gint64 wake = next_report;
+            if (rate_wake && (wake == 0 || rate_wake < wake)) wake = rate_wake;
+            if (wake == 0) {
+                g_cond_wait(&crawler->queue_cond, &crawler->queue_mutex);
+            } else if (!g_cond_wait_until(&crawler->queue_cond, &crawler->queue_mutex, wake) && wake == next_report) {
+                break; // Time for a statistics report
+            }
+        }
+        g_mutex_unlock(&crawler->queue_mutex);
+
+        if (finished) break; // Queue drained and nothing in flight
+
+        if (item) g_thread_pool_push(crawler->thread_pool, item, NULL);
+    }
+
+    // Detach the pool first so a control command cannot retune it while it
+    // is freed, then wait for all threads to finish
+    g_mutex_lock(&crawler->queue_mutex);
+    GThreadPool *thread_pool = crawler->thread_pool;
+    crawler->thread_pool = NULL;
+    g_mutex_unlock(&crawler->queue_mutex);
+    g_thread_pool_free(thread_pool, FALSE, TRUE);
+    if (crawler->control_socket) {
+        control_socket_stop(crawler->control_socket);
+        crawler->control_socket = NULL;
+    }
+
+    if (crawler->config.graph_output) {
+        export_link_graph(crawler, crawler->config.graph_output);
+    }
+    if (crawler->config.trace_output) {
+        trace_write(crawler, crawler->config.trace_output);
+    }
+
+    if (crawler->record_file && fclose(crawler->record_file) != 0) {
+        g_printerr("Failed to write archive %s\n", crawler->config.record_output);
+    }
+    crawler->record_file = NULL;
+    if (crawler->page_index && fclose(crawler->page_index) != 0) {
+        g_printerr("Failed to write page index %s\n", crawler->config.page_index);
+    }
+    crawler->page_index = NULL;
+    g_clear_pointer(&crawler->replay_archive, replay_archive_free);
+    g_clear_pointer(&crawler->mirror_root_uri, g_free);
+
+    g_mutex_lock(&crawler->queue_mutex);
+    g_queue_free_full(crawler->url_queue, url_item_free); // Left over when draining
+    crawler->url_queue = NULL;
+    g_mutex_unlock(&crawler->queue_mutex);
+    if (crawler->governor.spill_file) {
+        fclose(crawler->governor.spill_file);
+        crawler->governor.spill_file = NULL;
+    }
+    g_ptr_array_free(crawler->link_graph.node_urls, TRUE);
+    g_array_free(crawler->link_graph.edges, TRUE);
+    g_byte_array_free(crawler->link_graph.queued, TRUE);
+    g_ptr_array_free(crawler->trace_buffers, TRUE);
+    g_free(crawler->link_graph.ranks);
+    g_hash_table_destroy(crawler->visited_urls);
+    g_clear_pointer(&crawler->sketches, crawl_sketches_free);
+    memset(&crawler->link_graph, 0, sizeof(crawler->link_graph));
+    crawler->visited_urls = NULL;
+    crawler->trace_buffers = NULL;
+    return TRUE;
+}
+
+#ifndef CRAWLER_NO_MAIN
+
+/**
+ * @brief Check whether a command line argument is a plain thread count.
+ */
+static gboolean is_thread_count(const gchar *arg) {
+    if (*arg == '\0') return FALSE;
+    for (const gchar *p = arg; *p; p++) {
+        if (!g_ascii_isdigit(*p)) return FALSE;
+    }
+    return TRUE;
+}
+
+int main(int argc, char *argv[]) {
+    CrawlerConfig config;
+    crawler_config_init(&config);
+    gint memory_budget_mb = 0;
+
+    GOptionEntry option_entries[] = {
+        { "threads", 't', 0, G_OPTION_ARG_INT, &config.threads, "Number of fetch threads (default 5)", "N" },
+        { "max-depth", 'd', 0, G_OPTION_ARG_INT, &config.max_depth, "Maximum crawl depth (default 3)", "N" },
+        { "graph-out", 0, 0, G_OPTION_ARG_FILENAME, &config.graph_output, "Write the link graph to FILE and FILE.nodes", "FILE" },
+        { "rank-interval", 0, 0, G_OPTION_ARG_INT, &config.rank_interval, "Recompute PageRank every N pages (at least 100) to prioritise the frontier", "N" },
+        { "trace", 0, 0, G_OPTION_ARG_FILENAME, &config.trace_output, "Write a Chrome trace-event timeline of the crawl to FILE", "FILE" },
+        { "record", 0, 0, G_OPTION_ARG_FILENAME, &config.record_output, "Append every fetched response to the archive FILE", "FILE" },
+        { "page-index", 0, 0, G_OPTION_ARG_FILENAME, &config.page_index, "List every saved page by URL in FILE, for crawler_page_server", "FILE" },
+        { "replay", 0, 0, G_OPTION_ARG_FILENAME, &config.replay_input, "Serve responses from the archive FILE instead of the network", "FILE" },
+        { "mirror-root", 0, 0, G_OPTION_ARG_FILENAME, &config.mirror_root, "Serve http(s) URLs from the wget-style mirror in DIR", "DIR" },
+        { "memory-budget", 0, 0, G_OPTION_ARG_INT, &memory_budget_mb, "Keep bodies, frontier and visited set under MB megabytes", "MB" },
+        { "max-body-size", 0, 0, G_OPTION_ARG_INT64, &config.max_body_size, "Give up on responses larger than BYTES (default 16 MB, 0 = no limit)", "BYTES" },
+        { "host-rate", 0, 0, G_OPTION_ARG_DOUBLE, &config.host_rate, "Fetch at most N pages per second from each host (0 = no limit)", "N" },
+        { "stats-interval", 0, 0, G_OPTION_ARG_INT, &config.stats_interval, "Print crawl statistics and sketches every SEC seconds", "SEC" },
+        { "control-socket", 0, 0, G_OPTION_ARG_FILENAME, &config.control_socket_path, "Accept control commands on a UNIX socket at PATH", "PATH" },
+        { NULL }
+    };
+
+    GError *error = NULL;
+    GOptionContext *context = g_option_context_new("<start_url1> [<start_url2> ...] [max_threads]");
+    g_option_context_add_main_entries(context, option_entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    // A trailing number is still accepted as the thread count
+    if (argc > 2 && is_thread_count(argv[argc - 1])) {
+        config.threads = atoi(argv[--argc]);
+    }
+
+    if (argc < 2 || config.threads < 1) {
+        g_print("Usage: %s [options] <start_url1> [<start_url2> ...] [max_threads]\n", argv[0]);
+        return 1;
+    }
+
+    // Create a NULL-terminated array of start URLs
+    const gchar **start_urls = (const gchar **)g_malloc(argc * sizeof(gchar *));
+    for (int i = 1; i < argc; i++) {
+        start_urls[i - 1] = argv[i];
+    }
+    start_urls[argc - 1] = NULL;
+
+    config.memory_budget = (gsize)MAX(memory_budget_mb, 0) * 1024 * 1024;
+    Crawler *crawler = crawler_new(&config);
+
+    g_print("Starting crawler with %d threads...\n", config.threads);
+    gboolean ok = crawler_run(crawler, start_urls, &error);
+    if (ok) {
+        g_print("Crawling finished.\n");
+    } else {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+    }
+
+    crawler_free(crawler);
+    g_free(start_urls);
+    g_free(config.record_output);
+    g_free(config.control_socket_path);
+    g_free(config.replay_input);
+    g_free(config.mirror_root);
+    g_free(config.page_index);
+    g_free(config.graph_output);
+    g_free(config.trace_output);
+    return ok ? 0 : 1;
+}
+
+#endif /* CRAWLER_NO_MAIN */
@@ -0,0 +1,107 @@
+/**
+ * @file glib_web_crawler.h
+ * @brief Embedding API of the GLib web crawler.
+ *
+ * glib_web_crawler.c can be linked into another program instead of being
+ * run as a command: compile it with -DCRAWLER_NO_MAIN and drive the crawl
+ * through the functions below. Every command line option has a matching
+ * CrawlerConfig field.
+ *
+ * Pages and links are handed to the callbacks on the fetch threads as
+ * views into the crawler's own buffers, so in-process extraction and
+ * classification need neither the saved files nor a copy of the body.
+ *
+ * Example:
+ * CrawlerConfig config;
+ * crawler_config_init(&config);
+ * config.save_pages = FALSE;
+ * Crawler *crawler = crawler_new(&config);
+ * crawler_set_page_callback(crawler, on_page, state, NULL);
+ * crawler_run(crawler, start_urls, &error);
+ * crawler_free(crawler);
+ *
+ * @author: Nelson Chung
+ * @date: 2024.11.23*/
+
+#ifndef GLIB_WEB_CRAWLER_H
+#define GLIB_WEB_CRAWLER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _Crawler Crawler;
+
+// Crawl settings; set up with crawler_config_init() and copied by crawler_new()
+typedef struct {
+    gint threads;               // Number of fetch threads (default 5)
+    gint max_depth;             // Maximum crawl depth (default 3)
+    gchar *graph_output;        // Write the link graph to FILE and FILE.nodes
+    gint rank_interval;         // Recompute PageRank every N pages (at least 100), 0 = never
+    gchar *trace_output;        // Write a Chrome trace-event timeline to FILE
+    gchar *record_output;       // Append every response to this archive
+    gchar *page_index;          // List every saved page by URL in this file
+    gchar *replay_input;        // Serve responses from this archive
+    gchar *mirror_root;         // Serve http(s) URLs from this wget-style mirror
+    gsize memory_budget;        // Bytes for bodies, frontier and visited set, 0 = no limit
+    gint64 max_body_size;       // Give up on larger responses (default 16 MB, 0 = no limit)
+    gdouble host_rate;          // Pages per second per host, 0 = no limit
+    gchar *control_socket_path; // Accept control commands on this UNIX socket
+    gint stats_interval;        // Print statistics every N seconds, 0 = never
+    gboolean save_pages;        // Save each page to a file (default TRUE)
+} CrawlerConfig;
+
+/*
+ * A fetched response as seen by the page callback. All pointers are views
+ * that are only valid during the callback; body is not NUL-terminated and
+ * headers holds "Name: value\r\n" lines.
+ */
+typedef struct {
+    const gchar *url;
+    gint depth;
+    guint status;
+    const gchar *headers;
+    gsize headers_len;
+    const gchar *body;
+    gsize body_len;
+} CrawlerPage;
+
+// Called on a fetch thread for every response, before it is saved and scanned for links
+typedef void (*CrawlerPageFunc)(Crawler *crawler, const CrawlerPage *page, gpointer user_data);
+
+// Called on a fetch thread for every link found; return FALSE to neither record nor follow it
+typedef gboolean (*CrawlerLinkFunc)(Crawler *crawler, const gchar *from_url, const gchar *to_url,
+                                    gint depth, gpointer user_data);
+
+#define CRAWLER_ERROR (crawler_error_quark())
+
+typedef enum {
+    CRAWLER_ERROR_ARCHIVE,   // A record or replay archive cannot be opened
+    CRAWLER_ERROR_PAGE_INDEX // The page index cannot be opened
+} CrawlerError;
+
+GQuark crawler_error_quark(void);
+
+void crawler_config_init(CrawlerConfig *config);
+Crawler* crawler_new(const CrawlerConfig *config);
+void crawler_free(Crawler *crawler);
+
+// Callbacks must be set before crawler_run()
+void crawler_set_page_callback(Crawler *crawler, CrawlerPageFunc func, gpointer user_data, GDestroyNotify destroy);
+void crawler_set_link_callback(Crawler *crawler, CrawlerLinkFunc func, gpointer user_data, GDestroyNotify destroy);
+const gchar* crawler_page_get_header(const CrawlerPage *page, const gchar *name, gsize *value_len);
+
+gboolean crawler_run(Crawler *crawler, const gchar *const *start_urls, GError **error);
+
+// Runtime controls, safe to call from any thread while crawler_run() runs
+void crawler_set_threads(Crawler *crawler, gint threads);
+void crawler_set_max_depth(Crawler *crawler, gint max_depth);
+void crawler_set_host_rate(Crawler *crawler, const gchar *host, gdouble rate); // NULL host = default rate
+void crawler_pause(Crawler *crawler);
+void crawler_resume(Crawler *crawler);
+guint crawler_drain(Crawler *crawler); // Returns the number of frontier URLs dropped
+gboolean crawler_append_stats(Crawler *crawler, GString *out); // FALSE if no crawl is running
+
+G_END_DECLS
+
+#endif /* GLIB_WEB_CRAWLER_H */
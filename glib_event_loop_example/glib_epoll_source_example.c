@@ -0,0 +1,427 @@
+/**
+ * @file glib_epoll_source_example.c
+ * @brief 以一個 edge-triggered epoll 事件來源監聽大量 fd 的範例程式
+ *
+ * glib_io_event_example.c 以 g_io_add_watch() 監聽標準輸入；每個 fd 一個 watch 時，
+ * GLib 每次迴圈都要為所有 watch 重建 poll 陣列、交給 poll()，再逐一檢查結果，
+ * 成本隨 fd 數量線性成長，即使其中只有少數幾個有資料。
+ *
+ * 此程式的 EpollSource 擁有自己的 epoll，只以 epoll fd 一個 fd 附加到事件迴圈：
+ * - 其他 fd 以 EPOLLET（edge-triggered）註冊到 epoll，註冊後核心記住它們，
+ *   每次迴圈不必再重新傳遞。
+ * - epoll fd 可讀時，一次 epoll_wait() 只取回就緒的 fd，並只 dispatch 這些 fd。
+ * - edge-triggered 時，回呼必須讀到 EAGAIN 為止，否則不會再收到通知。
+ *
+ * 執行時以 epoll 監聽標準輸入，輸入 "exit" 結束。以 --benchmark 執行時，
+ * 建立大量大多閒置的 socket，每一輪只讓其中幾個有資料，
+ * 與每個 fd 一個 g_io_add_watch() 比較每一輪的時間。
+ *
+ * 編譯方式：
+ * gcc -O2 -o glib_epoll_source_example glib_epoll_source_example.c `pkg-config --cflags --libs glib-2.0`
+ *
+ * 執行方式：
+ * ./glib_epoll_source_example
+ * ./glib_epoll_source_example --benchmark [socket 數量 ...]
+ *
+ * 預期輸出：
+ * Please input (input "exit" to exit the application):
+ * hello
+ * We got your input: hello
+ * exit
+ * Get the exit command and ready to close the application.
+ *
+ * @author: Nelson Chung
+ * @date: 2024.11.23
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#define EPOLL_BATCH 256  // 每次 epoll_wait() 最多取回的事件數
+
+// fd 就緒時的回呼；events 是 EPOLLIN、EPOLLOUT 等的組合，傳回 FALSE 時移除這個 watch
+typedef gboolean (*EpollWatchFunc)(int fd, guint32 events, gpointer user_data);
+
+typedef struct {
+    int fd;
+    guint32 events;
+    EpollWatchFunc func;
+    gpointer user_data;
+    GDestroyNotify notify;
+    gboolean removed;         // 已移除，等 dispatch 結束後釋放
+} EpollWatch;
+
+// epoll 事件來源的結構體
+typedef struct {
+    GSource source;           // 基礎 GSource 結構
+    int epoll_fd;
+    guint n_watches;
+    GPtrArray *garbage;       // dispatch 中移除的 watch，本批事件處理完才釋放
+    gboolean dispatching;
+} EpollSource;
+
+static void epoll_watch_free(EpollWatch *watch) {
+    if (watch->notify) watch->notify(watch->user_data);
+    g_free(watch);
+}
+
+/**
+ * @brief 移除一個 watch，可在任何回呼中呼叫
+ *
+ * 不會關閉 fd。
+ */
+void epoll_source_remove(GSource *source, EpollWatch *watch) {
+    EpollSource *epoll_source = (EpollSource *)source;
+    if (watch->removed) return;
+
+    epoll_ctl(epoll_source->epoll_fd, EPOLL_CTL_DEL, watch->fd, NULL);
+    watch->removed = TRUE;
+    epoll_source->n_watches--;
+    // 同一批事件中可能還有指向這個 watch 的項目，稍後再釋放
+    if (epoll_source->dispatching) {
+        g_ptr_array_add(epoll_source->garbage, watch);
+    } else {
+        epoll_watch_free(watch);
+    }
+}
+
+// epoll 事件來源的回呼函式：只處理就緒的 fd
+gboolean epoll_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+    EpollSource *epoll_source = (EpollSource *)source;
+    struct epoll_event events[EPOLL_BATCH];
+    int n;
+
+    epoll_source->dispatching = TRUE;
+    do {
+        n = epoll_wait(epoll_source->epoll_fd, events, EPOLL_BATCH, 0);
+        for (int i = 0; i < n; i++) {
+            EpollWatch *watch = events[i].data.ptr;
+            if (watch->removed) continue;
+            if (!watch->func(watch->fd, events[i].events, watch->user_data)) {
+                epoll_source_remove(source, watch);
+            }
+        }
+    } while (n == EPOLL_BATCH); // 一批取滿時可能還有，繼續取到沒有為止
+    epoll_source->dispatching = FALSE;
+
+    if (n < 0 && errno != EINTR) {
+        g_printerr("epoll_wait failed: %s\n", g_strerror(errno));
+    }
+    for (guint i = 0; i < epoll_source->garbage->len; i++) {
+        epoll_watch_free(g_ptr_array_index(epoll_source->garbage, i));
+    }
+    g_ptr_array_set_size(epoll_source->garbage, 0);
+    return TRUE; // epoll 事件來源一直保留
+}
+
+// epoll 事件來源的結束函式；仍註冊中的 watch 由擁有者移除，這裡只關閉 epoll fd
+void epoll_source_finalize(GSource *source) {
+    EpollSource *epoll_source = (EpollSource *)source;
+    g_ptr_array_free(epoll_source->garbage, TRUE);
+    if (epoll_source->epoll_fd >= 0) close(epoll_source->epoll_fd);
+}
+
+// 沒有 prepare 與 check：epoll fd 可讀時才 dispatch
+static GSourceFuncs epoll_source_funcs = {
+    .prepare = NULL,
+    .check = NULL,
+    .dispatch = epoll_source_dispatch,
+    .finalize = epoll_source_finalize,
+};
+
+/**
+ * @brief 建立 epoll 事件來源，需要再以 g_source_attach() 附加到事件迴圈
+ *
+ * @return 事件來源；無法建立 epoll 時傳回 NULL
+ */
+GSource* epoll_source_new(void) {
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        g_printerr("epoll_create1 failed: %s\n", g_strerror(errno));
+        return NULL;
+    }
+
+    EpollSource *epoll_source = (EpollSource *)g_source_new(&epoll_source_funcs, sizeof(EpollSource));
+    epoll_source->epoll_fd = epoll_fd;
+    epoll_source->garbage = g_ptr_array_new();
+    g_source_add_unix_fd(&epoll_source->source, epoll_fd, G_IO_IN);
+    g_source_set_name(&epoll_source->source, "EpollSource");
+    return &epoll_source->source;
+}
+
+/**
+ * @brief 以 edge-triggered 模式監聽 fd
+ *
+ * fd 應設為非阻塞，回呼必須讀寫到 EAGAIN 為止。
+ *
+ * @param events EPOLLIN、EPOLLOUT 等；EPOLLET 會自動加上
+ * @return watch；epoll_ctl 失敗時傳回 NULL（例如一般檔案不能加入 epoll）
+ */
+EpollWatch* epoll_source_add(GSource *source, int fd, guint32 events, EpollWatchFunc func,
+                             gpointer user_data, GDestroyNotify notify) {
+    EpollSource *epoll_source = (EpollSource *)source;
+    EpollWatch *watch = g_new0(EpollWatch, 1);
+    watch->fd = fd;
+    watch->events = events | EPOLLET;
+    watch->func = func;
+    watch->user_data = user_data;
+    watch->notify = notify;
+
+    struct epoll_event event = { .events = watch->events, .data.ptr = watch };
+    if (epoll_ctl(epoll_source->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        g_printerr("epoll_ctl(%d) failed: %s\n", fd, g_strerror(errno));
+        g_free(watch);
+        return NULL;
+    }
+    epoll_source->n_watches++;
+    return watch;
+}
+
+/**
+ * @brief 改變監聽的事件，例如有資料要寫時加上 EPOLLOUT
+ */
+gboolean epoll_source_modify(GSource *source, EpollWatch *watch, guint32 events) {
+    EpollSource *epoll_source = (EpollSource *)source;
+    struct epoll_event event = { .events = events | EPOLLET, .data.ptr = watch };
+    if (epoll_ctl(epoll_source->epoll_fd, EPOLL_CTL_MOD, watch->fd, &event) < 0) {
+        g_printerr("epoll_ctl(%d) failed: %s\n", watch->fd, g_strerror(errno));
+        return FALSE;
+    }
+    watch->events = event.events;
+    return TRUE;
+}
+
+static gboolean set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// 示範：以 epoll 監聽標準輸入
+static GMainLoop *main_loop = NULL;
+
+/**
+ * @brief 標準輸入可讀時被呼叫；edge-triggered，所以讀到 EAGAIN 為止
+ *
+ * 讀到的資料累積在 GString 中，每湊滿一行就處理一行。
+ */
+gboolean stdin_callback(int fd, guint32 events, gpointer data) {
+    GString *pending = data;
+    gchar buffer[4096];
+    gboolean finished = FALSE;
+
+    while (!finished) {
+        ssize_t got = read(fd, buffer, sizeof(buffer));
+        if (got > 0) {
+            g_string_append_len(pending, buffer, got);
+        } else if (got < 0 && errno == EINTR) {
+            continue;
+        } else if (got < 0 && errno == EAGAIN) {
+            break;
+        } else {
+            // 0 表示輸入結束，其他則是錯誤；已讀到的行仍要處理
+            if (got < 0) g_printerr("Something wrong when read the input: %s\n", g_strerror(errno));
+            finished = TRUE;
+        }
+    }
+
+    gchar *newline;
+    while ((newline = memchr(pending->str, '\n', pending->len)) != NULL) {
+        gsize length = newline - pending->str + 1;
+        g_print("We got your input: %.*s", (int)length, pending->str);
+        gboolean exit_command = length == 5 && memcmp(pending->str, "exit\n", 5) == 0;
+        g_string_erase(pending, 0, length);
+        if (exit_command) {
+            g_print("Get the exit command and ready to close the application.\n");
+            finished = TRUE;
+            break;
+        }
+    }
+    if (finished) {
+        g_main_loop_quit(main_loop);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void run_demo(void) {
+    main_loop = g_main_loop_new(NULL, FALSE);
+    GSource *source = epoll_source_new();
+    if (!source) return;
+    g_source_attach(source, NULL);
+
+    GString *pending = g_string_new(NULL);
+    set_nonblocking(STDIN_FILENO);
+    if (!epoll_source_add(source, STDIN_FILENO, EPOLLIN, stdin_callback, pending, NULL)) {
+        g_printerr("Standard input cannot be watched with epoll (is it a regular file?)\n");
+    } else {
+        g_print("Please input (input \"exit\" to exit the application): \n");
+        g_main_loop_run(main_loop);
+    }
+
+    g_string_free(pending, TRUE);
+    g_source_destroy(source);
+    g_source_unref(source);
+    g_main_loop_unref(main_loop);
+}
+
+// 量測：n 對 socket，每一輪只有 BENCH_ACTIVE 個有資料
+#define BENCH_ROUNDS 200
+#define BENCH_ACTIVE 16
+
+static guint bench_pending = 0;     // 有資料還沒被讀的 socket 數
+static gboolean *bench_marked = NULL; // 每對 socket 是否已寫入、等待回呼
+
+// 讀到 EAGAIN 為止，兩種方式共用；user_data 是 socket 對的索引
+static void drain_socket(int fd, gpointer user_data) {
+    gchar buffer[256];
+    while (read(fd, buffer, sizeof(buffer)) > 0) {
+    }
+    guint index = GPOINTER_TO_UINT(user_data);
+    if (bench_marked[index]) {
+        bench_marked[index] = FALSE;
+        bench_pending--;
+    }
+}
+
+gboolean bench_epoll_callback(int fd, guint32 events, gpointer user_data) {
+    drain_socket(fd, user_data);
+    return TRUE;
+}
+
+gboolean bench_channel_callback(GIOChannel *channel, GIOCondition condition, gpointer user_data) {
+    drain_socket(g_io_channel_unix_get_fd(channel), user_data);
+    return TRUE;
+}
+
+// 盡量提高 fd 上限，傳回可以建立的 socket 對數
+static guint raise_fd_limit(guint wanted) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) < 0) return wanted;
+    rlim_t needed = (rlim_t)wanted * 2 + 64;
+    if (limit.rlim_cur < needed) {
+        limit.rlim_cur = MIN(needed, limit.rlim_max);
+        setrlimit(RLIMIT_NOFILE, &limit);
+        getrlimit(RLIMIT_NOFILE, &limit);
+    }
+    return limit.rlim_cur >= needed ? wanted : (guint)((limit.rlim_cur - 64) / 2);
+}
+
+static void run_benchmark(guint count, gboolean use_epoll) {
+    GMainContext *context = g_main_context_new();
+    int *pairs = g_new(int, count * 2);  // pairs[2 * i] 由事件迴圈讀，pairs[2 * i + 1] 用來寫
+    GIOChannel **channels = use_epoll ? NULL : g_new(GIOChannel *, count);
+    EpollWatch **watches = use_epoll ? g_new(EpollWatch *, count) : NULL;
+    GSource *epoll_source = NULL;
+    guint created = 0;
+    bench_marked = g_new0(gboolean, count);
+
+    if (use_epoll) {
+        epoll_source = epoll_source_new();
+        if (!epoll_source) {
+            count = 0;
+        } else {
+            g_source_attach(epoll_source, context);
+        }
+    }
+
+    gint64 start = g_get_monotonic_time();
+    for (; created < count; created++) {
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, &pairs[2 * created]) < 0) {
+            g_printerr("socketpair failed after %u pairs: %s\n", created, g_strerror(errno));
+            break;
+        }
+        if (use_epoll) {
+            watches[created] = epoll_source_add(epoll_source, pairs[2 * created], EPOLLIN, bench_epoll_callback,
+                                                GUINT_TO_POINTER(created), NULL);
+        } else {
+            channels[created] = g_io_channel_unix_new(pairs[2 * created]);
+            GSource *watch = g_io_create_watch(channels[created], G_IO_IN);
+            g_source_set_callback(watch, (GSourceFunc)bench_channel_callback, GUINT_TO_POINTER(created), NULL);
+            g_source_attach(watch, context);
+            g_source_unref(watch);
+        }
+    }
+    gint64 registered = g_get_monotonic_time();
+
+    // 每一輪寫入 BENCH_ACTIVE 個 socket，執行迴圈直到全部讀完
+    guint iterations = 0;
+    guint32 seed = 1;
+    gint64 run_start = g_get_monotonic_time();
+    for (guint round = 0; round < BENCH_ROUNDS && created > 0; round++) {
+        for (guint i = 0; i < BENCH_ACTIVE; i++) {
+            seed = seed * 1103515245 + 12345;
+            guint index = seed % created;
+            // 同一輪重複選到的 socket 只會有一次回呼；沒有 watch 的 socket 不會有回呼
+            if (bench_marked[index] || (use_epoll && !watches[index])) continue;
+            if (write(pairs[2 * index + 1], "x", 1) == 1) {
+                bench_marked[index] = TRUE;
+                bench_pending++;
+            }
+        }
+        while (bench_pending > 0) {
+            g_main_context_iteration(context, TRUE);
+            iterations++;
+        }
+    }
+    gint64 run_end = g_get_monotonic_time();
+
+    g_print("%-12s %7u sockets: register %7.1f ns/fd, %9.1f us per round, %5.2f iterations per round\n",
+            use_epoll ? "epoll" : "g_io_watch", created,
+            created ? (gdouble)(registered - start) * 1000 / created : 0.0,
+            (gdouble)(run_end - run_start) / BENCH_ROUNDS, (gdouble)iterations / BENCH_ROUNDS);
+
+    for (guint i = 0; i < created; i++) {
+        if (use_epoll) {
+            if (watches[i]) epoll_source_remove(epoll_source, watches[i]);
+        } else {
+            g_io_channel_unref(channels[i]);
+        }
+    }
+    if (epoll_source) {
+        g_source_destroy(epoll_source);
+        g_source_unref(epoll_source);
+    }
+    // watch 來源隨 context 一起釋放之後才關閉 fd
+    g_main_context_unref(context);
+    for (guint i = 0; i < created; i++) {
+        close(pairs[2 * i]);
+        close(pairs[2 * i + 1]);
+    }
+    g_free(pairs);
+    g_free(channels);
+    g_free(watches);
+    g_free(bench_marked);
+    bench_marked = NULL;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && g_strcmp0(argv[1], "--benchmark") == 0) {
+        static const char *default_counts[] = { "10000", "100000" };
+        const char **counts = argc > 2 ? (const char **)&argv[2] : default_counts;
+        int n_counts = argc > 2 ? argc - 2 : (int)G_N_ELEMENTS(default_counts);
+        g_print("%u rounds, %u active sockets per round\n", BENCH_ROUNDS, BENCH_ACTIVE);
+        for (int i = 0; i < n_counts; i++) {
+            guint count = (guint)atoi(counts[i]);
+            if (count == 0) continue;
+            guint possible = raise_fd_limit(count);
+            if (possible < count) {
+                g_printerr("File descriptor limit allows only %u socket pairs\n", possible);
+                count = possible;
+            }
+            run_benchmark(count, TRUE);
+            run_benchmark(count, FALSE);
+        }
+        return 0;
+    }
+
+    run_demo();
+    return 0;
+}
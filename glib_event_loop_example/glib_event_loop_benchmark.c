@@ -0,0 +1,368 @@
+/**
+ * @file glib_event_loop_benchmark.c
+ * @brief 量測 GMainContext 在大量事件來源下的 dispatch 成本與延遲
+ *
+ * 在以 GLib 事件迴圈建構事件驅動的元件之前，先量出迴圈在哪裡開始無法擴展。
+ * 此程式對四種事件來源（idle、timeout、fd watch，以及
+ * glib_custom_event_source_example.c 的 CustomSource）在 N 個來源下量測：
+ *
+ * - dispatch：N 個來源每次迴圈都就緒，每次 dispatch 的平均成本。
+ * - iteration：N 個不會觸發的來源加上 1 個 idle 來源，每次迴圈的成本；
+ *   這是其他來源閒置時，每次喚醒都要付出的 prepare/check 走訪成本。
+ *   （idle 來源永遠就緒，此項以 "-" 表示。）
+ * - churn：已有 N 個來源時，建立、附加、移除、釋放一個來源的成本。
+ * - wakeup：另一個執行緒以 g_main_context_invoke() 交付工作，到回呼執行的延遲。
+ *
+ * 每個 N 輸出一列，連續幾列就是隨來源數量變化的曲線。
+ *
+ * 編譯方式：
+ * gcc -O2 -o glib_event_loop_benchmark glib_event_loop_benchmark.c `pkg-config --cflags --libs glib-2.0`
+ *
+ * 執行方式：
+ * ./glib_event_loop_benchmark [N ...]
+ *
+ * 預期輸出：
+ * kind           N   dispatch ns  iteration ns     churn ns   wakeup p50 us  wakeup p99 us
+ * idle           1          95.1             -        612.3            12.4           31.0
+ * idle          10          52.7             -        640.8            12.9           33.2
+ * ...
+ * custom     10000          61.9      412003.4       8410.6           812.5          934.1
+ *
+ * @author: Nelson Chung
+ * @date: 2024.11.23
+ */
+
+#include <glib.h>
+#include <glib-unix.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#define MEASURE_USEC (200 * 1000)  // 每項量測至少執行的時間
+#define CHURN_OPS 20000
+#define WAKEUP_ROUNDS 2000
+#define DORMANT_MS (3600 * 1000)   // 不會觸發的來源的間隔
+
+typedef enum {
+    KIND_IDLE,
+    KIND_TIMEOUT,
+    KIND_FD,
+    KIND_CUSTOM,
+    N_KINDS
+} SourceKind;
+
+static const gchar *kind_names[] = { "idle", "timeout", "fd", "custom" };
+
+/*
+ * glib_custom_event_source_example.c 的 CustomSource，間隔改以 gint64 保存，
+ * 不會觸發的來源設定一小時的間隔時才不會溢位。
+ */
+typedef struct {
+    GSource source;             // 基礎 GSource 結構
+    gint64 next_execution_time; // 下一次觸發的時間（以微秒為單位）
+    gint64 interval;            // 事件間隔（以毫秒為單位）
+} CustomSource;
+
+gboolean custom_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+    CustomSource *custom_source = (CustomSource *)source;
+    custom_source->next_execution_time = g_get_monotonic_time() + (custom_source->interval * 1000);
+    return callback ? callback(user_data) : TRUE;
+}
+
+gboolean custom_source_prepare(GSource *source, gint *timeout) {
+    CustomSource *custom_source = (CustomSource *)source;
+    gint64 current_time = g_get_monotonic_time();
+
+    if (current_time >= custom_source->next_execution_time) {
+        *timeout = 0;
+        return TRUE;
+    }
+    *timeout = MIN((custom_source->next_execution_time - current_time) / 1000, G_MAXINT);
+    return FALSE;
+}
+
+gboolean custom_source_check(GSource *source) {
+    CustomSource *custom_source = (CustomSource *)source;
+    return g_get_monotonic_time() >= custom_source->next_execution_time;
+}
+
+static GSourceFuncs custom_source_funcs = {
+    .prepare = custom_source_prepare,
+    .check = custom_source_check,
+    .dispatch = custom_source_dispatch,
+    .finalize = NULL,
+};
+
+// 每種來源共用的回呼都只累加計數
+static guint64 dispatch_count = 0;
+
+gboolean count_callback(gpointer data) {
+    dispatch_count++;
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean count_fd_callback(gint fd, GIOCondition condition, gpointer data) {
+    dispatch_count++;
+    return G_SOURCE_CONTINUE;
+}
+
+// 兩個 eventfd：一個一直可讀（從不讀取），一個從不可讀
+static int ready_fd = -1;
+static int dormant_fd = -1;
+
+/**
+ * @brief 建立一個來源；ready 為 TRUE 時每次迴圈都就緒，否則一直不會觸發
+ */
+static GSource* make_source(SourceKind kind, gboolean ready) {
+    GSource *source = NULL;
+    switch (kind) {
+    case KIND_IDLE:
+        source = g_idle_source_new(); // 永遠就緒
+        g_source_set_callback(source, count_callback, NULL, NULL);
+        break;
+    case KIND_TIMEOUT:
+        source = g_timeout_source_new(ready ? 0 : DORMANT_MS);
+        g_source_set_callback(source, count_callback, NULL, NULL);
+        break;
+    case KIND_FD:
+        source = g_unix_fd_source_new(ready ? ready_fd : dormant_fd, G_IO_IN);
+        g_source_set_callback(source, (GSourceFunc)count_fd_callback, NULL, NULL);
+        break;
+    case KIND_CUSTOM: {
+        CustomSource *custom_source = (CustomSource *)g_source_new(&custom_source_funcs, sizeof(CustomSource));
+        custom_source->interval = ready ? 0 : DORMANT_MS;
+        custom_source->next_execution_time = g_get_monotonic_time() + custom_source->interval * 1000;
+        source = &custom_source->source;
+        g_source_set_callback(source, count_callback, NULL, NULL);
+        break;
+    }
+    default:
+        g_assert_not_reached();
+    }
+    return source;
+}
+
+static GPtrArray* attach_sources(GMainContext *context, SourceKind kind, guint n, gboolean ready) {
+    GPtrArray *sources = g_ptr_array_new_full(n, NULL);
+    for (guint i = 0; i < n; i++) {
+        GSource *source = make_source(kind, ready);
+        g_source_attach(source, context);
+        g_ptr_array_add(sources, source);
+    }
+    return sources;
+}
+
+static void destroy_sources(GPtrArray *sources) {
+    for (guint i = 0; i < sources->len; i++) {
+        GSource *source = g_ptr_array_index(sources, i);
+        g_source_destroy(source);
+        g_source_unref(source);
+    }
+    g_ptr_array_free(sources, TRUE);
+}
+
+// 執行迴圈至少 MEASURE_USEC，傳回花費的時間（微秒）與迴圈次數
+static gint64 run_for_a_while(GMainContext *context, guint64 *iterations) {
+    for (guint i = 0; i < 3; i++) g_main_context_iteration(context, FALSE); // 暖身
+
+    dispatch_count = 0;
+    *iterations = 0;
+    gint64 start = g_get_monotonic_time();
+    gint64 now = start;
+    while (now - start < MEASURE_USEC) {
+        g_main_context_iteration(context, FALSE);
+        (*iterations)++;
+        now = g_get_monotonic_time();
+    }
+    return now - start;
+}
+
+/**
+ * @brief N 個來源每次迴圈都就緒，傳回每次 dispatch 的成本（奈秒）
+ */
+static gdouble bench_dispatch(SourceKind kind, guint n) {
+    GMainContext *context = g_main_context_new();
+    GPtrArray *sources = attach_sources(context, kind, n, TRUE);
+    guint64 iterations;
+
+    gint64 elapsed = run_for_a_while(context, &iterations);
+    gdouble result = dispatch_count ? elapsed * 1000.0 / dispatch_count : -1;
+
+    destroy_sources(sources);
+    g_main_context_unref(context);
+    return result;
+}
+
+/**
+ * @brief N 個不會觸發的來源加上 1 個 idle 來源，傳回每次迴圈的成本（奈秒）
+ */
+static gdouble bench_iteration(SourceKind kind, guint n) {
+    if (kind == KIND_IDLE) return -1; // idle 來源不會閒置
+
+    GMainContext *context = g_main_context_new();
+    GPtrArray *sources = attach_sources(context, kind, n, FALSE);
+    GSource *idle = make_source(KIND_IDLE, TRUE);
+    g_source_attach(idle, context);
+    guint64 iterations;
+
+    gint64 elapsed = run_for_a_while(context, &iterations);
+
+    g_source_destroy(idle);
+    g_source_unref(idle);
+    destroy_sources(sources);
+    g_main_context_unref(context);
+    return elapsed * 1000.0 / iterations;
+}
+
+/**
+ * @brief 已有 N 個來源時，建立、附加、移除、釋放一個來源的成本（奈秒）
+ */
+static gdouble bench_churn(SourceKind kind, guint n) {
+    GMainContext *context = g_main_context_new();
+    // idle 來源不能作為閒置的背景來源，背景改用 timeout
+    GPtrArray *sources = attach_sources(context, kind == KIND_IDLE ? KIND_TIMEOUT : kind, n, FALSE);
+
+    gint64 start = g_get_monotonic_time();
+    for (guint i = 0; i < CHURN_OPS; i++) {
+        GSource *source = make_source(kind, FALSE);
+        g_source_attach(source, context);
+        g_source_destroy(source);
+        g_source_unref(source);
+    }
+    gint64 elapsed = g_get_monotonic_time() - start;
+
+    destroy_sources(sources);
+    g_main_context_unref(context);
+    return elapsed * 1000.0 / CHURN_OPS;
+}
+
+// 跨執行緒喚醒：poster 執行緒交付工作，主執行緒在 poll 中被喚醒後執行
+typedef struct {
+    GMainContext *context;
+    GMutex mutex;
+    GCond cond;
+    gint64 posted;
+    gboolean handled;
+    gdouble *latencies;
+    guint rounds;
+} WakeupState;
+
+gboolean wakeup_callback(gpointer data) {
+    WakeupState *state = data;
+    gint64 now = g_get_monotonic_time();
+    g_mutex_lock(&state->mutex);
+    state->latencies[state->rounds++] = (gdouble)(now - state->posted);
+    state->handled = TRUE;
+    g_cond_signal(&state->cond);
+    g_mutex_unlock(&state->mutex);
+    return G_SOURCE_REMOVE;
+}
+
+gpointer wakeup_poster(gpointer data) {
+    WakeupState *state = data;
+    for (guint i = 0; i < WAKEUP_ROUNDS; i++) {
+        // 稍等一下，讓主執行緒回到 poll 中睡眠
+        g_usleep(200);
+        g_mutex_lock(&state->mutex);
+        state->handled = FALSE;
+        state->posted = g_get_monotonic_time();
+        g_mutex_unlock(&state->mutex);
+
+        g_main_context_invoke(state->context, wakeup_callback, state);
+
+        g_mutex_lock(&state->mutex);
+        while (!state->handled) g_cond_wait(&state->cond, &state->mutex);
+        g_mutex_unlock(&state->mutex);
+    }
+    return NULL;
+}
+
+static gint compare_double(gconstpointer a, gconstpointer b) {
+    gdouble x = *(const gdouble *)a, y = *(const gdouble *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief 已有 N 個閒置來源時的跨執行緒喚醒延遲（微秒）
+ */
+static void bench_wakeup(SourceKind kind, guint n, gdouble *p50, gdouble *p99) {
+    WakeupState state = { 0 };
+    state.context = g_main_context_new();
+    state.latencies = g_new(gdouble, WAKEUP_ROUNDS);
+    g_mutex_init(&state.mutex);
+    g_cond_init(&state.cond);
+    GPtrArray *sources = attach_sources(state.context, kind == KIND_IDLE ? KIND_TIMEOUT : kind, n, FALSE);
+
+    // 主執行緒必須擁有 context，g_main_context_invoke() 才會排入來源並喚醒它
+    g_main_context_acquire(state.context);
+    GThread *poster = g_thread_new("poster", wakeup_poster, &state);
+    for (;;) {
+        g_mutex_lock(&state.mutex);
+        gboolean done = state.rounds == WAKEUP_ROUNDS;
+        g_mutex_unlock(&state.mutex);
+        if (done) break;
+        g_main_context_iteration(state.context, TRUE);
+    }
+    g_thread_join(poster);
+    g_main_context_release(state.context);
+
+    qsort(state.latencies, WAKEUP_ROUNDS, sizeof(gdouble), compare_double);
+    *p50 = state.latencies[WAKEUP_ROUNDS / 2];
+    *p99 = state.latencies[WAKEUP_ROUNDS * 99 / 100];
+
+    destroy_sources(sources);
+    g_free(state.latencies);
+    g_mutex_clear(&state.mutex);
+    g_cond_clear(&state.cond);
+    g_main_context_unref(state.context);
+}
+
+static void print_value(gdouble value, gint width) {
+    if (value < 0) {
+        g_print(" %*s", width, "-");
+    } else {
+        g_print(" %*.1f", width, value);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    static const guint default_sizes[] = { 1, 10, 100, 1000, 10000 };
+    guint n_sizes = argc > 1 ? (guint)(argc - 1) : G_N_ELEMENTS(default_sizes);
+    guint *sizes = g_new(guint, n_sizes);
+    for (guint i = 0; i < n_sizes; i++) {
+        sizes[i] = argc > 1 ? (guint)atoi(argv[i + 1]) : default_sizes[i];
+    }
+
+    ready_fd = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+    dormant_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ready_fd < 0 || dormant_fd < 0) {
+        g_printerr("eventfd failed: %s\n", g_strerror(errno));
+        return 1;
+    }
+
+    g_print("%-8s %7s %13s %13s %12s %15s %14s\n",
+            "kind", "N", "dispatch ns", "iteration ns", "churn ns", "wakeup p50 us", "wakeup p99 us");
+    for (SourceKind kind = KIND_IDLE; kind < N_KINDS; kind++) {
+        for (guint i = 0; i < n_sizes; i++) {
+            guint n = MAX(sizes[i], 1);
+            gdouble p50, p99;
+            bench_wakeup(kind, n, &p50, &p99);
+
+            g_print("%-8s %7u", kind_names[kind], n);
+            print_value(bench_dispatch(kind, n), 13);
+            print_value(bench_iteration(kind, n), 13);
+            print_value(bench_churn(kind, n), 12);
+            print_value(p50, 15);
+            print_value(p99, 14);
+            g_print("\n");
+        }
+    }
+
+    close(ready_fd);
+    close(dormant_fd);
+    g_free(sizes);
+    return 0;
+}
@@ -0,0 +1,633 @@
+/**
+ * @file glib_file_tail_source_example.c
+ * @brief 以 inotify 與大區塊 pread() 追蹤成長中檔案的自訂事件來源範例程式
+ *
+ * 日誌收集程式若像 glib_io_event_example.c 一樣從標準輸入讀取，就得另外接上 tail -F；
+ * 自己定時輪詢檔案大小則不是延遲太高就是浪費 CPU，再以 GIOChannel 逐行讀取也跟不上繁忙的日誌。
+ *
+ * 此程式的 FileTailSource 是一個自訂的 GSource，可以同時追蹤多個檔案：
+ * - 以一個 inotify fd 監聽每個檔案的 IN_MODIFY，以及所在目錄的 IN_CREATE、IN_MOVED_TO，
+ *   只有檔案真的變動時才喚醒事件迴圈。
+ * - 以 pread() 一次讀入一大塊（預設 1 MB），以 memchr() 切出完整的紀錄（以換行分隔），
+ *   每湊滿 TAIL_BATCH 筆或讀完這次的資料時，把紀錄檢視整批交給回呼，不複製資料。
+ *   最後不完整的一筆留到下次寫入補齊後再交出。
+ * - 輪替（rename 後建立同名新檔）：目錄事件中出現同名檔案且 inode 不同時，
+ *   先把舊檔讀完（包括最後沒有換行的一筆），再從新檔開頭讀取。
+ * - 截斷（copytruncate 或 > file）：檔案大小比已讀的位置小時，捨棄不完整的紀錄，從頭讀取。
+ * - 一次喚醒每個檔案最多讀 TAIL_MAX_READS 次，還有資料時以 g_source_set_ready_time(0)
+ *   在下一輪繼續，避免一個大檔案占住事件迴圈。
+ * - 檔案還不存在時等它被建立後再開始追蹤。
+ *
+ * 紀錄檢視只在回呼期間有效，需要保留時請自行複製。
+ *
+ * 執行時在暫存目錄中寫入兩個日誌檔，途中輪替 app.log、截斷 access.log。
+ * 以 --benchmark 執行時，由一個執行緒持續寫入檔案，與定時輪詢並以 GIOChannel 逐行讀取的方式比較。
+ *
+ * 編譯方式：
+ * gcc -O2 -o glib_file_tail_source_example glib_file_tail_source_example.c `pkg-config --cflags --libs glib-2.0`
+ *
+ * 執行方式：
+ * ./glib_file_tail_source_example
+ * ./glib_file_tail_source_example --benchmark [MB]
+ *
+ * 預期輸出：
+ * Tailing /tmp/tail-XXXXXX/app.log
+ * Tailing /tmp/tail-XXXXXX/access.log
+ * app.log: 3 records, first "app step 1 record 1"
+ * access.log: 3 records, first "access step 1 record 1"
+ * ...
+ * app.log: 1 records, first "app step 4 record 1"
+ * app.log: 1 records, first "app step 4 record 2 without newline"
+ * app.log: rotated
+ * app.log: 3 records, first "app after rotation record 1"
+ * access.log: truncated
+ * access.log: 1 records, first "access after truncation"
+ * app.log: 1 records, first "app partial record completed"
+ *
+ * @author: Nelson Chung
+ * @date: 2024.11.23
+ */
+
+#define _GNU_SOURCE
+#include <glib.h>
+#include <glib-unix.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#define TAIL_CHUNK (1024 * 1024)  // 預設緩衝區大小，也是每次 pread() 的上限
+#define TAIL_BATCH 1024           // 每批最多交給回呼的紀錄數
+#define TAIL_MAX_READS 8          // 每次喚醒每個檔案最多讀幾次
+
+// 一筆紀錄的檢視，指向檔案的緩衝區，不含換行字元
+typedef struct {
+    const gchar *data;
+    gsize length;
+} TailRecord;
+
+typedef enum {
+    TAIL_OPENED,     // 開始追蹤檔案（包括檔案在加入後才被建立）
+    TAIL_ROTATED,    // 舊檔已讀完，改為追蹤同名的新檔
+    TAIL_TRUNCATED,  // 檔案被截斷，從頭讀取
+} TailEvent;
+
+// 一批紀錄的回呼；name 是加入時的路徑
+typedef void (*TailRecordsFunc)(const gchar *name, const TailRecord *records, guint n_records, gpointer user_data);
+// 檔案狀態改變的回呼
+typedef void (*TailEventFunc)(const gchar *name, TailEvent event, gpointer user_data);
+
+// 一個被追蹤的檔案
+typedef struct {
+    gchar *path;
+    gchar *basename;
+    int fd;
+    dev_t dev;
+    ino_t ino;
+    int file_wd;             // 檔案本身的 inotify watch
+    int dir_wd;              // 所在目錄的 inotify watch，可能與其他檔案共用
+    off_t offset;            // 下一次 pread() 的位置
+    gchar *buffer;
+    gsize capacity;
+    gsize start;             // 尚未交出的第一個位元組
+    gsize scanned;           // start 到 scanned 之間已確認沒有換行字元
+    gsize end;               // 已讀入資料的結尾
+    TailRecord batch[TAIL_BATCH];
+    guint batch_len;
+    gboolean changed;        // 檔案有新資料或需要再讀
+    gboolean check_path;     // 目錄中出現同名檔案，需要檢查是否輪替
+} TailFile;
+
+typedef struct {
+    GSource source;
+    int inotify_fd;
+    GPtrArray *files;
+    TailRecordsFunc records_func;
+    TailEventFunc event_func;
+    gpointer user_data;
+    guint64 bytes;
+    guint64 records;
+    guint64 wakeups;
+} FileTailSource;
+
+static void tail_file_free(TailFile *file) {
+    if (file->fd >= 0) close(file->fd);
+    g_free(file->path);
+    g_free(file->basename);
+    g_free(file->buffer);
+    g_free(file);
+}
+
+static void file_tail_notify(FileTailSource *tail, TailFile *file, TailEvent event) {
+    if (tail->event_func) tail->event_func(file->path, event, tail->user_data);
+}
+
+// 交出目前收集的紀錄
+static void tail_file_flush(FileTailSource *tail, TailFile *file) {
+    if (file->batch_len == 0) return;
+    guint n_records = file->batch_len;
+    file->batch_len = 0;
+    tail->records += n_records;
+    tail->records_func(file->path, file->batch, n_records, tail->user_data);
+}
+
+// 在新讀入的資料中尋找完整的紀錄
+static void tail_file_scan(FileTailSource *tail, TailFile *file) {
+    for (;;) {
+        gchar *newline = memchr(file->buffer + file->scanned, '\n', file->end - file->scanned);
+        if (!newline) {
+            file->scanned = file->end;
+            return;
+        }
+        gsize record_end = newline - file->buffer;
+        file->batch[file->batch_len].data = file->buffer + file->start;
+        file->batch[file->batch_len].length = record_end - file->start;
+        file->batch_len++;
+        file->start = file->scanned = record_end + 1;
+        if (file->batch_len == TAIL_BATCH) tail_file_flush(tail, file);
+    }
+}
+
+/**
+ * @brief 在緩衝區尾端騰出空間
+ *
+ * 收集中的紀錄指向緩衝區，搬動資料前必須先交出。
+ */
+static void tail_file_make_room(FileTailSource *tail, TailFile *file) {
+    tail_file_flush(tail, file);
+
+    if (file->start > 0) {
+        // 只搬不完整的最後一筆
+        gsize pending = file->end - file->start;
+        memmove(file->buffer, file->buffer + file->start, pending);
+        file->scanned -= file->start;
+        file->end = pending;
+        file->start = 0;
+    } else {
+        // 一筆紀錄就填滿整個緩衝區
+        file->capacity *= 2;
+        file->buffer = g_realloc(file->buffer, file->capacity);
+    }
+}
+
+/**
+ * @brief 讀取檔案的新資料
+ *
+ * @param limit 最多 pread() 的次數，0 表示讀到檔尾
+ * @return 達到次數上限、檔案可能還有資料時傳回 TRUE
+ */
+static gboolean tail_file_read(FileTailSource *tail, TailFile *file, guint limit) {
+    struct stat st;
+    if (fstat(file->fd, &st) == 0 && st.st_size < file->offset) {
+        // 截斷：不完整的紀錄已經不存在，從頭讀取
+        file->offset = 0;
+        file->start = file->scanned = file->end = 0;
+        file_tail_notify(tail, file, TAIL_TRUNCATED);
+    }
+
+    for (guint reads = 0; limit == 0 || reads < limit; reads++) {
+        if (file->end == file->capacity) tail_file_make_room(tail, file);
+
+        ssize_t got = pread(file->fd, file->buffer + file->end, file->capacity - file->end, file->offset);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) {
+            g_printerr("pread(%s) failed: %s\n", file->path, g_strerror(errno));
+            break;
+        }
+        if (got == 0) break;
+        file->offset += got;
+        file->end += got;
+        tail->bytes += got;
+        tail_file_scan(tail, file);
+        // 讀不滿表示已到檔尾，不必再多呼叫一次 pread()
+        if (file->end < file->capacity) break;
+        if (limit != 0 && reads + 1 == limit) {
+            tail_file_flush(tail, file);
+            return TRUE;
+        }
+    }
+    tail_file_flush(tail, file);
+    return FALSE;
+}
+
+/**
+ * @brief 開始讀取 path 目前指向的檔案
+ *
+ * 已經在追蹤舊檔時，先把舊檔讀完並交出最後沒有換行的一筆。
+ */
+static gboolean tail_file_open(FileTailSource *tail, TailFile *file, gboolean from_start) {
+    int fd = open(file->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return FALSE; // 檔案還不存在，等目錄事件
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (file->fd >= 0 && st.st_dev == file->dev && st.st_ino == file->ino)) {
+        close(fd);
+        return FALSE;
+    }
+
+    gboolean rotated = file->fd >= 0;
+    if (rotated) {
+        tail_file_read(tail, file, 0);
+        if (file->start < file->end) {
+            file->batch[0].data = file->buffer + file->start;
+            file->batch[0].length = file->end - file->start;
+            file->batch_len = 1;
+            tail_file_flush(tail, file);
+        }
+        inotify_rm_watch(tail->inotify_fd, file->file_wd);
+        close(file->fd);
+    }
+
+    file->fd = fd;
+    file->dev = st.st_dev;
+    file->ino = st.st_ino;
+    file->offset = from_start ? 0 : st.st_size;
+    file->start = file->scanned = file->end = 0;
+    file->file_wd = inotify_add_watch(tail->inotify_fd, file->path, IN_MODIFY);
+    file->changed = TRUE;
+    file_tail_notify(tail, file, rotated ? TAIL_ROTATED : TAIL_OPENED);
+    return TRUE;
+}
+
+// 讀出所有 inotify 事件，標記需要處理的檔案
+static void file_tail_read_events(FileTailSource *tail) {
+    gchar buffer[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;) {
+        ssize_t got = read(tail->inotify_fd, buffer, sizeof(buffer));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return;
+
+        for (gchar *p = buffer; p < buffer + got; ) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            for (guint i = 0; i < tail->files->len; i++) {
+                TailFile *file = g_ptr_array_index(tail->files, i);
+                if (event->mask & IN_Q_OVERFLOW) {
+                    // 事件遺失：每個檔案都重新檢查
+                    file->changed = file->check_path = TRUE;
+                } else if (event->wd == file->file_wd && file->fd >= 0) {
+                    file->changed = TRUE;
+                } else if (event->wd == file->dir_wd && event->len > 0 &&
+                           strcmp(event->name, file->basename) == 0) {
+                    file->check_path = TRUE;
+                }
+            }
+        }
+    }
+}
+
+gboolean file_tail_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+    FileTailSource *tail = (FileTailSource *)source;
+    gboolean more = FALSE;
+    tail->wakeups++;
+
+    file_tail_read_events(tail);
+
+    for (guint i = 0; i < tail->files->len; i++) {
+        TailFile *file = g_ptr_array_index(tail->files, i);
+        if (file->check_path) {
+            file->check_path = FALSE;
+            tail_file_open(tail, file, TRUE);
+        }
+        if (file->changed && file->fd >= 0) {
+            file->changed = tail_file_read(tail, file, TAIL_MAX_READS);
+            more |= file->changed;
+        }
+    }
+
+    // 還有沒讀完的檔案時，下一輪不必等 inotify 事件
+    g_source_set_ready_time(source, more ? 0 : -1);
+    return G_SOURCE_CONTINUE;
+}
+
+void file_tail_source_finalize(GSource *source) {
+    FileTailSource *tail = (FileTailSource *)source;
+    g_ptr_array_free(tail->files, TRUE);
+    if (tail->inotify_fd >= 0) close(tail->inotify_fd);
+}
+
+static GSourceFuncs file_tail_source_funcs = {
+    .prepare = NULL,
+    .check = NULL,
+    .dispatch = file_tail_source_dispatch,
+    .finalize = file_tail_source_finalize,
+};
+
+/**
+ * @brief 建立檔案追蹤事件來源，需要再以 g_source_attach() 附加到事件迴圈
+ *
+ * @param records_func 每批紀錄的回呼
+ * @param event_func 開啟、輪替、截斷時的回呼，可為 NULL
+ * @return 事件來源；無法建立 inotify 時傳回 NULL
+ */
+GSource* file_tail_source_new(TailRecordsFunc records_func, TailEventFunc event_func, gpointer user_data) {
+    int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        g_printerr("inotify_init1 failed: %s\n", g_strerror(errno));
+        return NULL;
+    }
+
+    FileTailSource *tail = (FileTailSource *)g_source_new(&file_tail_source_funcs, sizeof(FileTailSource));
+    tail->inotify_fd = inotify_fd;
+    tail->files = g_ptr_array_new_with_free_func((GDestroyNotify)tail_file_free);
+    tail->records_func = records_func;
+    tail->event_func = event_func;
+    tail->user_data = user_data;
+    g_source_add_unix_fd(&tail->source, inotify_fd, G_IO_IN);
+    g_source_set_name(&tail->source, "FileTailSource");
+    return &tail->source;
+}
+
+/**
+ * @brief 開始追蹤 path
+ *
+ * 檔案不存在時，等它被建立後從開頭讀取。
+ *
+ * @param from_start TRUE 表示從現有內容的開頭讀取，FALSE 表示只讀之後寫入的資料
+ * @return 無法監聽所在目錄時傳回 FALSE
+ */
+gboolean file_tail_source_add(GSource *source, const gchar *path, gboolean from_start) {
+    FileTailSource *tail = (FileTailSource *)source;
+    gchar *dirname = g_path_get_dirname(path);
+    int dir_wd = inotify_add_watch(tail->inotify_fd, dirname, IN_CREATE | IN_MOVED_TO);
+    if (dir_wd < 0) {
+        g_printerr("inotify_add_watch(%s) failed: %s\n", dirname, g_strerror(errno));
+        g_free(dirname);
+        return FALSE;
+    }
+    g_free(dirname);
+
+    TailFile *file = g_new0(TailFile, 1);
+    file->path = g_strdup(path);
+    file->basename = g_path_get_basename(path);
+    file->fd = -1;
+    file->file_wd = -1;
+    file->dir_wd = dir_wd;
+    file->capacity = TAIL_CHUNK;
+    file->buffer = g_malloc(file->capacity);
+    g_ptr_array_add(tail->files, file);
+
+    // 現有內容在下一輪事件迴圈讀取
+    tail_file_open(tail, file, from_start);
+    g_source_set_ready_time(source, 0);
+    return TRUE;
+}
+
+// 示範：在暫存目錄中寫入日誌，途中輪替與截斷
+typedef struct {
+    GMainLoop *loop;
+    gchar *dir;
+    gchar *app_path;
+    gchar *access_path;
+    guint step;
+} DemoState;
+
+static void append_text(const gchar *path, const gchar *text) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        g_printerr("open(%s) failed: %s\n", path, g_strerror(errno));
+        return;
+    }
+    if (write(fd, text, strlen(text)) < 0) g_printerr("write failed: %s\n", g_strerror(errno));
+    close(fd);
+}
+
+void demo_records(const gchar *name, const TailRecord *records, guint n_records, gpointer user_data) {
+    gchar *basename = g_path_get_basename(name);
+    g_print("%s: %u records, first \"%.*s\"\n", basename, n_records, (int)records[0].length, records[0].data);
+    g_free(basename);
+}
+
+void demo_event(const gchar *name, TailEvent event, gpointer user_data) {
+    if (event == TAIL_OPENED) return;
+    gchar *basename = g_path_get_basename(name);
+    g_print("%s: %s\n", basename, event == TAIL_ROTATED ? "rotated" : "truncated");
+    g_free(basename);
+}
+
+// 每 200 ms 寫一次日誌
+gboolean demo_writer(gpointer user_data) {
+    DemoState *state = user_data;
+    state->step++;
+
+    if (state->step <= 3) {
+        gchar *app = g_strdup_printf("app step %u record 1\napp step %u record 2\napp step %u record 3\n",
+                                     state->step, state->step, state->step);
+        gchar *access = g_strdup_printf("access step %u record 1\naccess step %u record 2\naccess step %u record 3\n",
+                                        state->step, state->step, state->step);
+        append_text(state->app_path, app);
+        append_text(state->access_path, access);
+        g_free(app);
+        g_free(access);
+    } else if (state->step == 4) {
+        // 輪替：舊檔最後一筆沒有換行，也會在切換前交出
+        append_text(state->app_path, "app step 4 record 1\napp step 4 record 2 without newline");
+        gchar *rotated = g_strconcat(state->app_path, ".1", NULL);
+        rename(state->app_path, rotated);
+        g_free(rotated);
+        append_text(state->app_path, "app after rotation record 1\napp after rotation record 2\napp after rotation record 3\n");
+    } else if (state->step == 5) {
+        // 截斷後寫入較短的內容
+        if (truncate(state->access_path, 0) < 0) g_printerr("truncate failed: %s\n", g_strerror(errno));
+        append_text(state->access_path, "access after truncation\n");
+    } else if (state->step == 6) {
+        // 不完整的紀錄等到補齊換行才交出
+        append_text(state->app_path, "app partial ");
+    } else if (state->step == 7) {
+        append_text(state->app_path, "record completed\n");
+    } else {
+        g_main_loop_quit(state->loop);
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void run_demo(void) {
+    DemoState state = { g_main_loop_new(NULL, FALSE) };
+    gchar template[] = "/tmp/tail-XXXXXX";
+    if (!mkdtemp(template)) {
+        g_printerr("mkdtemp failed: %s\n", g_strerror(errno));
+        return;
+    }
+    state.dir = template;
+    state.app_path = g_build_filename(state.dir, "app.log", NULL);
+    state.access_path = g_build_filename(state.dir, "access.log", NULL);
+    append_text(state.access_path, "");  // access.log 已存在，app.log 稍後才建立
+
+    GSource *source = file_tail_source_new(demo_records, demo_event, &state);
+    if (!source) return;
+    file_tail_source_add(source, state.app_path, TRUE);
+    file_tail_source_add(source, state.access_path, TRUE);
+    g_source_attach(source, NULL);
+    g_print("Tailing %s\nTailing %s\n", state.app_path, state.access_path);
+
+    g_timeout_add(200, demo_writer, &state);
+    g_main_loop_run(state.loop);
+
+    g_source_destroy(source);
+    g_source_unref(source);
+
+    gchar *rotated = g_strconcat(state.app_path, ".1", NULL);
+    unlink(rotated);
+    unlink(state.app_path);
+    unlink(state.access_path);
+    rmdir(state.dir);
+    g_free(rotated);
+    g_free(state.app_path);
+    g_free(state.access_path);
+    g_main_loop_unref(state.loop);
+}
+
+// 量測：一個執行緒持續附加紀錄到檔案，事件迴圈追蹤到最後一筆為止
+typedef struct {
+    GMainLoop *loop;
+    GMainContext *context;
+    gchar *path;
+    guint megabytes;
+    guint64 records;
+    guint64 total_records;   // 寫入結束後才知道總筆數，只在事件迴圈的執行緒中存取
+    gint64 write_done;
+    GIOChannel *channel;
+} BenchState;
+
+static void bench_check_done(BenchState *state) {
+    if (state->total_records && state->records >= state->total_records) g_main_loop_quit(state->loop);
+}
+
+// 寫入執行緒的結果，經由 g_main_context_invoke_full() 交給事件迴圈的執行緒
+typedef struct {
+    BenchState *state;
+    guint64 total_records;
+    gint64 write_done;
+} WriterResult;
+
+// 在事件迴圈的執行緒中被呼叫
+gboolean writer_done(gpointer user_data) {
+    WriterResult *result = user_data;
+    result->state->total_records = result->total_records;
+    result->state->write_done = result->write_done;
+    bench_check_done(result->state);
+    return G_SOURCE_REMOVE;
+}
+
+static gpointer writer_thread(gpointer data) {
+    BenchState *state = data;
+    int fd = open(state->path, O_WRONLY | O_APPEND | O_CLOEXEC);
+    GString *block = g_string_new(NULL);
+    guint block_records = 0;
+    guint64 record = 0;
+    guint64 written = 0;
+
+    // 每次寫入同一塊 64 KB 的紀錄，讓寫入端盡量快
+    while (block->len < 64 * 1024) {
+        g_string_append_printf(block, "2024-11-23T10:00:00Z host-%02u GET /item/%u 200 %u\n",
+                               block_records % 32, block_records, block_records * 7 % 5000);
+        block_records++;
+    }
+    while (written < (guint64)state->megabytes * 1024 * 1024) {
+        if (write(fd, block->str, block->len) < 0) {
+            g_printerr("write failed: %s\n", g_strerror(errno));
+            break;
+        }
+        written += block->len;
+        record += block_records;
+    }
+    g_string_free(block, TRUE);
+    close(fd);
+
+    WriterResult *result = g_new(WriterResult, 1);
+    result->state = state;
+    result->total_records = record;
+    result->write_done = g_get_monotonic_time();
+    g_main_context_invoke_full(state->context, G_PRIORITY_DEFAULT, writer_done, result, g_free);
+    return NULL;
+}
+
+void bench_records(const gchar *name, const TailRecord *records, guint n_records, gpointer user_data) {
+    BenchState *state = user_data;
+    state->records += n_records;
+    bench_check_done(state);
+}
+
+// 比較基準：每 10 ms 以 GIOChannel 逐行讀到檔尾
+gboolean bench_poll(gpointer user_data) {
+    BenchState *state = user_data;
+    gchar *line;
+    gsize length;
+    while (g_io_channel_read_line(state->channel, &line, &length, NULL, NULL) == G_IO_STATUS_NORMAL) {
+        // 檔尾沒有換行的一筆下次再讀
+        if (length == 0 || line[length - 1] != '\n') {
+            g_io_channel_seek_position(state->channel, -(gint64)length, G_SEEK_CUR, NULL);
+            g_free(line);
+            break;
+        }
+        g_free(line);
+        state->records++;
+    }
+    bench_check_done(state);
+    return G_SOURCE_CONTINUE;
+}
+
+static void run_one(const gchar *dir, guint megabytes, gboolean tail) {
+    GMainContext *context = g_main_context_new();
+    BenchState state = { g_main_loop_new(context, FALSE), context };
+    state.path = g_build_filename(dir, tail ? "tail.log" : "poll.log", NULL);
+    state.megabytes = megabytes;
+    append_text(state.path, "");
+
+    GSource *source;
+    if (tail) {
+        source = file_tail_source_new(bench_records, NULL, &state);
+        file_tail_source_add(source, state.path, TRUE);
+    } else {
+        state.channel = g_io_channel_new_file(state.path, "r", NULL);
+        source = g_timeout_source_new(10);
+        g_source_set_callback(source, bench_poll, &state, NULL);
+    }
+    g_source_attach(source, context);
+
+    gint64 start = g_get_monotonic_time();
+    GThread *writer = g_thread_new("writer", writer_thread, &state);
+    g_main_loop_run(state.loop);
+    gdouble seconds = (g_get_monotonic_time() - start) / 1e6;
+    g_thread_join(writer);
+
+    g_print("%-15s %8" G_GUINT64_FORMAT " records, writer %.2f s, caught up after %.2f s, %7.0f MB/s\n",
+            tail ? "FileTailSource" : "poll+GIOChannel", state.records, (state.write_done - start) / 1e6,
+            seconds, megabytes * 1.048576 / seconds);
+
+    g_source_destroy(source);
+    g_source_unref(source);
+    if (state.channel) g_io_channel_unref(state.channel);
+    g_main_loop_unref(state.loop);
+    g_main_context_unref(context);
+    unlink(state.path);
+    g_free(state.path);
+}
+
+static void run_benchmark(guint megabytes) {
+    gchar template[] = "/tmp/tail-bench-XXXXXX";
+    if (!mkdtemp(template)) {
+        g_printerr("mkdtemp failed: %s\n", g_strerror(errno));
+        return;
+    }
+    g_print("Appending %u MB of access log records while tailing\n", megabytes);
+    run_one(template, megabytes, TRUE);
+    run_one(template, megabytes, FALSE);
+    rmdir(template);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && g_strcmp0(argv[1], "--benchmark") == 0) {
+        run_benchmark(argc > 2 ? MAX(atoi(argv[2]), 1) : 512);
+        return 0;
+    }
+    run_demo();
+    return 0;
+}
@@ -0,0 +1,697 @@
+/**
+ * @file glib_framed_message_example.c
+ * @brief 以 varint 長度前綴分隔訊息、零複製解碼的二進位訊框範例程式
+ *
+ * glib_io_event_example.c 的 stdin_callback() 以換行分隔訊息；payload 可能含有換行字元時，
+ * 送出端必須跳脫、接收端必須逐位元組掃描並還原成新的字串。
+ * 此程式改以「varint 長度 + payload」分隔訊息，沿用同樣的事件迴圈架構：
+ * - FrameReader 以大區塊讀入緩衝區，直接在緩衝區中解析長度，
+ *   payload 以 FrameView（指標與長度）整批交給回呼，不複製、不掃描內容。
+ * - FrameWriter 是一個 GSource：同一次迴圈中送出的小訊框先複製到合併緩衝區，
+ *   到 dispatch 時以一次 writev() 送出；大訊框以 GBytes 參考原本的資料，不複製。
+ *   socket 寫滿時才監聽 G_IO_OUT。
+ *
+ * 長度以 LEB128 編碼：每個位元組低 7 位元是資料，最高位元表示後面還有位元組；
+ * 小於 128 位元組的訊息只需要 1 個位元組的標頭。
+ *
+ * 執行時以 socketpair 送出幾個訊框並印出收到的內容。以 --benchmark 執行時，
+ * 比較合併寫入的訊框、每個訊框一次 write() 的訊框，以及跳脫後以換行分隔的文字行。
+ *
+ * 編譯方式：
+ * gcc -O2 -o glib_framed_message_example glib_framed_message_example.c `pkg-config --cflags --libs glib-2.0`
+ *
+ * 執行方式：
+ * ./glib_framed_message_example
+ * ./glib_framed_message_example --benchmark [訊框數]
+ *
+ * 預期輸出：
+ * Frame 1: 5 bytes "hello"
+ * Frame 2: 12 bytes "two\nlines\n!!"
+ * Frame 3: 0 bytes ""
+ * Frame 4: 100000 bytes (large, sent without copying)
+ * 4 frames in 1 batches, sender used 1 write calls
+ *
+ * @author: Nelson Chung
+ * @date: 2024.11.23
+ */
+
+#include <glib.h>
+#include <glib-unix.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define VARINT_MAX_BYTES 10               // 64 位元的值最多 10 個位元組
+#define FRAME_MAX_SIZE (16 * 1024 * 1024) // 超過此長度視為協定錯誤
+#define FRAME_READER_CHUNK (256 * 1024)
+#define FRAME_READER_BATCH 256
+#define FRAME_READER_MAX_READS 16
+#define FRAME_WRITER_COPY_LIMIT 4096      // 小於此長度的 payload 複製到合併緩衝區
+#define FRAME_WRITER_MAX_IOV 64
+
+/**
+ * @brief 以 LEB128 編碼 value
+ *
+ * @return 寫入 out 的位元組數
+ */
+gsize varint_encode(guint64 value, guint8 *out) {
+    gsize length = 0;
+    while (value >= 0x80) {
+        out[length++] = (guint8)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (guint8)value;
+    return length;
+}
+
+/**
+ * @brief 解碼 LEB128
+ *
+ * @return 標頭的位元組數；資料還不完整時傳回 0，格式錯誤時傳回 -1
+ */
+gint varint_decode(const guint8 *data, gsize available, guint64 *value) {
+    guint64 result = 0;
+    for (gsize i = 0; i < MIN(available, VARINT_MAX_BYTES); i++) {
+        result |= (guint64)(data[i] & 0x7f) << (7 * i);
+        if (!(data[i] & 0x80)) {
+            *value = result;
+            return (gint)i + 1;
+        }
+    }
+    return available >= VARINT_MAX_BYTES ? -1 : 0;
+}
+
+// 一個訊框的 payload，指向讀取器的緩衝區
+typedef struct {
+    const guint8 *data;
+    gsize length;
+} FrameView;
+
+// 一批訊框的回呼；傳回 FALSE 時停止讀取
+typedef gboolean (*FrameBatchFunc)(const FrameView *frames, guint n_frames, gpointer user_data);
+// 讀取結束時的回呼；error 為 0 表示對方關閉，EPROTO 表示訊框格式錯誤，其他是 errno
+typedef void (*FrameReaderEndFunc)(int error, gpointer user_data);
+
+typedef struct {
+    int fd;
+    GSource *source;
+    guint8 *buffer;
+    gsize capacity;
+    gsize start;             // 下一個訊框的開頭
+    gsize end;
+    gsize need;              // 目前的訊框需要從 start 起的位元組數，0 表示還不知道
+    FrameView batch[FRAME_READER_BATCH];
+    guint batch_len;
+    gboolean stopped;
+    FrameBatchFunc func;
+    FrameReaderEndFunc end_func;
+    gpointer user_data;
+    guint64 frames;
+    guint64 batches;
+} FrameReader;
+
+// 交出目前收集的訊框；回呼要求停止時傳回 FALSE
+static gboolean frame_reader_flush(FrameReader *reader) {
+    if (reader->batch_len == 0) return TRUE;
+    guint n_frames = reader->batch_len;
+    reader->batch_len = 0;
+    reader->frames += n_frames;
+    reader->batches++;
+    if (!reader->func(reader->batch, n_frames, reader->user_data)) {
+        reader->stopped = TRUE;
+    }
+    return !reader->stopped;
+}
+
+static void frame_reader_finish(FrameReader *reader, int error) {
+    if (!frame_reader_flush(reader)) return;
+    // 對方在訊框中間關閉連線也是協定錯誤
+    if (error == 0 && reader->start < reader->end) error = EPROTO;
+    reader->stopped = TRUE;
+    if (reader->end_func) reader->end_func(error, reader->user_data);
+}
+
+// 直接在緩衝區中解析完整的訊框
+static gboolean frame_reader_parse(FrameReader *reader) {
+    for (;;) {
+        guint64 length;
+        gsize available = reader->end - reader->start;
+        gint header = varint_decode(reader->buffer + reader->start, available, &length);
+        if (header < 0 || length > FRAME_MAX_SIZE) {
+            frame_reader_finish(reader, EPROTO);
+            return FALSE;
+        }
+        if (header == 0) {
+            reader->need = 0;
+            return TRUE;
+        }
+        if (available - header < length) {
+            reader->need = header + length;
+            return TRUE;
+        }
+
+        reader->batch[reader->batch_len].data = reader->buffer + reader->start + header;
+        reader->batch[reader->batch_len].length = length;
+        reader->batch_len++;
+        reader->start += header + length;
+        if (reader->batch_len == FRAME_READER_BATCH && !frame_reader_flush(reader)) return FALSE;
+    }
+}
+
+/**
+ * @brief 在緩衝區尾端騰出空間，必要時放大到放得下目前的訊框
+ *
+ * 收集中的 FrameView 指向緩衝區，搬動資料前必須先交出。
+ */
+static gboolean frame_reader_make_room(FrameReader *reader) {
+    if (!frame_reader_flush(reader)) return FALSE;
+
+    gsize pending = reader->end - reader->start;
+    memmove(reader->buffer, reader->buffer + reader->start, pending);
+    reader->start = 0;
+    reader->end = pending;
+    while (reader->capacity < reader->need || reader->end == reader->capacity) {
+        reader->capacity *= 2;
+    }
+    reader->buffer = g_realloc(reader->buffer, reader->capacity);
+    return TRUE;
+}
+
+// fd 可讀時被呼叫：讀入大區塊並整批交出訊框
+static gboolean frame_reader_callback(gint fd, GIOCondition condition, gpointer user_data) {
+    FrameReader *reader = user_data;
+
+    for (int i = 0; i < FRAME_READER_MAX_READS && !reader->stopped; i++) {
+        if ((reader->end == reader->capacity || reader->start + reader->need > reader->capacity) &&
+            !frame_reader_make_room(reader)) {
+            break;
+        }
+
+        ssize_t got = read(fd, reader->buffer + reader->end, reader->capacity - reader->end);
+        if (got > 0) {
+            reader->end += got;
+            if (!frame_reader_parse(reader)) break;
+            continue;
+        }
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0 && errno == EAGAIN) break;
+        frame_reader_finish(reader, got == 0 ? 0 : errno);
+    }
+    if (!reader->stopped) frame_reader_flush(reader);
+
+    if (reader->stopped) {
+        // 傳回 FALSE 後 GLib 會釋放事件來源
+        g_source_unref(reader->source);
+        reader->source = NULL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * @brief 建立訊框讀取器並開始監聽 fd
+ *
+ * FrameView 只在回呼期間有效。fd 會被設為非阻塞模式，但不會被關閉。
+ *
+ * @param context 要附加的事件迴圈，NULL 表示預設的 GMainContext
+ */
+FrameReader* frame_reader_new(int fd, GMainContext *context, FrameBatchFunc func,
+                              FrameReaderEndFunc end_func, gpointer user_data) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        g_printerr("fcntl failed: %s\n", g_strerror(errno));
+        return NULL;
+    }
+
+    FrameReader *reader = g_new0(FrameReader, 1);
+    reader->fd = fd;
+    reader->capacity = FRAME_READER_CHUNK;
+    reader->buffer = g_malloc(reader->capacity);
+    reader->func = func;
+    reader->end_func = end_func;
+    reader->user_data = user_data;
+
+    reader->source = g_unix_fd_source_new(fd, G_IO_IN | G_IO_HUP | G_IO_ERR);
+    g_source_set_callback(reader->source, (GSourceFunc)frame_reader_callback, reader, NULL);
+    g_source_set_name(reader->source, "FrameReader");
+    g_source_attach(reader->source, context);
+    return reader;
+}
+
+// 停止讀取並釋放訊框讀取器；不能在它自己的回呼中呼叫
+void frame_reader_free(FrameReader *reader) {
+    if (reader->source) {
+        g_source_destroy(reader->source);
+        g_source_unref(reader->source);
+    }
+    g_free(reader->buffer);
+    g_free(reader);
+}
+
+// 訊框寫入器的結構體
+typedef struct {
+    GSource source;          // 基礎 GSource 結構
+    gpointer tag;
+    int fd;
+    GQueue segments;         // 待送出的 GBytes，依序送出
+    gsize offset;            // 第一個 segment 已送出的位元組數
+    GByteArray *tail;        // 合併中的小訊框與標頭
+    gsize queued;            // 尚未送出的位元組數
+    gboolean coalesce;       // FALSE 時每個訊框立即送出
+    int error;
+    guint64 writes;          // writev() 呼叫次數
+} FrameWriter;
+
+// 把合併緩衝區封成一個 segment
+static void frame_writer_seal(FrameWriter *writer) {
+    if (writer->tail->len == 0) return;
+    g_queue_push_tail(&writer->segments, g_byte_array_free_to_bytes(writer->tail));
+    writer->tail = g_byte_array_new();
+}
+
+/**
+ * @brief 盡量送出所有排隊的資料，每次最多 FRAME_WRITER_MAX_IOV 個 segment
+ *
+ * socket 寫滿時監聽 G_IO_OUT，寫完後停止監聽。
+ */
+void frame_writer_flush(FrameWriter *writer) {
+    frame_writer_seal(writer);
+
+    while (writer->queued > 0 && writer->error == 0) {
+        struct iovec iov[FRAME_WRITER_MAX_IOV];
+        guint n_iov = 0;
+        for (GList *link = writer->segments.head; link && n_iov < FRAME_WRITER_MAX_IOV; link = link->next) {
+            gsize size;
+            const guint8 *data = g_bytes_get_data(link->data, &size);
+            gsize skip = n_iov == 0 ? writer->offset : 0;
+            iov[n_iov].iov_base = (gpointer)(data + skip);
+            iov[n_iov].iov_len = size - skip;
+            n_iov++;
+        }
+
+        ssize_t sent = writev(writer->fd, iov, n_iov);
+        writer->writes++;
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) break;
+            writer->error = errno;
+            g_printerr("writev failed: %s\n", g_strerror(errno));
+            break;
+        }
+
+        // 移除已送完的 segment
+        writer->queued -= sent;
+        sent += writer->offset;
+        writer->offset = 0;
+        while (sent > 0) {
+            GBytes *segment = g_queue_peek_head(&writer->segments);
+            gsize size = g_bytes_get_size(segment);
+            if ((gsize)sent < size) {
+                writer->offset = sent;
+                break;
+            }
+            g_bytes_unref(g_queue_pop_head(&writer->segments));
+            sent -= size;
+        }
+    }
+
+    g_source_modify_unix_fd(&writer->source, writer->tag,
+                            writer->queued > 0 && writer->error == 0 ? G_IO_OUT : 0);
+}
+
+// 訊框寫入器的回呼函式：合併的訊框到期或 socket 可寫時送出
+gboolean frame_writer_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+    FrameWriter *writer = (FrameWriter *)source;
+    g_source_set_ready_time(source, -1);
+    frame_writer_flush(writer);
+    return G_SOURCE_CONTINUE;
+}
+
+void frame_writer_finalize(GSource *source) {
+    FrameWriter *writer = (FrameWriter *)source;
+    g_queue_clear_full(&writer->segments, (GDestroyNotify)g_bytes_unref);
+    g_byte_array_free(writer->tail, TRUE);
+}
+
+// 沒有 prepare 與 check：以 ready time 或 G_IO_OUT 觸發
+static GSourceFuncs frame_writer_funcs = {
+    .prepare = NULL,
+    .check = NULL,
+    .dispatch = frame_writer_dispatch,
+    .finalize = frame_writer_finalize,
+};
+
+/**
+ * @brief 建立訊框寫入器並附加到 context
+ *
+ * fd 會被設為非阻塞模式，但不會被關閉。
+ *
+ * @param coalesce TRUE 時同一次迴圈送出的訊框合併成一次 writev()
+ */
+FrameWriter* frame_writer_new(int fd, GMainContext *context, gboolean coalesce) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        g_printerr("fcntl failed: %s\n", g_strerror(errno));
+        return NULL;
+    }
+
+    FrameWriter *writer = (FrameWriter *)g_source_new(&frame_writer_funcs, sizeof(FrameWriter));
+    writer->fd = fd;
+    writer->coalesce = coalesce;
+    writer->tail = g_byte_array_new();
+    g_queue_init(&writer->segments);
+    writer->tag = g_source_add_unix_fd(&writer->source, fd, 0);
+    g_source_set_name(&writer->source, "FrameWriter");
+    g_source_attach(&writer->source, context);
+    return writer;
+}
+
+// 排定送出：合併模式下等到這次迴圈的 dispatch，否則立即送出
+static void frame_writer_schedule(FrameWriter *writer) {
+    if (writer->coalesce) {
+        g_source_set_ready_time(&writer->source, 0);
+    } else {
+        frame_writer_flush(writer);
+    }
+}
+
+/**
+ * @brief 排入已編碼好的位元組，不加標頭（例如其他協定的資料）
+ */
+void frame_writer_write_raw(FrameWriter *writer, const guint8 *data, gsize length) {
+    g_byte_array_append(writer->tail, data, length);
+    writer->queued += length;
+    frame_writer_schedule(writer);
+}
+
+/**
+ * @brief 送出一個訊框；payload 會被複製，呼叫後即可重複使用
+ */
+void frame_writer_send(FrameWriter *writer, const guint8 *payload, gsize length) {
+    guint8 header[VARINT_MAX_BYTES];
+    gsize header_length = varint_encode(length, header);
+    g_byte_array_append(writer->tail, header, header_length);
+    g_byte_array_append(writer->tail, payload, length);
+    writer->queued += header_length + length;
+    frame_writer_schedule(writer);
+}
+
+/**
+ * @brief 送出一個訊框，大的 payload 只增加參考，不複製
+ */
+void frame_writer_send_bytes(FrameWriter *writer, GBytes *payload) {
+    gsize length;
+    const guint8 *data = g_bytes_get_data(payload, &length);
+    if (length < FRAME_WRITER_COPY_LIMIT) {
+        frame_writer_send(writer, data, length);
+        return;
+    }
+
+    guint8 header[VARINT_MAX_BYTES];
+    gsize header_length = varint_encode(length, header);
+    g_byte_array_append(writer->tail, header, header_length);
+    frame_writer_seal(writer);
+    g_queue_push_tail(&writer->segments, g_bytes_ref(payload));
+    writer->queued += header_length + length;
+    frame_writer_schedule(writer);
+}
+
+void frame_writer_free(FrameWriter *writer) {
+    g_source_destroy(&writer->source);
+    g_source_unref(&writer->source);
+}
+
+// 示範：送出幾個訊框，其中有含換行字元的與大的訊框
+static GMainLoop *main_loop = NULL;
+static guint demo_received = 0;
+
+gboolean demo_frames_callback(const FrameView *frames, guint n_frames, gpointer user_data) {
+    for (guint i = 0; i < n_frames; i++) {
+        demo_received++;
+        if (frames[i].length > 64) {
+            g_print("Frame %u: %" G_GSIZE_FORMAT " bytes (large, sent without copying)\n", demo_received, frames[i].length);
+        } else {
+            GString *text = g_string_new(NULL);
+            for (gsize j = 0; j < frames[i].length; j++) {
+                gchar c = frames[i].data[j];
+                if (c == '\n') g_string_append(text, "\\n");
+                else g_string_append_c(text, c);
+            }
+            g_print("Frame %u: %" G_GSIZE_FORMAT " bytes \"%s\"\n", demo_received, frames[i].length, text->str);
+            g_string_free(text, TRUE);
+        }
+    }
+    if (demo_received == 4) g_main_loop_quit(main_loop);
+    return TRUE;
+}
+
+static void run_demo(void) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        g_printerr("socketpair failed: %s\n", g_strerror(errno));
+        return;
+    }
+    main_loop = g_main_loop_new(NULL, FALSE);
+    FrameReader *reader = frame_reader_new(fds[0], NULL, demo_frames_callback, NULL, NULL);
+    FrameWriter *writer = frame_writer_new(fds[1], NULL, TRUE);
+
+    // 同一次迴圈中送出，dispatch 時合併成一次 writev()
+    frame_writer_send(writer, (const guint8 *)"hello", 5);
+    frame_writer_send(writer, (const guint8 *)"two\nlines\n!!", 12);
+    frame_writer_send(writer, NULL, 0);
+    GBytes *large = g_bytes_new_take(g_malloc0(100000), 100000);
+    frame_writer_send_bytes(writer, large);
+    g_bytes_unref(large);
+
+    g_main_loop_run(main_loop);
+    g_print("%" G_GUINT64_FORMAT " frames in %" G_GUINT64_FORMAT " batches, sender used %" G_GUINT64_FORMAT " write calls\n",
+            reader->frames, reader->batches, writer->writes);
+
+    frame_writer_free(writer);
+    frame_reader_free(reader);
+    g_main_loop_unref(main_loop);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// 量測：相同的 payload 以三種方式傳送
+typedef enum {
+    BENCH_FRAMED,          // 訊框，合併寫入
+    BENCH_FRAMED_EACH,     // 訊框，每個訊框一次 writev()
+    BENCH_ESCAPED_LINES,   // 跳脫後以換行分隔，合併寫入
+} BenchMode;
+
+#define BENCH_FRAMES_PER_TICK 64
+#define BENCH_POOL_SIZE (1024 * 1024)
+
+typedef struct {
+    GMainLoop *loop;
+    BenchMode mode;
+    FrameWriter *writer;
+    const guint8 *pool;        // 隨機資料，payload 取自其中
+    GBytes *pool_bytes;
+    guint total;
+    guint sent;
+    guint received;
+    guint64 sent_bytes;
+    guint64 sent_checksum;
+    guint64 received_checksum;
+    guint32 seed;
+    // 文字行模式的接收端
+    guint8 *line_buffer;
+    gsize line_capacity;
+    gsize line_start;
+    gsize line_end;
+    guint8 *unescaped;
+    guint64 line_wakeups;
+} Bench;
+
+// 只看長度與頭尾，讓各模式的檢查成本相同
+static guint64 payload_checksum(const guint8 *data, gsize length) {
+    return length * 31 + (length ? data[0] * 7 + data[length - 1] : 0);
+}
+
+// 大多是 16 到 512 位元組的小訊息，每 100 個有一個 64 KB 的大訊息
+static gsize bench_next(Bench *bench, const guint8 **data) {
+    bench->seed = bench->seed * 1103515245 + 12345;
+    gsize length = bench->sent % 100 == 99 ? 64 * 1024 : 16 + (bench->seed >> 8) % 497;
+    gsize offset = (bench->seed >> 4) % (BENCH_POOL_SIZE - length);
+    *data = bench->pool + offset;
+    return length;
+}
+
+// 跳脫 '\\' 與 '\n'，讓 payload 不含換行字元
+static void escape_line(GByteArray *out, const guint8 *data, gsize length) {
+    gsize start = 0;
+    for (gsize i = 0; i < length; i++) {
+        if (data[i] != '\n' && data[i] != '\\') continue;
+        g_byte_array_append(out, data + start, i - start);
+        g_byte_array_append(out, (const guint8 *)(data[i] == '\n' ? "\\n" : "\\\\"), 2);
+        start = i + 1;
+    }
+    g_byte_array_append(out, data + start, length - start);
+    g_byte_array_append(out, (const guint8 *)"\n", 1);
+}
+
+// 送出端：每次迴圈送出一批，寫入佇列太長時暫停
+gboolean bench_producer(gpointer user_data) {
+    Bench *bench = user_data;
+    if (bench->writer->queued > 4 * 1024 * 1024) return G_SOURCE_CONTINUE;
+
+    GByteArray *escaped = bench->mode == BENCH_ESCAPED_LINES ? g_byte_array_new() : NULL;
+    for (guint i = 0; i < BENCH_FRAMES_PER_TICK && bench->sent < bench->total; i++) {
+        const guint8 *data;
+        gsize length = bench_next(bench, &data);
+        bench->sent_checksum += payload_checksum(data, length);
+        bench->sent_bytes += length;
+        bench->sent++;
+
+        if (escaped) {
+            escape_line(escaped, data, length);
+        } else if (length >= FRAME_WRITER_COPY_LIMIT) {
+            GBytes *payload = g_bytes_new_from_bytes(bench->pool_bytes, data - bench->pool, length);
+            frame_writer_send_bytes(bench->writer, payload);
+            g_bytes_unref(payload);
+        } else {
+            frame_writer_send(bench->writer, data, length);
+        }
+    }
+    if (escaped) {
+        frame_writer_write_raw(bench->writer, escaped->data, escaped->len);
+        g_byte_array_free(escaped, TRUE);
+    }
+    return bench->sent < bench->total;
+}
+
+static void bench_received(Bench *bench, const guint8 *data, gsize length) {
+    bench->received_checksum += payload_checksum(data, length);
+    if (++bench->received == bench->total) g_main_loop_quit(bench->loop);
+}
+
+gboolean bench_frames_callback(const FrameView *frames, guint n_frames, gpointer user_data) {
+    for (guint i = 0; i < n_frames; i++) {
+        bench_received(user_data, frames[i].data, frames[i].length);
+    }
+    return TRUE;
+}
+
+// 文字行的接收端：找換行字元，再把每一行還原到另一個緩衝區
+gboolean bench_lines_callback(gint fd, GIOCondition condition, gpointer user_data) {
+    Bench *bench = user_data;
+    bench->line_wakeups++;
+
+    for (int i = 0; i < FRAME_READER_MAX_READS; i++) {
+        if (bench->line_end == bench->line_capacity) {
+            gsize pending = bench->line_end - bench->line_start;
+            memmove(bench->line_buffer, bench->line_buffer + bench->line_start, pending);
+            bench->line_start = 0;
+            bench->line_end = pending;
+            if (pending == bench->line_capacity) {
+                bench->line_capacity *= 2;
+                bench->line_buffer = g_realloc(bench->line_buffer, bench->line_capacity);
+            }
+        }
+        ssize_t got = read(fd, bench->line_buffer + bench->line_end, bench->line_capacity - bench->line_end);
+        if (got <= 0) break;
+        gsize scan = bench->line_end;
+        bench->line_end += got;
+
+        guint8 *newline;
+        while ((newline = memchr(bench->line_buffer + scan, '\n', bench->line_end - scan)) != NULL) {
+            const guint8 *line = bench->line_buffer + bench->line_start;
+            gsize length = 0;
+            for (const guint8 *p = line; p < newline; p++) {
+                if (*p == '\\') {
+                    p++;
+                    bench->unescaped[length++] = *p == 'n' ? '\n' : *p;
+                } else {
+                    bench->unescaped[length++] = *p;
+                }
+            }
+            bench_received(bench, bench->unescaped, length);
+            bench->line_start = scan = newline - bench->line_buffer + 1;
+        }
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void run_benchmark(BenchMode mode, guint total, guint8 *pool) {
+    static const gchar *names[] = { "framed, coalesced", "framed, write each", "escaped lines" };
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        g_printerr("socketpair failed: %s\n", g_strerror(errno));
+        return;
+    }
+
+    GMainContext *context = g_main_context_new();
+    Bench bench = { g_main_loop_new(context, FALSE), mode };
+    bench.pool = pool;
+    bench.pool_bytes = g_bytes_new_static(pool, BENCH_POOL_SIZE);
+    bench.total = total;
+    bench.seed = 1;
+    bench.writer = frame_writer_new(fds[1], context, mode != BENCH_FRAMED_EACH);
+
+    FrameReader *reader = NULL;
+    if (mode == BENCH_ESCAPED_LINES) {
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+        bench.line_capacity = FRAME_READER_CHUNK;
+        bench.line_buffer = g_malloc(bench.line_capacity);
+        bench.unescaped = g_malloc(FRAME_MAX_SIZE);
+        GSource *source = g_unix_fd_source_new(fds[0], G_IO_IN);
+        g_source_set_callback(source, (GSourceFunc)bench_lines_callback, &bench, NULL);
+        g_source_attach(source, context);
+        g_source_unref(source);
+    } else {
+        reader = frame_reader_new(fds[0], context, bench_frames_callback, NULL, &bench);
+    }
+
+    GSource *producer = g_idle_source_new();
+    g_source_set_callback(producer, bench_producer, &bench, NULL);
+    g_source_attach(producer, context);
+    g_source_unref(producer);
+
+    gint64 start = g_get_monotonic_time();
+    g_main_loop_run(bench.loop);
+    gdouble seconds = (g_get_monotonic_time() - start) / 1e6;
+
+    g_print("%-20s %8u frames: %7.1f MB/s payload, %6.2f M frames/s, %8" G_GUINT64_FORMAT " writes, %7" G_GUINT64_FORMAT " read batches, checksum %s\n",
+            names[mode], total, bench.sent_bytes / 1e6 / seconds, total / 1e6 / seconds, bench.writer->writes,
+            reader ? reader->batches : bench.line_wakeups,
+            bench.sent_checksum == bench.received_checksum ? "ok" : "MISMATCH");
+
+    if (reader) frame_reader_free(reader);
+    frame_writer_free(bench.writer);
+    g_bytes_unref(bench.pool_bytes);
+    g_free(bench.line_buffer);
+    g_free(bench.unescaped);
+    g_main_loop_unref(bench.loop);
+    g_main_context_unref(context);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && g_strcmp0(argv[1], "--benchmark") == 0) {
+        guint total = argc > 2 ? (guint)atoi(argv[2]) : 2000000;
+        guint8 *pool = g_malloc(BENCH_POOL_SIZE);
+        // 隨機的二進位資料，約 1/128 是換行字元，需要跳脫
+        guint32 seed = 7;
+        for (gsize i = 0; i < BENCH_POOL_SIZE; i++) {
+            seed = seed * 1103515245 + 12345;
+            pool[i] = seed >> 24;
+        }
+        for (BenchMode mode = BENCH_FRAMED; mode <= BENCH_ESCAPED_LINES; mode++) {
+            run_benchmark(mode, total, pool);
+        }
+        g_free(pool);
+        return 0;
+    }
+
+    run_demo();
+    return 0;
+}
@@ -0,0 +1,396 @@
+/**
+ * @file glib_idle_scheduler_example.c
+ * @brief 在事件迴圈上分時執行背景工作的排程器範例程式
+ *
+ * 在 idle 回呼中做大量工作（例如重建索引）時只有兩種極端：
+ * 一次做完會擋住計時器與 I/O 的 dispatch；每次只做一項則因為每次迴圈
+ * 都要 prepare/poll/check，整體慢得像在爬。
+ *
+ * 此程式的 IdleScheduler 是一個優先權為 G_PRIORITY_DEFAULT_IDLE 的自訂事件來源：
+ * - 長時間的工作拆成可重複呼叫的步驟（IdleJobStep），每次呼叫做一小段就返回。
+ * - 每次 dispatch 最多執行 budget 微秒，時間到就讓迴圈回去處理計時器與 I/O。
+ * - 工作之間依實際花掉的 CPU 時間做加權公平排程（stride scheduling）：
+ *   優先權越高權重越大，分到的時間越多，但低優先權的工作不會餓死。
+ *
+ * 執行時同時排入三個工作，並以 50 毫秒的計時器量測迴圈的延遲。
+ * 以 --benchmark 執行時，與「一個 idle 回呼做完全部」及「每個 idle 回呼做一項」比較。
+ *
+ * 編譯方式：
+ * gcc -O2 -o glib_idle_scheduler_example glib_idle_scheduler_example.c `pkg-config --cflags --libs glib-2.0`
+ *
+ * 執行方式：
+ * ./glib_idle_scheduler_example
+ * ./glib_idle_scheduler_example --benchmark
+ *
+ * 預期輸出：
+ * Progress: rebuild-index 21%, thumbnails 10%
+ * Progress: rebuild-index 42%, thumbnails 21%, urgent-sync 60%
+ * Job urgent-sync finished after 0.81 s
+ * ...
+ * Timer fired 40 times, max lag 2.1 ms
+ *
+ * @author: Nelson Chung
+ * @date: 2024.11.23
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+
+// 一個步驟：做一小段工作，還有剩餘工作時傳回 TRUE
+typedef gboolean (*IdleJobStep)(gpointer data);
+
+typedef enum {
+    IDLE_JOB_LOW,
+    IDLE_JOB_NORMAL,
+    IDLE_JOB_HIGH,
+} IdleJobPriority;
+
+// 各優先權的權重：同時執行時，高優先權分到的時間是低優先權的 4 倍
+static const guint job_weights[] = { 1, 2, 4 };
+
+#define STRIDE_SCALE 1024 // pass 以「微秒 * STRIDE_SCALE / 權重」累加
+
+typedef struct _IdleScheduler IdleScheduler;
+
+typedef struct {
+    guint id;
+    gchar *name;
+    guint weight;
+    guint64 pass;              // 虛擬時間，最小的先執行
+    IdleJobStep step;
+    gpointer data;
+    GDestroyNotify done;       // 工作完成或取消時呼叫
+    GSequenceIter *iter;       // 在 runnable 中的位置；正在執行時為 NULL
+    gboolean cancelled;        // 在自己的步驟中被取消，步驟返回後釋放
+    gint64 cpu_time;           // 已花掉的時間（微秒）
+} IdleJob;
+
+struct _IdleScheduler {
+    GSource source;            // 基礎 GSource 結構
+    GSequence *runnable;       // 依 pass 排序的工作
+    GHashTable *jobs;          // 工作編號 -> 尚未完成的 IdleJob
+    guint next_id;
+    gint64 budget;             // 每次 dispatch 最多執行的時間（微秒）
+    gint64 slice;              // 每個工作一次最多執行的時間（微秒）
+    guint64 min_pass;          // 最近執行過的 pass，新工作從這裡開始
+};
+
+static gint job_compare(gconstpointer a, gconstpointer b, gpointer user_data) {
+    const IdleJob *job_a = a, *job_b = b;
+    if (job_a->pass != job_b->pass) return job_a->pass < job_b->pass ? -1 : 1;
+    return job_a < job_b ? -1 : job_a > job_b;
+}
+
+static void idle_job_free(IdleScheduler *scheduler, IdleJob *job) {
+    g_hash_table_remove(scheduler->jobs, GUINT_TO_POINTER(job->id));
+    if (job->done) job->done(job->data);
+    g_free(job->name);
+    g_free(job);
+}
+
+// 排程器的準備函式：有工作就立即 dispatch；優先權低於計時器與 I/O，它們就緒時會先執行
+gboolean idle_scheduler_prepare(GSource *source, gint *timeout) {
+    IdleScheduler *scheduler = (IdleScheduler *)source;
+    gboolean ready = g_sequence_get_length(scheduler->runnable) > 0;
+    *timeout = ready ? 0 : -1;
+    return ready;
+}
+
+// 排程器的回呼函式：在 budget 內輪流執行 pass 最小的工作
+gboolean idle_scheduler_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+    IdleScheduler *scheduler = (IdleScheduler *)source;
+    gint64 start = g_get_monotonic_time();
+    gint64 deadline = start + scheduler->budget;
+    gint64 now = start;
+
+    while (now < deadline && g_sequence_get_length(scheduler->runnable) > 0) {
+        GSequenceIter *first = g_sequence_get_begin_iter(scheduler->runnable);
+        IdleJob *job = g_sequence_get(first);
+        g_sequence_remove(first);
+        job->iter = NULL;
+        scheduler->min_pass = job->pass;
+
+        // 執行到工作的時間片或整體 budget 用完；每一步之後檢查時間
+        gint64 slice_start = now;
+        gint64 slice_end = MIN(now + scheduler->slice, deadline);
+        gboolean more;
+        do {
+            more = job->step(job->data);
+            now = g_get_monotonic_time();
+        } while (more && !job->cancelled && now < slice_end);
+
+        gint64 used = now - slice_start;
+        job->cpu_time += used;
+        job->pass += (guint64)MAX(used, 1) * STRIDE_SCALE / job->weight;
+
+        if (more && !job->cancelled) {
+            job->iter = g_sequence_insert_sorted(scheduler->runnable, job, job_compare, NULL);
+        } else {
+            idle_job_free(scheduler, job);
+        }
+    }
+    return TRUE; // 排程器一直保留
+}
+
+void idle_scheduler_finalize(GSource *source) {
+    IdleScheduler *scheduler = (IdleScheduler *)source;
+    // 尚未完成的工作視為取消
+    while (g_sequence_get_length(scheduler->runnable) > 0) {
+        GSequenceIter *first = g_sequence_get_begin_iter(scheduler->runnable);
+        IdleJob *job = g_sequence_get(first);
+        g_sequence_remove(first);
+        idle_job_free(scheduler, job);
+    }
+    g_sequence_free(scheduler->runnable);
+    g_hash_table_destroy(scheduler->jobs);
+}
+
+static GSourceFuncs idle_scheduler_funcs = {
+    .prepare = idle_scheduler_prepare,
+    .check = NULL,
+    .dispatch = idle_scheduler_dispatch,
+    .finalize = idle_scheduler_finalize,
+};
+
+/**
+ * @brief 建立排程器並附加到 context
+ *
+ * @param budget_us 每次迴圈最多花在背景工作上的時間（微秒）
+ */
+IdleScheduler* idle_scheduler_new(GMainContext *context, guint budget_us) {
+    IdleScheduler *scheduler = (IdleScheduler *)g_source_new(&idle_scheduler_funcs, sizeof(IdleScheduler));
+    // 不設定 GDestroyNotify：dispatch 取出工作執行時不能釋放它
+    scheduler->runnable = g_sequence_new(NULL);
+    scheduler->jobs = g_hash_table_new(NULL, NULL);
+    scheduler->next_id = 1;
+    scheduler->budget = MAX(budget_us, 1);
+    scheduler->slice = MAX(scheduler->budget / 4, 1);
+    g_source_set_priority(&scheduler->source, G_PRIORITY_DEFAULT_IDLE);
+    g_source_set_name(&scheduler->source, "IdleScheduler");
+    g_source_attach(&scheduler->source, context);
+    return scheduler;
+}
+
+/**
+ * @brief 排入一個背景工作；step 會被重複呼叫直到傳回 FALSE
+ *
+ * @param done 工作完成或被取消時以 data 呼叫，可為 NULL
+ * @return 工作編號，用於 idle_scheduler_cancel()；工作完成後編號即失效
+ */
+guint idle_scheduler_add(IdleScheduler *scheduler, const gchar *name, IdleJobPriority priority,
+                            IdleJobStep step, gpointer data, GDestroyNotify done) {
+    IdleJob *job = g_new0(IdleJob, 1);
+    job->id = scheduler->next_id++;
+    if (scheduler->next_id == 0) scheduler->next_id = 1;
+    job->name = g_strdup(name);
+    job->weight = job_weights[CLAMP(priority, IDLE_JOB_LOW, IDLE_JOB_HIGH)];
+    // 新工作從目前的虛擬時間開始，不會因為之前沒執行而累積優勢
+    job->pass = scheduler->min_pass;
+    job->step = step;
+    job->data = data;
+    job->done = done;
+    job->iter = g_sequence_insert_sorted(scheduler->runnable, job, job_compare, NULL);
+    g_hash_table_insert(scheduler->jobs, GUINT_TO_POINTER(job->id), job);
+    return job->id;
+}
+
+/**
+ * @brief 取消尚未完成的工作
+ *
+ * 工作已完成或已取消時不做任何事。在工作自己的步驟中呼叫時，步驟返回後才釋放。
+ *
+ * @return 找到並取消了工作時傳回 TRUE
+ */
+gboolean idle_scheduler_cancel(IdleScheduler *scheduler, guint id) {
+    IdleJob *job = g_hash_table_lookup(scheduler->jobs, GUINT_TO_POINTER(id));
+    if (!job || job->cancelled) return FALSE;
+    if (!job->iter) {
+        job->cancelled = TRUE;
+        return TRUE;
+    }
+    g_sequence_remove(job->iter);
+    idle_job_free(scheduler, job);
+    return TRUE;
+}
+
+void idle_scheduler_free(IdleScheduler *scheduler) {
+    g_source_destroy(&scheduler->source);
+    g_source_unref(&scheduler->source);
+}
+
+// 示範的工作：每一步處理一個項目
+typedef struct {
+    const gchar *name;
+    guint total;
+    guint done;
+    guint64 checksum;
+    gint64 started;
+    gint64 finished;
+} DemoJob;
+
+static guint64 process_item(guint64 x) {
+    for (guint i = 0; i < 2000; i++) {
+        x = x * G_GUINT64_CONSTANT(6364136223846793005) + 1442695040888963407;
+    }
+    return x;
+}
+
+gboolean demo_job_step(gpointer data) {
+    DemoJob *job = data;
+    job->checksum ^= process_item(job->done);
+    return ++job->done < job->total;
+}
+
+void demo_job_done(gpointer data) {
+    DemoJob *job = data;
+    job->finished = g_get_monotonic_time();
+    if (job->done == job->total) {
+        g_print("Job %s finished after %.2f s\n", job->name, (job->finished - job->started) / 1e6);
+    }
+}
+
+// 量測迴圈延遲的計時器
+typedef struct {
+    gint64 next;
+    gint64 interval;
+    guint fired;
+    gint64 max_lag;
+} LagTimer;
+
+gboolean lag_timer_callback(gpointer data) {
+    LagTimer *timer = data;
+    gint64 now = g_get_monotonic_time();
+    if (timer->next) timer->max_lag = MAX(timer->max_lag, now - timer->next);
+    timer->next = now + timer->interval;
+    timer->fired++;
+    return TRUE;
+}
+
+static GMainLoop *main_loop = NULL;
+static DemoJob demo_jobs[3] = {
+    { "rebuild-index", 400000 },
+    { "thumbnails", 400000 },
+    { "urgent-sync", 100000 },
+};
+
+gboolean progress_callback(gpointer data) {
+    GString *line = g_string_new("Progress:");
+    gboolean running = FALSE;
+    for (guint i = 0; i < G_N_ELEMENTS(demo_jobs); i++) {
+        DemoJob *job = &demo_jobs[i];
+        if (job->started && !job->finished) {
+            g_string_append_printf(line, "%s %s %u%%", running ? "," : "", job->name, job->done * 100 / job->total);
+            running = TRUE;
+        }
+    }
+    if (running) g_print("%s\n", line->str);
+    g_string_free(line, TRUE);
+    return TRUE;
+}
+
+gboolean add_urgent_job(gpointer data) {
+    IdleScheduler *scheduler = data;
+    demo_jobs[2].started = g_get_monotonic_time();
+    idle_scheduler_add(scheduler, demo_jobs[2].name, IDLE_JOB_HIGH, demo_job_step, &demo_jobs[2], demo_job_done);
+    return G_SOURCE_REMOVE;
+}
+
+gboolean check_finished(gpointer data) {
+    for (guint i = 0; i < G_N_ELEMENTS(demo_jobs); i++) {
+        if (!demo_jobs[i].finished) return TRUE;
+    }
+    g_main_loop_quit(main_loop);
+    return FALSE;
+}
+
+static void run_demo(void) {
+    main_loop = g_main_loop_new(NULL, FALSE);
+    IdleScheduler *scheduler = idle_scheduler_new(NULL, 2000);
+    LagTimer timer = { 0, 50 * 1000, 0, 0 };
+
+    g_timeout_add(50, lag_timer_callback, &timer);
+    g_timeout_add(500, progress_callback, NULL);
+    g_timeout_add(50, check_finished, NULL);
+
+    demo_jobs[0].started = demo_jobs[1].started = g_get_monotonic_time();
+    idle_scheduler_add(scheduler, demo_jobs[0].name, IDLE_JOB_NORMAL, demo_job_step, &demo_jobs[0], demo_job_done);
+    idle_scheduler_add(scheduler, demo_jobs[1].name, IDLE_JOB_LOW, demo_job_step, &demo_jobs[1], demo_job_done);
+    g_timeout_add(700, add_urgent_job, scheduler);
+
+    g_main_loop_run(main_loop);
+    g_print("Timer fired %u times, max lag %.1f ms\n", timer.fired, timer.max_lag / 1000.0);
+
+    idle_scheduler_free(scheduler);
+    g_main_loop_unref(main_loop);
+}
+
+// 量測：同樣的工作量以三種方式在有計時器的迴圈上執行
+typedef enum {
+    BENCH_WHOLE,       // 一個 idle 回呼做完全部
+    BENCH_PER_ITEM,    // 每個 idle 回呼做一項
+    BENCH_SCHEDULER,   // IdleScheduler
+} BenchMode;
+
+gboolean bench_whole_callback(gpointer data) {
+    while (demo_job_step(data)) {
+    }
+    return G_SOURCE_REMOVE;
+}
+
+gboolean bench_item_callback(gpointer data) {
+    return demo_job_step(data);
+}
+
+static void run_benchmark(BenchMode mode, guint items) {
+    static const gchar *names[] = { "whole job per idle", "one item per idle", "IdleScheduler 2 ms" };
+    GMainContext *context = g_main_context_new();
+    DemoJob job = { "bench", items };
+    LagTimer timer = { 0, 10 * 1000, 0, 0 };
+    IdleScheduler *scheduler = NULL;
+
+    GSource *timer_source = g_timeout_source_new(10);
+    g_source_set_callback(timer_source, lag_timer_callback, &timer, NULL);
+    g_source_attach(timer_source, context);
+
+    gint64 start = g_get_monotonic_time();
+    timer.next = start + timer.interval;
+    if (mode == BENCH_SCHEDULER) {
+        scheduler = idle_scheduler_new(context, 2000);
+        idle_scheduler_add(scheduler, job.name, IDLE_JOB_NORMAL, demo_job_step, &job, NULL);
+    } else {
+        GSource *idle = g_idle_source_new();
+        g_source_set_callback(idle, mode == BENCH_WHOLE ? bench_whole_callback : bench_item_callback, &job, NULL);
+        g_source_attach(idle, context);
+        g_source_unref(idle);
+    }
+
+    guint iterations = 0;
+    while (job.done < job.total) {
+        g_main_context_iteration(context, TRUE);
+        iterations++;
+    }
+    gint64 elapsed = g_get_monotonic_time() - start;
+    // 工作一直占住迴圈時計時器還沒有機會執行，讓它執行一次才量得到延遲
+    g_main_context_iteration(context, FALSE);
+
+    g_print("%-20s %u items: %6.3f s, %8u iterations, timer max lag %8.1f ms\n",
+            names[mode], items, elapsed / 1e6, iterations, timer.max_lag / 1000.0);
+
+    if (scheduler) idle_scheduler_free(scheduler);
+    g_source_destroy(timer_source);
+    g_source_unref(timer_source);
+    g_main_context_unref(context);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && g_strcmp0(argv[1], "--benchmark") == 0) {
+        for (BenchMode mode = BENCH_WHOLE; mode <= BENCH_SCHEDULER; mode++) {
+            run_benchmark(mode, 200000);
+        }
+        return 0;
+    }
+
+    run_demo();
+    return 0;
+}
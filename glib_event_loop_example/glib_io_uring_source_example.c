@@ -0,0 +1,696 @@
+/**
+ * @file glib_io_uring_source_example.c
+ * @brief 以 io_uring 做非同步檔案與 socket I/O 的自訂事件來源範例程式
+ *
+ * glib_io_event_example.c 以 GIOChannel 監聽 fd，每次讀寫都是一個系統呼叫，
+ * 每次迴圈還要再 poll 一次。
+ *
+ * 此程式的 UringSource 擁有一個 io_uring，並提供 read、write、accept、recv 的送出函式：
+ * - 送出只是填寫共享記憶體中的 SQE；同一次迴圈中送出的所有操作，在迴圈進入 poll
+ *   之前（prepare）以一次 io_uring_enter() 一起交給核心。
+ * - io_uring 註冊了一個 eventfd，有完成事件時 eventfd 變成可讀，主迴圈醒來後
+ *   在一次 dispatch 中取走 CQ 中所有的完成事件，依序呼叫各操作的回呼。
+ * - 直接使用 io_uring_setup/io_uring_enter/io_uring_register 系統呼叫與
+ *   <linux/io_uring.h>，不需要 liburing。
+ *
+ * 執行時先以 16 個並行的讀取讀完一個檔案，再以 accept/recv/write 做一個
+ * echo 伺服器，由另一個執行緒連線測試。以 --benchmark 執行時，
+ * 比較以 io_uring 與以 GIOChannel 每次讀取 4 KB 讀完同一個檔案。
+ *
+ * 需要 Linux 5.6 以上的核心。
+ *
+ * 編譯方式：
+ * gcc -O2 -o glib_io_uring_source_example glib_io_uring_source_example.c `pkg-config --cflags --libs glib-2.0`
+ *
+ * 執行方式：
+ * ./glib_io_uring_source_example [檔案]
+ * ./glib_io_uring_source_example --benchmark 檔案
+ *
+ * 預期輸出：
+ * Read 23816 bytes from glib_io_uring_source_example.c in 1 chunks, 1 io_uring_enter calls
+ * Echo server listening on 127.0.0.1:40123
+ * Client got echo: hello 1
+ * Client got echo: hello 2
+ * Client got echo: hello 3
+ * Echo server closed connection, exiting...
+ *
+ * @author: Nelson Chung
+ * @date: 2024.11.23
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+
+// 操作完成時的回呼；result 是系統呼叫的傳回值，失敗時為 -errno
+typedef void (*UringCompleteFunc)(gint32 result, gpointer user_data);
+
+// 一個送出中的操作，位址作為 SQE 的 user_data
+typedef struct _UringOp UringOp;
+struct _UringOp {
+    UringOp *prev;
+    UringOp *next;
+    UringCompleteFunc func;
+    gpointer user_data;
+};
+
+// io_uring 事件來源的結構體
+typedef struct {
+    GSource source;             // 基礎 GSource 結構
+    int ring_fd;
+    int event_fd;               // 有完成事件時由核心寫入
+
+    // 送出佇列（SQ），與核心共享
+    guint32 *sq_head;
+    guint32 *sq_tail;
+    guint32 sq_mask;
+    guint32 sq_entries;
+    guint32 *sq_array;
+    struct io_uring_sqe *sqes;
+    guint32 sq_local_tail;      // 已填寫但還沒交給核心的 SQE 結尾
+    guint32 to_submit;
+
+    // 完成佇列（CQ），與核心共享
+    guint32 *cq_head;
+    guint32 *cq_tail;
+    guint32 cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring;
+    gsize sq_ring_size;
+    void *cq_ring;
+    gsize cq_ring_size;
+    gsize sqes_size;
+
+    UringOp *in_flight;         // 尚未完成的操作，釋放事件來源時取消並等它們完成
+    guint64 enter_calls;        // io_uring_enter 的呼叫次數
+} UringSource;
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * @brief 把已填寫的 SQE 交給核心
+ *
+ * @return 成功時為 TRUE；核心暫時無法接受（EAGAIN、EBUSY）時留待下次再送
+ */
+static gboolean uring_flush(UringSource *uring) {
+    while (uring->to_submit > 0) {
+        int submitted = io_uring_enter(uring->ring_fd, uring->to_submit, 0, 0);
+        uring->enter_calls++;
+        if (submitted < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EBUSY) {
+                g_printerr("io_uring_enter failed: %s\n", g_strerror(errno));
+            }
+            return FALSE;
+        }
+        uring->to_submit -= submitted;
+    }
+    return TRUE;
+}
+
+// 取得一個空的 SQE；SQ 已滿時先把已填寫的交給核心
+static struct io_uring_sqe* uring_get_sqe(UringSource *uring) {
+    guint32 head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+    if (uring->sq_local_tail - head >= uring->sq_entries) {
+        uring_flush(uring);
+        head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+        if (uring->sq_local_tail - head >= uring->sq_entries) return NULL;
+    }
+
+    guint32 index = uring->sq_local_tail & uring->sq_mask;
+    struct io_uring_sqe *sqe = &uring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    uring->sq_array[index] = index;
+    return sqe;
+}
+
+// 送出填好的 SQE：發布新的 SQ 結尾，實際的系統呼叫延到 prepare 時一起做
+static void uring_queue(UringSource *uring, struct io_uring_sqe *sqe, UringCompleteFunc func, gpointer user_data) {
+    UringOp *op = g_new(UringOp, 1);
+    op->func = func;
+    op->user_data = user_data;
+    op->prev = NULL;
+    op->next = uring->in_flight;
+    if (uring->in_flight) uring->in_flight->prev = op;
+    uring->in_flight = op;
+
+    sqe->user_data = (guint64)(guintptr)op;
+    uring->sq_local_tail++;
+    uring->to_submit++;
+    __atomic_store_n(uring->sq_tail, uring->sq_local_tail, __ATOMIC_RELEASE);
+}
+
+static void uring_op_unlink(UringSource *uring, UringOp *op) {
+    if (op->prev) op->prev->next = op->next;
+    else uring->in_flight = op->next;
+    if (op->next) op->next->prev = op->prev;
+}
+
+// 有完成事件時不 poll，直接 dispatch
+static gboolean uring_has_completions(UringSource *uring) {
+    return *uring->cq_head != __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+}
+
+// io_uring 事件來源的準備函式：在迴圈睡眠前把這一輪送出的操作一次交給核心
+gboolean uring_source_prepare(GSource *source, gint *timeout) {
+    UringSource *uring = (UringSource *)source;
+    if (uring->to_submit > 0 && !uring_flush(uring)) {
+        *timeout = 1; // 核心暫時無法接受，稍後再試
+        return uring_has_completions(uring);
+    }
+    *timeout = -1;
+    return uring_has_completions(uring);
+}
+
+gboolean uring_source_check(GSource *source) {
+    return uring_has_completions((UringSource *)source);
+}
+
+// io_uring 事件來源的回呼函式：取走 CQ 中所有的完成事件
+gboolean uring_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+    UringSource *uring = (UringSource *)source;
+    guint64 value;
+
+    // 先清除 eventfd 再讀 CQ，之後完成的操作一定會再喚醒一次
+    if (read(uring->event_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        g_printerr("eventfd read failed: %s\n", g_strerror(errno));
+    }
+
+    guint32 head = *uring->cq_head;
+    guint32 tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &uring->cqes[head & uring->cq_mask];
+        UringOp *op = (UringOp *)(guintptr)cqe->user_data;
+        gint32 result = cqe->res;
+
+        // 先把 CQE 還給核心，回呼中可以馬上送出新的操作
+        head++;
+        __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+
+        uring_op_unlink(uring, op);
+        if (op->func) op->func(result, op->user_data);
+        g_free(op);
+
+        // 處理期間又有操作完成時一起處理，不必再等下一次迴圈
+        if (head == tail) tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+    }
+    return TRUE; // io_uring 事件來源一直保留
+}
+
+/**
+ * @brief 取消所有尚未完成的操作，並等到核心交回它們的完成事件
+ *
+ * 關閉 ring 不會同步地停止操作：核心之後仍可能把資料讀進呼叫者的緩衝區。
+ * 等完成事件全部收回後，呼叫者才能安全地釋放緩衝區。被取消的操作不再呼叫回呼。
+ */
+static void uring_cancel_all(UringSource *uring) {
+    for (UringOp *op = uring->in_flight; op; op = op->next) {
+        op->func = NULL;
+    }
+
+    UringOp *next_cancel = uring->in_flight;
+    while (uring->in_flight) {
+        // 每個操作送出一個 ASYNC_CANCEL；SQ 已滿時先收回完成事件再繼續
+        struct io_uring_sqe *sqe;
+        while (next_cancel && (sqe = uring_get_sqe(uring)) != NULL) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = (guint64)(guintptr)next_cancel;
+            sqe->user_data = 0; // 取消操作本身的完成事件沒有對應的 UringOp
+            uring->sq_local_tail++;
+            uring->to_submit++;
+            __atomic_store_n(uring->sq_tail, uring->sq_local_tail, __ATOMIC_RELEASE);
+            next_cancel = next_cancel->next;
+        }
+
+        // 一併送出尚未交給核心的操作，並等待至少一個完成事件
+        int submitted = io_uring_enter(uring->ring_fd, uring->to_submit, 1, IORING_ENTER_GETEVENTS);
+        if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            g_printerr("io_uring_enter failed while cancelling: %s\n", g_strerror(errno));
+            break;
+        }
+        if (submitted > 0) uring->to_submit -= submitted;
+
+        guint32 head = *uring->cq_head;
+        guint32 tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            UringOp *op = (UringOp *)(guintptr)uring->cqes[head & uring->cq_mask].user_data;
+            if (!op) continue;
+            if (op == next_cancel) next_cancel = op->next;
+            uring_op_unlink(uring, op);
+            g_free(op);
+        }
+        __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+// io_uring 事件來源的結束函式：先取消並收回所有操作，再關閉 ring
+void uring_source_finalize(GSource *source) {
+    UringSource *uring = (UringSource *)source;
+    if (uring->ring_fd >= 0 && uring->sqes && uring->cqes) uring_cancel_all(uring);
+    if (uring->sqes) munmap(uring->sqes, uring->sqes_size);
+    if (uring->cq_ring && uring->cq_ring != uring->sq_ring) munmap(uring->cq_ring, uring->cq_ring_size);
+    if (uring->sq_ring) munmap(uring->sq_ring, uring->sq_ring_size);
+    if (uring->ring_fd >= 0) close(uring->ring_fd);
+    if (uring->event_fd >= 0) close(uring->event_fd);
+    while (uring->in_flight) {
+        UringOp *op = uring->in_flight;
+        uring->in_flight = op->next;
+        g_free(op);
+    }
+}
+
+static GSourceFuncs uring_source_funcs = {
+    .prepare = uring_source_prepare,
+    .check = uring_source_check,
+    .dispatch = uring_source_dispatch,
+    .finalize = uring_source_finalize,
+};
+
+/**
+ * @brief 建立有 entries 個 SQE 的 io_uring 事件來源，需要再以 g_source_attach() 附加
+ *
+ * @return 事件來源；核心不支援 io_uring 時傳回 NULL
+ */
+GSource* uring_source_new(guint entries) {
+    UringSource *uring = (UringSource *)g_source_new(&uring_source_funcs, sizeof(UringSource));
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    uring->event_fd = -1;
+    g_source_set_name(&uring->source, "UringSource");
+
+    uring->ring_fd = io_uring_setup(MAX(entries, 1), &params);
+    if (uring->ring_fd < 0) {
+        g_printerr("io_uring_setup failed: %s\n", g_strerror(errno));
+        g_source_unref(&uring->source);
+        return NULL;
+    }
+
+    // 對應 SQ、CQ 與 SQE 陣列；新核心的 SQ 與 CQ 共用一塊對應
+    uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(guint32);
+    uring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        uring->sq_ring_size = uring->cq_ring_size = MAX(uring->sq_ring_size, uring->cq_ring_size);
+    }
+    uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          uring->ring_fd, IORING_OFF_SQ_RING);
+    if (uring->sq_ring == MAP_FAILED) {
+        uring->sq_ring = NULL;
+        goto fail;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        uring->cq_ring = uring->sq_ring;
+    } else {
+        uring->cq_ring = mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              uring->ring_fd, IORING_OFF_CQ_RING);
+        if (uring->cq_ring == MAP_FAILED) {
+            uring->cq_ring = NULL;
+            goto fail;
+        }
+    }
+    uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       uring->ring_fd, IORING_OFF_SQES);
+    if (uring->sqes == MAP_FAILED) {
+        uring->sqes = NULL;
+        goto fail;
+    }
+
+    guint8 *sq = uring->sq_ring;
+    uring->sq_head = (guint32 *)(sq + params.sq_off.head);
+    uring->sq_tail = (guint32 *)(sq + params.sq_off.tail);
+    uring->sq_mask = *(guint32 *)(sq + params.sq_off.ring_mask);
+    uring->sq_entries = *(guint32 *)(sq + params.sq_off.ring_entries);
+    uring->sq_array = (guint32 *)(sq + params.sq_off.array);
+    uring->sq_local_tail = *uring->sq_tail;
+
+    guint8 *cq = uring->cq_ring;
+    uring->cq_head = (guint32 *)(cq + params.cq_off.head);
+    uring->cq_tail = (guint32 *)(cq + params.cq_off.tail);
+    uring->cq_mask = *(guint32 *)(cq + params.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    // 完成事件透過 eventfd 通知主迴圈
+    uring->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (uring->event_fd < 0 || io_uring_register(uring->ring_fd, IORING_REGISTER_EVENTFD, &uring->event_fd, 1) < 0) {
+        goto fail;
+    }
+    g_source_add_unix_fd(&uring->source, uring->event_fd, G_IO_IN);
+    return &uring->source;
+
+fail:
+    g_printerr("io_uring setup failed: %s\n", g_strerror(errno));
+    g_source_unref(&uring->source);
+    return NULL;
+}
+
+/**
+ * @brief 從 fd 的 offset 讀取最多 len 位元組；offset 為 -1 時使用目前的檔案位置
+ *
+ * buf 在操作完成或事件來源釋放之前必須保持有效；事件來源釋放時會取消並等待尚未完成的操作。
+ * 所有送出函式在 SQ 已滿且無法送出時傳回 FALSE。
+ */
+gboolean uring_source_read(GSource *source, int fd, gpointer buf, guint32 len, gint64 offset,
+                           UringCompleteFunc func, gpointer user_data) {
+    UringSource *uring = (UringSource *)source;
+    struct io_uring_sqe *sqe = uring_get_sqe(uring);
+    if (!sqe) return FALSE;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (guint64)(guintptr)buf;
+    sqe->len = len;
+    sqe->off = (guint64)offset;
+    uring_queue(uring, sqe, func, user_data);
+    return TRUE;
+}
+
+gboolean uring_source_write(GSource *source, int fd, gconstpointer buf, guint32 len, gint64 offset,
+                            UringCompleteFunc func, gpointer user_data) {
+    UringSource *uring = (UringSource *)source;
+    struct io_uring_sqe *sqe = uring_get_sqe(uring);
+    if (!sqe) return FALSE;
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (guint64)(guintptr)buf;
+    sqe->len = len;
+    sqe->off = (guint64)offset;
+    uring_queue(uring, sqe, func, user_data);
+    return TRUE;
+}
+
+// 完成時 result 是新連線的 fd；addr 與 addrlen 可為 NULL
+gboolean uring_source_accept(GSource *source, int fd, struct sockaddr *addr, socklen_t *addrlen,
+                             UringCompleteFunc func, gpointer user_data) {
+    UringSource *uring = (UringSource *)source;
+    struct io_uring_sqe *sqe = uring_get_sqe(uring);
+    if (!sqe) return FALSE;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->addr = (guint64)(guintptr)addr;
+    sqe->addr2 = (guint64)(guintptr)addrlen;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    uring_queue(uring, sqe, func, user_data);
+    return TRUE;
+}
+
+gboolean uring_source_recv(GSource *source, int fd, gpointer buf, guint32 len, int flags,
+                           UringCompleteFunc func, gpointer user_data) {
+    UringSource *uring = (UringSource *)source;
+    struct io_uring_sqe *sqe = uring_get_sqe(uring);
+    if (!sqe) return FALSE;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->addr = (guint64)(guintptr)buf;
+    sqe->len = len;
+    sqe->msg_flags = flags;
+    uring_queue(uring, sqe, func, user_data);
+    return TRUE;
+}
+
+guint64 uring_source_get_enter_calls(GSource *source) {
+    return ((UringSource *)source)->enter_calls;
+}
+
+// 示範一：以 16 個並行的讀取讀完一個檔案
+#define READ_CHUNK (64 * 1024)
+#define READ_DEPTH 16
+
+static GMainLoop *main_loop = NULL;
+
+typedef struct {
+    GSource *uring;
+    int fd;
+    gint64 size;
+    gint64 next_offset;     // 下一個要送出的讀取位置
+    guint outstanding;
+    guint chunk_size;
+    guint64 bytes;
+    guint64 chunks;
+    gchar *buffers;         // 每個並行的讀取一個緩衝區
+    guint64 enter_calls;
+    gboolean failed;
+} FileReader;
+
+typedef struct {
+    FileReader *reader;
+    gchar *buffer;
+} ReadSlot;
+
+static gboolean file_reader_submit(FileReader *reader, ReadSlot *slot);
+
+void file_read_done(gint32 result, gpointer user_data) {
+    ReadSlot *slot = user_data;
+    FileReader *reader = slot->reader;
+    reader->outstanding--;
+
+    if (result < 0) {
+        g_printerr("read failed: %s\n", g_strerror(-result));
+        reader->failed = TRUE;
+    } else {
+        reader->bytes += result;
+        reader->chunks++;
+    }
+
+    // 同一個緩衝區接著讀下一段
+    if (reader->failed || !file_reader_submit(reader, slot)) {
+        if (reader->outstanding == 0) g_main_loop_quit(main_loop);
+    }
+}
+
+static gboolean file_reader_submit(FileReader *reader, ReadSlot *slot) {
+    if (reader->next_offset >= reader->size) return FALSE;
+    if (!uring_source_read(reader->uring, reader->fd, slot->buffer, reader->chunk_size, reader->next_offset,
+                           file_read_done, slot)) {
+        return FALSE;
+    }
+    reader->next_offset += reader->chunk_size;
+    reader->outstanding++;
+    return TRUE;
+}
+
+/**
+ * @brief 以 depth 個並行、每次 chunk_size 位元組的讀取讀完檔案
+ */
+static gboolean read_file_with_uring(const gchar *path, guint chunk_size, guint depth, FileReader *reader) {
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (reader->fd < 0) {
+        g_printerr("Cannot open %s: %s\n", path, g_strerror(errno));
+        return FALSE;
+    }
+    reader->size = lseek(reader->fd, 0, SEEK_END);
+    reader->chunk_size = chunk_size;
+    reader->uring = uring_source_new(depth * 2);
+    if (!reader->uring) {
+        close(reader->fd);
+        return FALSE;
+    }
+    g_source_attach(reader->uring, NULL);
+
+    reader->buffers = g_malloc((gsize)chunk_size * depth);
+    ReadSlot *slots = g_new(ReadSlot, depth);
+    for (guint i = 0; i < depth; i++) {
+        slots[i].reader = reader;
+        slots[i].buffer = reader->buffers + (gsize)i * chunk_size;
+        file_reader_submit(reader, &slots[i]);
+    }
+    if (reader->outstanding > 0) g_main_loop_run(main_loop);
+    reader->enter_calls = uring_source_get_enter_calls(reader->uring);
+
+    g_source_destroy(reader->uring);
+    g_source_unref(reader->uring);
+    g_free(slots);
+    g_free(reader->buffers);
+    close(reader->fd);
+    return !reader->failed;
+}
+
+// 示範二：以 accept/recv/write 做的 echo 伺服器
+typedef struct {
+    GSource *uring;
+    int listen_fd;
+    int client_fd;
+    gchar buffer[256];
+} EchoServer;
+
+void echo_recv_done(gint32 result, gpointer user_data);
+
+void echo_write_done(gint32 result, gpointer user_data) {
+    EchoServer *server = user_data;
+    if (result < 0) {
+        g_printerr("write failed: %s\n", g_strerror(-result));
+        g_main_loop_quit(main_loop);
+        return;
+    }
+    uring_source_recv(server->uring, server->client_fd, server->buffer, sizeof(server->buffer), 0,
+                      echo_recv_done, server);
+}
+
+void echo_recv_done(gint32 result, gpointer user_data) {
+    EchoServer *server = user_data;
+    if (result <= 0) {
+        g_print("Echo server closed connection, exiting...\n");
+        g_main_loop_quit(main_loop);
+        return;
+    }
+    uring_source_write(server->uring, server->client_fd, server->buffer, result, -1, echo_write_done, server);
+}
+
+void echo_accept_done(gint32 result, gpointer user_data) {
+    EchoServer *server = user_data;
+    if (result < 0) {
+        g_printerr("accept failed: %s\n", g_strerror(-result));
+        g_main_loop_quit(main_loop);
+        return;
+    }
+    server->client_fd = result;
+    uring_source_recv(server->uring, server->client_fd, server->buffer, sizeof(server->buffer), 0,
+                      echo_recv_done, server);
+}
+
+// 以阻塞的 socket 連線、傳送並讀回三行
+gpointer echo_client_thread(gpointer data) {
+    struct sockaddr_in *address = data;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)address, sizeof(*address)) < 0) {
+        g_printerr("Client cannot connect: %s\n", g_strerror(errno));
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    for (int i = 1; i <= 3; i++) {
+        gchar line[32], reply[32];
+        int len = g_snprintf(line, sizeof(line), "hello %d", i);
+        if (write(fd, line, len) != len) break;
+        ssize_t got = read(fd, reply, sizeof(reply) - 1);
+        if (got <= 0) break;
+        reply[got] = '\0';
+        g_print("Client got echo: %s\n", reply);
+    }
+    close(fd);
+    return NULL;
+}
+
+static void run_echo_demo(void) {
+    EchoServer server = { NULL, -1, -1 };
+    struct sockaddr_in address;
+    socklen_t address_len = sizeof(address);
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    server.listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server.listen_fd < 0 || bind(server.listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(server.listen_fd, 16) < 0 ||
+        getsockname(server.listen_fd, (struct sockaddr *)&address, &address_len) < 0) {
+        g_printerr("Cannot listen: %s\n", g_strerror(errno));
+        if (server.listen_fd >= 0) close(server.listen_fd);
+        return;
+    }
+    g_print("Echo server listening on 127.0.0.1:%u\n", ntohs(address.sin_port));
+
+    server.uring = uring_source_new(32);
+    if (!server.uring) {
+        close(server.listen_fd);
+        return;
+    }
+    g_source_attach(server.uring, NULL);
+    uring_source_accept(server.uring, server.listen_fd, NULL, NULL, echo_accept_done, &server);
+
+    GThread *client = g_thread_new("echo-client", echo_client_thread, &address);
+    g_main_loop_run(main_loop);
+    g_thread_join(client);
+
+    g_source_destroy(server.uring);
+    g_source_unref(server.uring);
+    if (server.client_fd >= 0) close(server.client_fd);
+    close(server.listen_fd);
+}
+
+// 量測：以 GIOChannel 每次讀取 4 KB 讀完同一個檔案，每次讀取一個系統呼叫
+typedef struct {
+    guint64 bytes;
+    guint64 reads;
+    gchar buffer[4096];
+} ChannelReader;
+
+gboolean channel_read_callback(GIOChannel *channel, GIOCondition condition, gpointer data) {
+    ChannelReader *reader = data;
+    gsize got = 0;
+    GIOStatus status = g_io_channel_read_chars(channel, reader->buffer, sizeof(reader->buffer), &got, NULL);
+    reader->reads++;
+    reader->bytes += got;
+    if (status == G_IO_STATUS_EOF || status == G_IO_STATUS_ERROR) {
+        g_main_loop_quit(main_loop);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void run_benchmark(const gchar *path) {
+    FileReader reader;
+    gint64 start = g_get_monotonic_time();
+    if (!read_file_with_uring(path, 4096, 64, &reader)) return;
+    gint64 elapsed = g_get_monotonic_time() - start;
+    g_print("io_uring   %10" G_GUINT64_FORMAT " bytes in %8" G_GUINT64_FORMAT " reads: %8.3f s, %8.1f MB/s, %8"
+            G_GUINT64_FORMAT " system calls\n", reader.bytes, reader.chunks, elapsed / 1e6,
+            reader.bytes / (elapsed / 1e6) / 1e6, reader.enter_calls);
+
+    GIOChannel *channel = g_io_channel_new_file(path, "r", NULL);
+    if (!channel) return;
+    g_io_channel_set_encoding(channel, NULL, NULL);
+    g_io_channel_set_buffered(channel, FALSE);
+    ChannelReader channel_reader = { 0, 0 };
+    start = g_get_monotonic_time();
+    g_io_add_watch(channel, G_IO_IN | G_IO_HUP, channel_read_callback, &channel_reader);
+    g_main_loop_run(main_loop);
+    elapsed = g_get_monotonic_time() - start;
+    // 每次讀取之外，每次迴圈還有一次 poll
+    g_print("GIOChannel %10" G_GUINT64_FORMAT " bytes in %8" G_GUINT64_FORMAT " reads: %8.3f s, %8.1f MB/s, %8"
+            G_GUINT64_FORMAT " system calls\n", channel_reader.bytes, channel_reader.reads, elapsed / 1e6,
+            channel_reader.bytes / (elapsed / 1e6) / 1e6, channel_reader.reads * 2);
+    g_io_channel_unref(channel);
+}
+
+int main(int argc, char *argv[]) {
+    main_loop = g_main_loop_new(NULL, FALSE);
+
+    if (argc > 1 && g_strcmp0(argv[1], "--benchmark") == 0) {
+        if (argc < 3) {
+            g_printerr("Usage: %s --benchmark FILE\n", argv[0]);
+            return 1;
+        }
+        run_benchmark(argv[2]);
+    } else {
+        const gchar *path = argc > 1 ? argv[1] : __FILE__;
+        FileReader reader;
+        if (read_file_with_uring(path, READ_CHUNK, READ_DEPTH, &reader)) {
+            g_print("Read %" G_GUINT64_FORMAT " bytes from %s in %" G_GUINT64_FORMAT " chunks, %"
+                    G_GUINT64_FORMAT " io_uring_enter calls\n", reader.bytes, path, reader.chunks, reader.enter_calls);
+        }
+        run_echo_demo();
+    }
+
+    g_main_loop_unref(main_loop);
+    return 0;
+}
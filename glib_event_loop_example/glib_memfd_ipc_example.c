@@ -0,0 +1,669 @@
+/**
+ * @file glib_memfd_ipc_example.c
+ * @brief 以 memfd 共享記憶體與 SCM_RIGHTS 傳遞大型資料的行程間通道範例程式
+ *
+ * 以 pipe 或 socket 在兩個 GLib 行程之間傳送大型資料（例如爬取的網頁）時，
+ * 每個位元組都要複製兩次：送出端複製到核心，接收端再從核心複製出來。
+ *
+ * 此程式的 IpcChannel 以 UNIX SOCK_SEQPACKET socket 連接兩個行程，
+ * 但 socket 上只傳送幾十個位元組的描述：
+ * - 送出端從自己的區域池取得一塊 memfd 共享記憶體，直接把資料寫進去。
+ * - 區域第一次使用時，它的 fd 以 SCM_RIGHTS 隨描述一起傳給對方，
+ *   對方以唯讀方式 mmap 後保留，之後同一個區域只傳送編號、位移與長度。
+ * - 接收端以 IpcPayload 取得資料的檢視，不複製；可以 ipc_payload_ref() 保留到稍後處理，
+ *   最後一個參考釋放時送回 RELEASE，送出端收到後才重複使用這個區域。
+ * - socket 的讀取端是一個 g_unix_fd_source，兩個行程都在自己的事件迴圈中處理訊息。
+ *
+ * 區域池預設最多 IPC_MAX_REGIONS 個區域（max_regions）；全部使用中時 ipc_channel_alloc() 傳回 NULL，
+ * 送出端等收到 RELEASE 再繼續，接收端處理太慢時送出端自然會慢下來。
+ *
+ * 執行時以 fork() 建立接收端行程，傳送 8 個網頁大小的資料。以 --benchmark 執行時，
+ * 與經過 pipe 複製的方式比較 GB/s。
+ *
+ * 編譯方式：
+ * gcc -O2 -o glib_memfd_ipc_example glib_memfd_ipc_example.c `pkg-config --cflags --libs glib-2.0`
+ *
+ * 執行方式：
+ * ./glib_memfd_ipc_example
+ * ./glib_memfd_ipc_example --benchmark [每筆 KB] [筆數]
+ *
+ * 預期輸出：
+ * Consumer received page 1: 262144 bytes in region 0 "<html><body>page 1 ..."
+ * ...
+ * Consumer received page 8: 262144 bytes in region 3 "<html><body>page 8 ..."
+ * Producer: 8 payloads sent, 8 released, 4 regions, 4 file descriptors passed
+ *
+ * @author: Nelson Chung
+ * @date: 2024.11.23
+ */
+
+#define _GNU_SOURCE
+#include <glib.h>
+#include <glib-unix.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define IPC_MAX_REGIONS 32              // 每個通道最多的共享區域數
+#define IPC_REGION_MIN_SIZE (64 * 1024) // 區域大小是不小於此值的 2 的次方
+
+typedef enum {
+    IPC_PAYLOAD = 1,    // 區域中的一筆資料；區域第一次使用時附帶 fd
+    IPC_RELEASE,        // 接收端已處理完這個區域的資料
+} IpcMessageType;
+
+// socket 上傳送的描述
+typedef struct {
+    guint32 type;
+    guint32 region;
+    guint64 region_size;
+    guint64 offset;
+    guint64 length;
+    guint64 sequence;
+} IpcMessage;
+
+// 一塊 memfd 共享記憶體
+typedef struct {
+    guint32 id;
+    int fd;
+    guint8 *data;
+    gsize size;
+    gboolean in_use;         // 送出端：資料尚未被對方釋放
+    gboolean shared;         // 送出端：fd 已傳給對方
+    guint64 sequence;        // 送出端：區域中目前資料的序號
+} IpcRegion;
+
+typedef struct _IpcChannel IpcChannel;
+
+// 接收端取得的資料檢視；最後一個參考釋放時通知送出端
+// 資料指向通道 mmap 的區域，必須在 ipc_channel_free() 之前釋放
+typedef struct {
+    IpcChannel *channel;
+    guint32 region;
+    const guint8 *data;
+    gsize length;
+    guint64 sequence;
+    gint ref_count;
+} IpcPayload;
+
+typedef void (*IpcPayloadFunc)(IpcChannel *channel, IpcPayload *payload, gpointer user_data);
+typedef void (*IpcReleaseFunc)(IpcChannel *channel, gpointer user_data);
+typedef void (*IpcClosedFunc)(IpcChannel *channel, gpointer user_data);
+
+struct _IpcChannel {
+    int fd;
+    GSource *source;
+    GPtrArray *regions;       // 本端建立的區域，依編號排列
+    GPtrArray *peer_regions;  // 對方傳來並已 mmap 的區域，依編號排列
+    IpcPayloadFunc payload_func;
+    IpcReleaseFunc release_func;
+    IpcClosedFunc closed_func;
+    gpointer user_data;
+    guint max_regions;        // 區域池上限，預設 IPC_MAX_REGIONS
+    gboolean closed;
+    guint64 next_sequence;
+    guint64 sent;
+    guint64 received;
+    guint64 released;
+    guint fds_passed;
+    guint live_payloads;      // 尚未釋放的 IpcPayload
+};
+
+void ipc_payload_unref(IpcPayload *payload);
+
+static void ipc_region_free(IpcRegion *region) {
+    if (region->data) munmap(region->data, region->size);
+    if (region->fd >= 0) close(region->fd);
+    g_free(region);
+}
+
+static gboolean ipc_channel_send_message(IpcChannel *channel, const IpcMessage *message, int fd) {
+    union {
+        struct cmsghdr header;
+        gchar buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec iov = { (gpointer)message, sizeof(*message) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+    if (fd >= 0) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buffer;
+        msg.msg_controllen = sizeof(control.buffer);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    // 使用中的區域最多 IPC_MAX_REGIONS 個，未處理的描述不會填滿 socket 緩衝區，以阻塞模式送出即可
+    while (sendmsg(channel->fd, &msg, MSG_NOSIGNAL) < 0) {
+        if (errno == EINTR) continue;
+        g_printerr("sendmsg failed: %s\n", g_strerror(errno));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// 對方第一次使用一個區域：mmap 它傳來的 fd
+static IpcRegion* ipc_channel_map_peer_region(IpcChannel *channel, const IpcMessage *message, int fd) {
+    IpcRegion *region = g_new0(IpcRegion, 1);
+    region->id = message->region;
+    region->fd = -1;
+    region->size = message->region_size;
+    region->data = mmap(NULL, region->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // mapping 建立後就不需要 fd
+    if (region->data == MAP_FAILED) {
+        g_printerr("mmap failed: %s\n", g_strerror(errno));
+        g_free(region);
+        return NULL;
+    }
+
+    if (channel->peer_regions->len <= region->id) g_ptr_array_set_size(channel->peer_regions, region->id + 1);
+    if (g_ptr_array_index(channel->peer_regions, region->id)) {
+        ipc_region_free(g_ptr_array_index(channel->peer_regions, region->id));
+    }
+    g_ptr_array_index(channel->peer_regions, region->id) = region;
+    return region;
+}
+
+static void ipc_channel_handle(IpcChannel *channel, const IpcMessage *message, int fd) {
+    if (message->type == IPC_RELEASE) {
+        IpcRegion *region = message->region < channel->regions->len ?
+                            g_ptr_array_index(channel->regions, message->region) : NULL;
+        // 只接受對目前送出資料的釋放，重複或過期的釋放不能讓仍在使用的區域被重寫
+        if (region && region->in_use && region->sequence == message->sequence) {
+            region->in_use = FALSE;
+            channel->released++;
+            if (channel->release_func) channel->release_func(channel, channel->user_data);
+        } else {
+            g_printerr("Ignoring stale release of region %u (sequence %" G_GUINT64_FORMAT ")\n",
+                       message->region, message->sequence);
+        }
+        return;
+    }
+
+    IpcRegion *region = NULL;
+    if (fd >= 0) {
+        region = ipc_channel_map_peer_region(channel, message, fd);
+    } else if (message->region < channel->peer_regions->len) {
+        region = g_ptr_array_index(channel->peer_regions, message->region);
+    }
+    if (!region || !channel->payload_func || message->offset + message->length > region->size) {
+        g_printerr("Invalid payload descriptor for region %u\n", message->region);
+        return;
+    }
+
+    IpcPayload *payload = g_new(IpcPayload, 1);
+    payload->channel = channel;
+    payload->region = message->region;
+    payload->data = region->data + message->offset;
+    payload->length = message->length;
+    payload->sequence = message->sequence;
+    payload->ref_count = 1;
+    channel->live_payloads++;
+    channel->received++;
+
+    channel->payload_func(channel, payload, channel->user_data);
+    ipc_payload_unref(payload);
+}
+
+static void ipc_channel_close(IpcChannel *channel) {
+    channel->closed = TRUE;
+    if (channel->closed_func) channel->closed_func(channel, channel->user_data);
+}
+
+// socket 可讀：處理所有等待中的描述
+static gboolean ipc_channel_callback(gint fd, GIOCondition condition, gpointer user_data) {
+    IpcChannel *channel = user_data;
+
+    for (;;) {
+        IpcMessage message;
+        union {
+            struct cmsghdr header;
+            gchar buffer[CMSG_SPACE(sizeof(int))];
+        } control;
+        struct iovec iov = { &message, sizeof(message) };
+        struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1,
+                              .msg_control = control.buffer, .msg_controllen = sizeof(control.buffer) };
+
+        ssize_t got = recvmsg(fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0 && errno == EAGAIN) return G_SOURCE_CONTINUE;
+        if (got <= 0) {
+            if (got < 0) g_printerr("recvmsg failed: %s\n", g_strerror(errno));
+            break;
+        }
+
+        int passed_fd = -1;
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                memcpy(&passed_fd, CMSG_DATA(cmsg), sizeof(int));
+            }
+        }
+        if (got != sizeof(message) || (msg.msg_flags & MSG_CTRUNC)) {
+            g_printerr("Malformed message (%zd bytes), closing channel\n", got);
+            if (passed_fd >= 0) close(passed_fd);
+            break;
+        }
+        ipc_channel_handle(channel, &message, passed_fd);
+        if (channel->closed) break;
+    }
+
+    // 對方關閉或發生錯誤；傳回 FALSE 後 GLib 會釋放事件來源
+    g_source_unref(channel->source);
+    channel->source = NULL;
+    if (!channel->closed) ipc_channel_close(channel);
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * @brief 在已連線的 SOCK_SEQPACKET socket 上建立通道
+ *
+ * 同一個通道可以同時送出與接收。fd 由通道擁有，ipc_channel_free() 時關閉。
+ * 以 ipc_payload_ref() 保留的資料必須在 ipc_channel_free() 之前釋放，
+ * 通常在 closed_func 中釋放。
+ *
+ * @param payload_func 收到資料時的回呼；回呼結束後資料即釋放，除非以 ipc_payload_ref() 保留
+ * @param release_func 對方釋放一個區域時的回呼，可為 NULL
+ * @param closed_func 對方關閉通道時的回呼，可為 NULL
+ */
+IpcChannel* ipc_channel_new(int fd, GMainContext *context, IpcPayloadFunc payload_func,
+                            IpcReleaseFunc release_func, IpcClosedFunc closed_func, gpointer user_data) {
+    IpcChannel *channel = g_new0(IpcChannel, 1);
+    channel->fd = fd;
+    channel->regions = g_ptr_array_new_with_free_func((GDestroyNotify)ipc_region_free);
+    channel->peer_regions = g_ptr_array_new_with_free_func((GDestroyNotify)ipc_region_free);
+    channel->payload_func = payload_func;
+    channel->release_func = release_func;
+    channel->closed_func = closed_func;
+    channel->user_data = user_data;
+    channel->max_regions = IPC_MAX_REGIONS;
+
+    channel->source = g_unix_fd_source_new(fd, G_IO_IN);
+    g_source_set_callback(channel->source, (GSourceFunc)ipc_channel_callback, channel, NULL);
+    g_source_set_name(channel->source, "IpcChannel");
+    g_source_attach(channel->source, context);
+    return channel;
+}
+
+void ipc_channel_free(IpcChannel *channel) {
+    // 仍被保留的資料指向即將 munmap 的區域，並會在釋放時存取通道
+    g_return_if_fail(channel->live_payloads == 0);
+    if (channel->source) {
+        g_source_destroy(channel->source);
+        g_source_unref(channel->source);
+    }
+    g_ptr_array_free(channel->regions, TRUE);
+    g_ptr_array_free(channel->peer_regions, TRUE);
+    close(channel->fd);
+    g_free(channel);
+}
+
+/**
+ * @brief 取得一塊可寫入至少 length 位元組的共享記憶體
+ *
+ * 寫入後以 ipc_channel_send() 送出。
+ *
+ * @return 區域的起點；區域池全部使用中時傳回 NULL，收到 release_func 後再試
+ */
+guint8* ipc_channel_alloc(IpcChannel *channel, gsize length, guint32 *region_id) {
+    for (guint i = 0; i < channel->regions->len; i++) {
+        IpcRegion *region = g_ptr_array_index(channel->regions, i);
+        if (!region->in_use && region->size >= length) {
+            region->in_use = TRUE;
+            *region_id = region->id;
+            return region->data;
+        }
+    }
+    if (channel->regions->len >= channel->max_regions) return NULL;
+
+    gsize size = IPC_REGION_MIN_SIZE;
+    while (size < length) size *= 2;
+    int fd = memfd_create("ipc-region", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, size) < 0) {
+        g_printerr("Cannot create shared region: %s\n", g_strerror(errno));
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    guint8 *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        g_printerr("mmap failed: %s\n", g_strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    IpcRegion *region = g_new0(IpcRegion, 1);
+    region->id = channel->regions->len;
+    region->fd = fd;
+    region->data = data;
+    region->size = size;
+    region->in_use = TRUE;
+    g_ptr_array_add(channel->regions, region);
+    *region_id = region->id;
+    return data;
+}
+
+/**
+ * @brief 送出以 ipc_channel_alloc() 取得並已寫入的資料
+ *
+ * 區域在對方釋放之前不能再寫入。
+ */
+gboolean ipc_channel_send(IpcChannel *channel, guint32 region_id, gsize length) {
+    IpcRegion *region = g_ptr_array_index(channel->regions, region_id);
+    IpcMessage message = {
+        .type = IPC_PAYLOAD,
+        .region = region_id,
+        .region_size = region->size,
+        .offset = 0,
+        .length = MIN(length, region->size),
+        .sequence = channel->next_sequence++,
+    };
+    region->sequence = message.sequence;
+
+    // 區域第一次送出時附帶 fd，之後只送描述
+    if (!ipc_channel_send_message(channel, &message, region->shared ? -1 : region->fd)) return FALSE;
+    if (!region->shared) {
+        region->shared = TRUE;
+        channel->fds_passed++;
+    }
+    channel->sent++;
+    return TRUE;
+}
+
+IpcPayload* ipc_payload_ref(IpcPayload *payload) {
+    payload->ref_count++;
+    return payload;
+}
+
+// 釋放一個參考；最後一個參考釋放時通知送出端可以重複使用區域
+void ipc_payload_unref(IpcPayload *payload) {
+    if (--payload->ref_count > 0) return;
+    IpcChannel *channel = payload->channel;
+    if (!channel->closed) {
+        IpcMessage message = { .type = IPC_RELEASE, .region = payload->region, .sequence = payload->sequence };
+        ipc_channel_send_message(channel, &message, -1);
+    }
+    channel->live_payloads--;
+    g_free(payload);
+}
+
+// 示範：送出端產生網頁，接收端印出每一頁的開頭
+#define DEMO_PAGES 8
+#define DEMO_PAGE_SIZE (256 * 1024)
+
+typedef struct {
+    GMainLoop *loop;
+    IpcChannel *channel;
+    guint total;
+    gsize size;
+    guint produced;
+    guint64 checksum;        // 送出端寫入的、接收端讀到的資料的 XOR
+    gboolean benchmark;
+    GQueue held;             // 接收端暫時保留的資料
+} IpcState;
+
+// 以 64 位元字組填入資料，並累計 XOR
+static guint64 fill_payload(guint8 *data, gsize length, guint64 sequence) {
+    guint64 *words = (guint64 *)data;
+    guint64 checksum = 0;
+    for (gsize i = 0; i < length / sizeof(guint64); i++) {
+        words[i] = sequence * G_GUINT64_CONSTANT(0x9e3779b97f4a7c15) + i;
+        checksum ^= words[i];
+    }
+    return checksum;
+}
+
+static guint64 payload_checksum(const guint8 *data, gsize length) {
+    const guint64 *words = (const guint64 *)data;
+    guint64 checksum = 0;
+    for (gsize i = 0; i < length / sizeof(guint64); i++) {
+        checksum ^= words[i];
+    }
+    return checksum;
+}
+
+// 送出端：區域池有空位就繼續送
+static void produce(IpcState *state) {
+    while (state->produced < state->total) {
+        guint32 region;
+        guint8 *data = ipc_channel_alloc(state->channel, state->size, &region);
+        if (!data) return; // 等對方釋放區域
+
+        if (state->benchmark) {
+            state->checksum ^= fill_payload(data, state->size, state->produced);
+        } else {
+            memset(data, ' ', state->size);
+            gint n = g_snprintf((gchar *)data, state->size, "<html><body>page %u ...", state->produced + 1);
+            data[n] = ' ';
+        }
+        if (!ipc_channel_send(state->channel, region, state->size)) {
+            g_main_loop_quit(state->loop);
+            return;
+        }
+        state->produced++;
+    }
+}
+
+void producer_release(IpcChannel *channel, gpointer user_data) {
+    IpcState *state = user_data;
+    produce(state);
+    if (channel->released == state->total) g_main_loop_quit(state->loop);
+}
+
+void producer_closed(IpcChannel *channel, gpointer user_data) {
+    IpcState *state = user_data;
+    g_printerr("Consumer closed the channel early\n");
+    g_main_loop_quit(state->loop);
+}
+
+// 示範的接收端：保留兩頁再一起釋放，展示參考計數
+void consumer_payload(IpcChannel *channel, IpcPayload *payload, gpointer user_data) {
+    IpcState *state = user_data;
+
+    if (state->benchmark) {
+        state->checksum ^= payload_checksum(payload->data, payload->length);
+        return;
+    }
+
+    g_print("Consumer received page %" G_GUINT64_FORMAT ": %" G_GSIZE_FORMAT " bytes in region %u \"%.22s\"\n",
+            payload->sequence + 1, payload->length, payload->region, (const gchar *)payload->data);
+    g_queue_push_tail(&state->held, ipc_payload_ref(payload));
+    if (state->held.length == 2) {
+        while (!g_queue_is_empty(&state->held)) ipc_payload_unref(g_queue_pop_head(&state->held));
+    }
+}
+
+void consumer_closed(IpcChannel *channel, gpointer user_data) {
+    IpcState *state = user_data;
+    // 通道關閉後不再送出釋放，但保留的資料仍要在 ipc_channel_free() 前釋放
+    while (!g_queue_is_empty(&state->held)) ipc_payload_unref(g_queue_pop_head(&state->held));
+    g_main_loop_quit(state->loop);
+}
+
+/**
+ * @brief 接收端行程：處理到送出端關閉通道為止，把 checksum 寫入 result_fd
+ */
+static void run_consumer(int fd, int result_fd, gboolean benchmark) {
+    GMainContext *context = g_main_context_new();
+    IpcState state = { g_main_loop_new(context, FALSE) };
+    state.benchmark = benchmark;
+    g_queue_init(&state.held);
+    state.channel = ipc_channel_new(fd, context, consumer_payload, NULL, consumer_closed, &state);
+
+    g_main_loop_run(state.loop);
+    if (write(result_fd, &state.checksum, sizeof(state.checksum)) < 0) {
+        g_printerr("write failed: %s\n", g_strerror(errno));
+    }
+
+    ipc_channel_free(state.channel);
+    g_main_loop_unref(state.loop);
+    g_main_context_unref(context);
+}
+
+/**
+ * @brief 以 fork() 建立接收端行程，送出 total 筆 size 位元組的資料
+ *
+ * @return 接收端的 checksum 與送出端相符時傳回 TRUE
+ */
+static gboolean run_memfd(guint total, gsize size, gboolean benchmark) {
+    int sockets[2], result[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) < 0 || pipe(result) < 0) {
+        g_printerr("socketpair failed: %s\n", g_strerror(errno));
+        return FALSE;
+    }
+
+    // fork() 時還沒有任何 GLib 執行緒與 context，子行程可以安全地建立自己的事件迴圈
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(sockets[0]);
+        close(result[0]);
+        run_consumer(sockets[1], result[1], benchmark);
+        _exit(0);
+    }
+    close(sockets[1]);
+    close(result[1]);
+
+    GMainContext *context = g_main_context_new();
+    IpcState state = { g_main_loop_new(context, FALSE) };
+    state.total = total;
+    state.size = size;
+    state.benchmark = benchmark;
+    state.channel = ipc_channel_new(sockets[0], context, NULL, producer_release, producer_closed, &state);
+    // 示範時縮小區域池，讓區域在釋放後重複使用
+    if (!benchmark) state.channel->max_regions = 4;
+
+    produce(&state);
+    g_main_loop_run(state.loop);
+
+    if (!benchmark) {
+        g_print("Producer: %" G_GUINT64_FORMAT " payloads sent, %" G_GUINT64_FORMAT " released, %u regions, %u file descriptors passed\n",
+                state.channel->sent, state.channel->released, state.channel->regions->len, state.channel->fds_passed);
+    }
+    // 關閉通道，接收端收到 EOF 後結束
+    ipc_channel_free(state.channel);
+    g_main_loop_unref(state.loop);
+    g_main_context_unref(context);
+
+    guint64 consumer_checksum = 0;
+    gboolean ok = read(result[0], &consumer_checksum, sizeof(consumer_checksum)) == sizeof(consumer_checksum) &&
+                  consumer_checksum == state.checksum;
+    close(result[0]);
+    waitpid(pid, NULL, 0);
+    return ok;
+}
+
+// 量測的比較基準：長度加資料，經過 pipe 複製兩次
+typedef struct {
+    GMainLoop *loop;
+    guint8 *buffer;
+    gsize size;
+    gsize filled;
+    guint64 checksum;
+} PipeConsumer;
+
+gboolean pipe_consumer_callback(gint fd, GIOCondition condition, gpointer user_data) {
+    PipeConsumer *consumer = user_data;
+
+    for (;;) {
+        ssize_t got = read(fd, consumer->buffer + consumer->filled, consumer->size - consumer->filled);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0 && errno == EAGAIN) return G_SOURCE_CONTINUE;
+        if (got <= 0) break;
+        consumer->filled += got;
+        if (consumer->filled == consumer->size) {
+            consumer->checksum ^= payload_checksum(consumer->buffer, consumer->size);
+            consumer->filled = 0;
+        }
+    }
+    g_main_loop_quit(consumer->loop);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean run_pipe(guint total, gsize size) {
+    int data[2], result[2];
+    if (pipe(data) < 0 || pipe(result) < 0) {
+        g_printerr("pipe failed: %s\n", g_strerror(errno));
+        return FALSE;
+    }
+    fcntl(data[1], F_SETPIPE_SZ, 1024 * 1024);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(data[1]);
+        close(result[0]);
+        fcntl(data[0], F_SETFL, O_NONBLOCK);
+        GMainContext *context = g_main_context_new();
+        PipeConsumer consumer = { g_main_loop_new(context, FALSE), g_malloc(size), size };
+        GSource *source = g_unix_fd_source_new(data[0], G_IO_IN | G_IO_HUP);
+        g_source_set_callback(source, (GSourceFunc)pipe_consumer_callback, &consumer, NULL);
+        g_source_attach(source, context);
+        g_source_unref(source);
+        g_main_loop_run(consumer.loop);
+        if (write(result[1], &consumer.checksum, sizeof(consumer.checksum)) < 0) _exit(1);
+        _exit(0);
+    }
+    close(data[0]);
+    close(result[1]);
+
+    // 每筆資料大小固定，接收端以大小分隔，不需要長度標頭
+    guint8 *buffer = g_malloc(size);
+    guint64 checksum = 0;
+    for (guint i = 0; i < total; i++) {
+        checksum ^= fill_payload(buffer, size, i);
+        gsize written = 0;
+        while (written < size) {
+            ssize_t n = write(data[1], buffer + written, size - written);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                g_printerr("write failed: %s\n", g_strerror(errno));
+                break;
+            }
+            written += n;
+        }
+    }
+    close(data[1]);
+    g_free(buffer);
+
+    guint64 consumer_checksum = 0;
+    gboolean ok = read(result[0], &consumer_checksum, sizeof(consumer_checksum)) == sizeof(consumer_checksum) &&
+                  consumer_checksum == checksum;
+    close(result[0]);
+    waitpid(pid, NULL, 0);
+    return ok;
+}
+
+static void run_benchmark(gsize size, guint total) {
+    size = MAX(size / sizeof(guint64), 1) * sizeof(guint64);
+    g_print("%u payloads x %" G_GSIZE_FORMAT " KB (%.1f MB)\n", total, size / 1024, (gdouble)size * total / 1e6);
+
+    for (int memfd = 1; memfd >= 0; memfd--) {
+        gint64 start = g_get_monotonic_time();
+        gboolean ok = memfd ? run_memfd(total, size, TRUE) : run_pipe(total, size);
+        gdouble seconds = (g_get_monotonic_time() - start) / 1e6;
+        g_print("%-6s %7.2f s, %6.2f GB/s, %8.0f payloads/s, checksum %s\n",
+                memfd ? "memfd" : "pipe", seconds, (gdouble)size * total / 1e9 / seconds, total / seconds,
+                ok ? "ok" : "MISMATCH");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && g_strcmp0(argv[1], "--benchmark") == 0) {
+        gsize size_kb = argc > 2 ? (gsize)atoi(argv[2]) : 1024;
+        guint total = argc > 3 ? (guint)atoi(argv[3]) : 2000;
+        run_benchmark(MAX(size_kb, 1) * 1024, MAX(total, 1));
+        return 0;
+    }
+
+    if (!run_memfd(DEMO_PAGES, DEMO_PAGE_SIZE, FALSE)) {
+        g_printerr("Consumer did not finish cleanly\n");
+        return 1;
+    }
+    return 0;
+}
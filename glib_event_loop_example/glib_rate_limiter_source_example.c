@@ -0,0 +1,410 @@
+/**
+ * @file glib_rate_limiter_source_example.c
+ * @brief 以單一 GSource 管理多個 token bucket 的限速器範例程式
+ *
+ * 臨時的限速做法是每個請求算好該等多久，再各自 g_timeout_add() 一個計時器；
+ * 排隊的請求一多，事件迴圈上就有成千上萬個來源，每次迴圈都要全部走訪。
+ *
+ * 此程式的 RateLimiterSource 在一個自訂事件來源中管理任意數量的 token bucket，
+ * 每個 key（例如主機或用戶端）一個：
+ * - 每個 bucket 每秒補充 rate 個 token，最多累積 burst 個；token 在需要時才依經過的時間計算。
+ * - 排隊的回呼依 key 進入各自 bucket 的佇列，有 token 時依序 dispatch。
+ * - 有排隊請求的 bucket 依「下一個 token 可用的時間」排序，以 g_source_set_ready_time()
+ *   讓迴圈剛好睡到最早的那個時間，不需要每個 key 一個計時器。
+ * - 佇列清空且 token 補滿的 bucket 會自動釋放；以 rate_limiter_set_limit() 設定的個別速率
+ *   另外保存，bucket 重新建立時沿用。
+ *
+ * 執行時三個主機各排入 6 個請求（每秒 5 個、burst 2），印出每個請求 dispatch 的時間。
+ * 以 --benchmark 執行時，與每個請求一個 g_timeout_add() 比較。
+ *
+ * 編譯方式：
+ * gcc -O2 -o glib_rate_limiter_source_example glib_rate_limiter_source_example.c `pkg-config --cflags --libs glib-2.0`
+ *
+ * 執行方式：
+ * ./glib_rate_limiter_source_example
+ * ./glib_rate_limiter_source_example --benchmark [key 數量] [每個 key 的請求數]
+ *
+ * 預期輸出：
+ * [   0 ms] a.example request 1
+ * [   0 ms] a.example request 2
+ * [   0 ms] b.example request 1
+ * ...
+ * [ 200 ms] a.example request 3
+ * ...
+ * [ 800 ms] c.example request 6
+ * All requests dispatched, exiting...
+ *
+ * @author: Nelson Chung
+ * @date: 2024.11.23
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// 排隊中的回呼
+typedef struct {
+    GSourceFunc func;
+    gpointer data;
+    GDestroyNotify notify;
+} RateRequest;
+
+typedef struct {
+    gchar *key;
+    gdouble rate;              // 每秒補充的 token 數
+    gdouble burst;             // 最多累積的 token 數
+    gdouble tokens;
+    gint64 refilled;           // 上次計算 token 的時間
+    GQueue pending;            // RateRequest
+    gint64 due;                // 下一次需要處理的時間：有 token 可用，或 bucket 可以釋放
+    GSequenceIter *iter;       // 在 schedule 中的位置，NULL 表示不在排程中
+} RateBucket;
+
+// 以 rate_limiter_set_limit() 設定的個別速率
+typedef struct {
+    gdouble rate;
+    gdouble burst;
+} RateLimit;
+
+// 限速器事件來源的結構體
+typedef struct {
+    GSource source;            // 基礎 GSource 結構
+    gdouble rate;              // 新 bucket 的預設值
+    gdouble burst;
+    GHashTable *buckets;       // key -> RateBucket
+    GHashTable *limits;        // key -> RateLimit，bucket 釋放後仍保留
+    GSequence *schedule;       // 依 due 排序的 bucket
+    guint64 dispatched;
+} RateLimiterSource;
+
+static void rate_request_free(RateRequest *request) {
+    if (request->notify) request->notify(request->data);
+    g_free(request);
+}
+
+static void rate_bucket_free(RateBucket *bucket) {
+    g_queue_clear_full(&bucket->pending, (GDestroyNotify)rate_request_free);
+    g_free(bucket->key);
+    g_free(bucket);
+}
+
+static void bucket_refill(RateBucket *bucket, gint64 now) {
+    bucket->tokens = MIN(bucket->burst, bucket->tokens + (now - bucket->refilled) * bucket->rate / G_USEC_PER_SEC);
+    bucket->refilled = now;
+}
+
+static gint bucket_compare(gconstpointer a, gconstpointer b, gpointer user_data) {
+    const RateBucket *bucket_a = a, *bucket_b = b;
+    if (bucket_a->due != bucket_b->due) return bucket_a->due < bucket_b->due ? -1 : 1;
+    return bucket_a < bucket_b ? -1 : bucket_a > bucket_b;
+}
+
+// 依最早的 due 設定喚醒時間，沒有排程時不喚醒
+static void limiter_update_ready_time(RateLimiterSource *limiter) {
+    GSequenceIter *first = g_sequence_get_begin_iter(limiter->schedule);
+    if (g_sequence_iter_is_end(first)) {
+        g_source_set_ready_time(&limiter->source, -1);
+    } else {
+        g_source_set_ready_time(&limiter->source, ((RateBucket *)g_sequence_get(first))->due);
+    }
+}
+
+// 重新排程 bucket：有排隊的請求時排到下一個 token 可用，否則排到 token 補滿時釋放
+static void limiter_schedule(RateLimiterSource *limiter, RateBucket *bucket, gint64 now) {
+    if (bucket->iter) {
+        g_sequence_remove(bucket->iter);
+        bucket->iter = NULL;
+    }
+
+    gdouble missing = g_queue_is_empty(&bucket->pending) ? bucket->burst - bucket->tokens : 1.0 - bucket->tokens;
+    // 無條件進位到微秒，醒來時 token 一定已經足夠
+    bucket->due = now + (missing > 0 ? (gint64)(missing * G_USEC_PER_SEC / bucket->rate) + 1 : 0);
+    bucket->iter = g_sequence_insert_sorted(limiter->schedule, bucket, bucket_compare, NULL);
+}
+
+static RateBucket* limiter_get_bucket(RateLimiterSource *limiter, const gchar *key, gint64 now) {
+    RateBucket *bucket = g_hash_table_lookup(limiter->buckets, key);
+    if (!bucket) {
+        RateLimit *limit = g_hash_table_lookup(limiter->limits, key);
+        bucket = g_new0(RateBucket, 1);
+        bucket->key = g_strdup(key);
+        bucket->rate = limit ? limit->rate : limiter->rate;
+        bucket->burst = limit ? limit->burst : limiter->burst;
+        bucket->tokens = bucket->burst; // 新的 key 可以立即使用整個 burst
+        bucket->refilled = now;
+        g_queue_init(&bucket->pending);
+        g_hash_table_insert(limiter->buckets, bucket->key, bucket);
+    }
+    return bucket;
+}
+
+// 限速器事件來源的回呼函式：處理所有已到時間的 bucket
+gboolean rate_limiter_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+    RateLimiterSource *limiter = (RateLimiterSource *)source;
+    gint64 now = g_get_monotonic_time();
+
+    // 先取出所有到期的 bucket，回呼中新增的請求不會讓這次 dispatch 無止境地執行下去
+    GPtrArray *due = g_ptr_array_new();
+    GSequenceIter *iter = g_sequence_get_begin_iter(limiter->schedule);
+    while (!g_sequence_iter_is_end(iter)) {
+        RateBucket *bucket = g_sequence_get(iter);
+        if (bucket->due > now) break;
+        GSequenceIter *next = g_sequence_iter_next(iter);
+        g_sequence_remove(iter);
+        bucket->iter = NULL;
+        g_ptr_array_add(due, bucket);
+        iter = next;
+    }
+
+    for (guint i = 0; i < due->len; i++) {
+        RateBucket *bucket = g_ptr_array_index(due, i);
+        bucket_refill(bucket, now);
+
+        while (bucket->tokens >= 1.0 && !g_queue_is_empty(&bucket->pending)) {
+            RateRequest *request = g_queue_pop_head(&bucket->pending);
+            bucket->tokens -= 1.0;
+            limiter->dispatched++;
+            if (request->func) request->func(request->data);
+            rate_request_free(request);
+        }
+
+        // 回呼中排入同一個 key 時，rate_limiter_enqueue() 已經重新排程過
+        if (bucket->iter) continue;
+        if (g_queue_is_empty(&bucket->pending) && bucket->tokens >= bucket->burst) {
+            g_hash_table_remove(limiter->buckets, bucket->key);
+        } else {
+            limiter_schedule(limiter, bucket, now);
+        }
+    }
+    g_ptr_array_free(due, TRUE);
+
+    limiter_update_ready_time(limiter);
+    return TRUE; // 限速器事件來源一直保留
+}
+
+// 限速器事件來源的結束函式：尚未 dispatch 的請求只呼叫 notify
+void rate_limiter_finalize(GSource *source) {
+    RateLimiterSource *limiter = (RateLimiterSource *)source;
+    g_sequence_free(limiter->schedule);
+    g_hash_table_destroy(limiter->buckets);
+    g_hash_table_destroy(limiter->limits);
+}
+
+// 沒有 prepare 與 check：以 ready time 決定何時 dispatch
+static GSourceFuncs rate_limiter_funcs = {
+    .prepare = NULL,
+    .check = NULL,
+    .dispatch = rate_limiter_dispatch,
+    .finalize = rate_limiter_finalize,
+};
+
+/**
+ * @brief 建立限速器事件來源，需要再以 g_source_attach() 附加到事件迴圈
+ *
+ * @param rate 每個 key 每秒最多 dispatch 的回呼數
+ * @param burst 每個 key 最多可以連續 dispatch 的回呼數，至少為 1
+ */
+GSource* rate_limiter_source_new(gdouble rate, gdouble burst) {
+    RateLimiterSource *limiter = (RateLimiterSource *)g_source_new(&rate_limiter_funcs, sizeof(RateLimiterSource));
+    limiter->rate = rate > 0 ? rate : 1.0;
+    limiter->burst = MAX(burst, 1.0);
+    limiter->buckets = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)rate_bucket_free);
+    limiter->limits = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    limiter->schedule = g_sequence_new(NULL);
+    g_source_set_name(&limiter->source, "RateLimiterSource");
+    return &limiter->source;
+}
+
+/**
+ * @brief 設定某個 key 的速率與 burst，取代建立事件來源時的預設值
+ *
+ * 設定一直有效，key 閒置、bucket 被釋放後再排入請求時仍然沿用。
+ */
+void rate_limiter_set_limit(GSource *source, const gchar *key, gdouble rate, gdouble burst) {
+    RateLimiterSource *limiter = (RateLimiterSource *)source;
+    RateLimit *limit = g_new(RateLimit, 1);
+    limit->rate = rate > 0 ? rate : 1.0;
+    limit->burst = MAX(burst, 1.0);
+    g_hash_table_replace(limiter->limits, g_strdup(key), limit);
+
+    gint64 now = g_get_monotonic_time();
+    RateBucket *bucket = limiter_get_bucket(limiter, key, now);
+    bucket_refill(bucket, now);
+    bucket->rate = limit->rate;
+    bucket->burst = limit->burst;
+    bucket->tokens = MIN(bucket->tokens, bucket->burst);
+    limiter_schedule(limiter, bucket, now);
+    limiter_update_ready_time(limiter);
+}
+
+/**
+ * @brief 在 key 的限速內排入一個回呼；func 的傳回值會被忽略
+ *
+ * 必須在執行事件來源的執行緒上呼叫，回呼中也可以呼叫。
+ */
+void rate_limiter_enqueue(GSource *source, const gchar *key, GSourceFunc func, gpointer data, GDestroyNotify notify) {
+    RateLimiterSource *limiter = (RateLimiterSource *)source;
+    gint64 now = g_get_monotonic_time();
+    RateBucket *bucket = limiter_get_bucket(limiter, key, now);
+
+    RateRequest *request = g_new(RateRequest, 1);
+    request->func = func;
+    request->data = data;
+    request->notify = notify;
+    g_queue_push_tail(&bucket->pending, request);
+
+    // 只有第一個排隊的請求需要重新排程，之後的請求跟著佇列前進
+    if (bucket->pending.length == 1) {
+        bucket_refill(bucket, now);
+        limiter_schedule(limiter, bucket, now);
+        limiter_update_ready_time(limiter);
+    }
+}
+
+guint rate_limiter_get_n_keys(GSource *source) {
+    return g_hash_table_size(((RateLimiterSource *)source)->buckets);
+}
+
+// 示範
+static GMainLoop *main_loop = NULL;
+static gint64 demo_start = 0;
+static guint demo_remaining = 0;
+
+typedef struct {
+    const gchar *host;
+    guint index;
+} DemoRequest;
+
+gboolean demo_request_callback(gpointer data) {
+    DemoRequest *request = data;
+    g_print("[%4" G_GINT64_FORMAT " ms] %s request %u\n", (g_get_monotonic_time() - demo_start) / 1000,
+            request->host, request->index);
+    if (--demo_remaining == 0) {
+        g_print("All requests dispatched, exiting...\n");
+        g_main_loop_quit(main_loop);
+    }
+    return FALSE;
+}
+
+static void run_demo(void) {
+    static const gchar *hosts[] = { "a.example", "b.example", "c.example" };
+    main_loop = g_main_loop_new(NULL, FALSE);
+    GSource *limiter = rate_limiter_source_new(5, 2);
+    g_source_attach(limiter, NULL);
+
+    demo_start = g_get_monotonic_time();
+    for (guint i = 1; i <= 6; i++) {
+        for (guint h = 0; h < G_N_ELEMENTS(hosts); h++) {
+            DemoRequest *request = g_new(DemoRequest, 1);
+            request->host = hosts[h];
+            request->index = i;
+            rate_limiter_enqueue(limiter, hosts[h], demo_request_callback, request, g_free);
+            demo_remaining++;
+        }
+    }
+
+    g_main_loop_run(main_loop);
+    g_source_destroy(limiter);
+    g_source_unref(limiter);
+    g_main_loop_unref(main_loop);
+}
+
+// 量測：keys 個 key 各排入 requests 個請求，每個 key 每秒 100 個、burst 1
+#define BENCH_RATE 100
+
+typedef struct {
+    guint remaining;
+    guint64 dispatched;
+    gint64 lateness_sum;
+} BenchState;
+
+typedef struct {
+    BenchState *state;
+    gint64 due;
+} BenchRequest;
+
+gboolean bench_callback(gpointer data) {
+    BenchRequest *request = data;
+    request->state->remaining--;
+    request->state->dispatched++;
+    request->state->lateness_sum += MAX(g_get_monotonic_time() - request->due, 0);
+    return FALSE;
+}
+
+static gdouble cpu_seconds(void) {
+    return (gdouble)clock() / CLOCKS_PER_SEC;
+}
+
+static void run_benchmark(guint keys, guint requests, gboolean use_limiter) {
+    GMainContext *context = g_main_context_new();
+    BenchState state = { keys * requests, 0, 0 };
+    BenchRequest *pending = g_new(BenchRequest, (gsize)keys * requests);
+    GSource *limiter = NULL;
+    gchar key[32];
+
+    if (use_limiter) {
+        limiter = rate_limiter_source_new(BENCH_RATE, 1);
+        g_source_attach(limiter, context);
+    }
+
+    gdouble cpu_start = cpu_seconds();
+    gint64 start = g_get_monotonic_time();
+    for (guint k = 0; k < keys; k++) {
+        g_snprintf(key, sizeof(key), "client-%u", k);
+        for (guint i = 0; i < requests; i++) {
+            BenchRequest *request = &pending[(gsize)k * requests + i];
+            request->state = &state;
+            request->due = start + (gint64)i * G_USEC_PER_SEC / BENCH_RATE;
+            if (use_limiter) {
+                rate_limiter_enqueue(limiter, key, bench_callback, request, NULL);
+            } else {
+                // 臨時做法：每個請求算好自己的時間，各一個計時器
+                GSource *timeout = g_timeout_source_new(i * 1000 / BENCH_RATE);
+                g_source_set_callback(timeout, bench_callback, request, NULL);
+                g_source_attach(timeout, context);
+                g_source_unref(timeout);
+            }
+        }
+    }
+    gint64 queued = g_get_monotonic_time();
+
+    guint iterations = 0;
+    while (state.remaining > 0) {
+        g_main_context_iteration(context, TRUE);
+        iterations++;
+    }
+    gint64 end = g_get_monotonic_time();
+    gdouble cpu = cpu_seconds() - cpu_start;
+
+    g_print("%-10s %6u keys x %4u: enqueue %7.1f ns, run %6.3f s wall / %6.3f s CPU, %7u wakeups, "
+            "lateness avg %.2f ms\n",
+            use_limiter ? "limiter" : "g_timeout", keys, requests,
+            (gdouble)(queued - start) * 1000 / ((gdouble)keys * requests), (end - start) / 1e6, cpu, iterations,
+            state.lateness_sum / 1000.0 / state.dispatched);
+
+    if (limiter) {
+        g_source_destroy(limiter);
+        g_source_unref(limiter);
+    }
+    g_free(pending);
+    g_main_context_unref(context);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && g_strcmp0(argv[1], "--benchmark") == 0) {
+        guint keys = argc > 2 ? (guint)atoi(argv[2]) : 10000;
+        guint requests = argc > 3 ? (guint)atoi(argv[3]) : 20;
+        if (keys == 0 || requests == 0) {
+            g_printerr("Usage: %s --benchmark [keys] [requests-per-key]\n", argv[0]);
+            return 1;
+        }
+        run_benchmark(keys, requests, TRUE);
+        run_benchmark(keys, requests, FALSE);
+        return 0;
+    }
+
+    run_demo();
+    return 0;
+}
@@ -0,0 +1,454 @@
+/**
+ * @file glib_sharded_event_loops_example.c
+ * @brief 每個 CPU 核心一個 GMainContext 的分片事件迴圈範例程式
+ *
+ * glib_event_loop_example.c 只有一個 GMainLoop，所有事件來源都在同一個執行緒上
+ * dispatch，事件驅動的服務最多只能用到一個核心。
+ *
+ * 此程式的 ShardedRuntime 為每個核心建立一個 GMainContext 與 GMainLoop，
+ * 各自在固定到該核心的執行緒上執行：
+ * - sharded_runtime_attach() 把事件來源（例如一個連線）附加到目前負載最低的分片，
+ *   之後這個來源的所有回呼都在該分片的執行緒上執行，不需要加鎖。
+ * - loop_shard_post() 把工作交給另一個分片執行，分片之間只以這種方式溝通。
+ * - 負載以每個分片上的來源數量計算，來源結束時以 loop_shard_release() 歸還。
+ *
+ * 執行時建立 16 個模擬連線，分配到各分片，每個連線定期把訊息轉送給
+ * 另一個分片上的連線。以 --benchmark 執行時，比較 1 個與全部分片處理
+ * 相同 CPU 工作量的時間，並量測分片之間來回傳遞的延遲。
+ *
+ * 編譯方式：
+ * gcc -O2 -o glib_sharded_event_loops_example glib_sharded_event_loops_example.c `pkg-config --cflags --libs glib-2.0`
+ *
+ * 執行方式：
+ * ./glib_sharded_event_loops_example [分片數]
+ * ./glib_sharded_event_loops_example --benchmark [分片數]
+ *
+ * 預期輸出：
+ * Started 4 shards
+ * Connection 0 -> shard 0
+ * Connection 1 -> shard 1
+ * ...
+ * Shard 0 (CPU 0): 4 connections, 20 ticks, 20 messages received
+ * ...
+ * All shards stopped, exiting...
+ *
+ * @author: Nelson Chung
+ * @date: 2024.11.23
+ */
+
+#define _GNU_SOURCE
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+
+// 一個分片：一個 GMainContext 與執行它的執行緒
+typedef struct {
+    guint index;
+    gint cpu;                // 固定的 CPU，-1 表示未固定
+    GMainContext *context;
+    GMainLoop *loop;
+    GThread *thread;
+    gint load;               // 附加在此分片上的來源數量（atomic）
+} LoopShard;
+
+typedef struct {
+    guint n_shards;
+    LoopShard *shards;
+} ShardedRuntime;
+
+gpointer shard_thread(gpointer data) {
+    LoopShard *shard = data;
+
+    // 固定到一個核心：分片的快取與資料都留在同一個核心上
+    if (shard->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(shard->cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0) {
+            g_printerr("Shard %u: cannot pin to CPU %d: %s\n", shard->index, shard->cpu, g_strerror(err));
+            shard->cpu = -1;
+        }
+    }
+
+    // 此執行緒上新建立的來源（例如 g_timeout_add）預設都附加到分片自己的 context
+    g_main_context_push_thread_default(shard->context);
+    g_main_loop_run(shard->loop);
+    g_main_context_pop_thread_default(shard->context);
+    return NULL;
+}
+
+/**
+ * @brief 啟動 n_shards 個分片，0 表示每個核心一個
+ */
+ShardedRuntime* sharded_runtime_new(guint n_shards) {
+    // 行程可用的核心不一定是 0..n-1（taskset、cgroup cpuset），依 sched_getaffinity() 取得
+    cpu_set_t allowed;
+    gint cpus[CPU_SETSIZE];
+    guint n_cpus = 0;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (gint cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) cpus[n_cpus++] = cpu;
+        }
+    } else {
+        g_printerr("sched_getaffinity failed: %s\n", g_strerror(errno));
+    }
+
+    ShardedRuntime *runtime = g_new0(ShardedRuntime, 1);
+    runtime->n_shards = n_shards > 0 ? n_shards : MAX(n_cpus, 1);
+    runtime->shards = g_new0(LoopShard, runtime->n_shards);
+
+    for (guint i = 0; i < runtime->n_shards; i++) {
+        LoopShard *shard = &runtime->shards[i];
+        shard->index = i;
+        // 分片比可用核心多時不固定，交給排程器
+        shard->cpu = runtime->n_shards <= n_cpus ? cpus[i] : -1;
+        shard->context = g_main_context_new();
+        shard->loop = g_main_loop_new(shard->context, FALSE);
+        gchar *name = g_strdup_printf("shard-%u", i);
+        shard->thread = g_thread_new(name, shard_thread, shard);
+        g_free(name);
+    }
+    return runtime;
+}
+
+/**
+ * @brief 在分片的執行緒上執行 func，可從任何執行緒呼叫
+ *
+ * 從分片自己的執行緒呼叫時直接執行。
+ */
+void loop_shard_post(LoopShard *shard, GSourceFunc func, gpointer data, GDestroyNotify notify) {
+    g_main_context_invoke_full(shard->context, G_PRIORITY_DEFAULT, func, data, notify);
+}
+
+static gboolean quit_shard(gpointer data) {
+    LoopShard *shard = data;
+    g_main_loop_quit(shard->loop);
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * @brief 停止所有分片並釋放資源
+ *
+ * 以 loop_shard_post() 結束迴圈，因此即使執行緒還沒進入 g_main_loop_run() 也不會遺漏。
+ */
+void sharded_runtime_free(ShardedRuntime *runtime) {
+    for (guint i = 0; i < runtime->n_shards; i++) {
+        loop_shard_post(&runtime->shards[i], quit_shard, &runtime->shards[i], NULL);
+    }
+    for (guint i = 0; i < runtime->n_shards; i++) {
+        LoopShard *shard = &runtime->shards[i];
+        g_thread_join(shard->thread);
+        g_main_loop_unref(shard->loop);
+        g_main_context_unref(shard->context);
+    }
+    g_free(runtime->shards);
+    g_free(runtime);
+}
+
+/**
+ * @brief 目前負載最低的分片
+ */
+LoopShard* sharded_runtime_least_loaded(ShardedRuntime *runtime) {
+    LoopShard *best = &runtime->shards[0];
+    gint best_load = g_atomic_int_get(&best->load);
+    for (guint i = 1; i < runtime->n_shards; i++) {
+        gint load = g_atomic_int_get(&runtime->shards[i].load);
+        if (load < best_load) {
+            best = &runtime->shards[i];
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief 選出負載最低的分片並計入一個來源，可從任何執行緒呼叫
+ *
+ * 適合先決定分片、稍後才建立來源的情況；來源結束時以 loop_shard_release() 歸還負載。
+ */
+LoopShard* sharded_runtime_assign(ShardedRuntime *runtime) {
+    LoopShard *shard = sharded_runtime_least_loaded(runtime);
+    g_atomic_int_inc(&shard->load);
+    return shard;
+}
+
+/**
+ * @brief 把事件來源附加到負載最低的分片，可從任何執行緒呼叫
+ *
+ * 來源結束時以 loop_shard_release() 歸還負載。
+ *
+ * @return 來源所在的分片
+ */
+LoopShard* sharded_runtime_attach(ShardedRuntime *runtime, GSource *source) {
+    LoopShard *shard = sharded_runtime_assign(runtime);
+    g_source_attach(source, shard->context);
+    return shard;
+}
+
+void loop_shard_release(LoopShard *shard) {
+    g_atomic_int_add(&shard->load, -1);
+}
+
+// 示範：模擬連線，定期把訊息轉送給另一個分片上的連線
+#define DEMO_CONNECTIONS 16
+#define DEMO_TICKS 5
+
+typedef struct _Connection Connection;
+
+struct _Connection {
+    guint id;
+    LoopShard *shard;
+    Connection *peer;       // 接收轉送訊息的連線，通常在另一個分片
+    guint ticks;
+    guint received;         // 只在 shard 的執行緒上更新
+};
+
+typedef struct {
+    Connection *to;
+    guint from;
+} Message;
+
+static gint demo_remaining = DEMO_CONNECTIONS;
+static GMutex demo_mutex;
+static GCond demo_cond;
+
+gboolean deliver_message(gpointer data) {
+    Message *message = data;
+    // 在接收端的分片執行緒上執行，可直接修改接收端連線的狀態
+    message->to->received++;
+    return G_SOURCE_REMOVE;
+}
+
+gboolean connection_tick(gpointer data) {
+    Connection *connection = data;
+    connection->ticks++;
+
+    Message *message = g_new(Message, 1);
+    message->to = connection->peer;
+    message->from = connection->id;
+    loop_shard_post(connection->peer->shard, deliver_message, message, g_free);
+
+    if (connection->ticks < DEMO_TICKS) return G_SOURCE_CONTINUE;
+
+    loop_shard_release(connection->shard);
+    if (g_atomic_int_dec_and_test(&demo_remaining)) {
+        g_mutex_lock(&demo_mutex);
+        g_cond_signal(&demo_cond);
+        g_mutex_unlock(&demo_mutex);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// 讀取其他分片的狀態：在該分片上執行後再回報給等待的執行緒
+typedef struct {
+    Connection *connections;
+    LoopShard *shard;
+    guint connections_on_shard;
+    guint ticks;
+    guint received;
+    gboolean done;
+} ShardReport;
+
+gboolean collect_report(gpointer data) {
+    ShardReport *report = data;
+    for (guint i = 0; i < DEMO_CONNECTIONS; i++) {
+        Connection *connection = &report->connections[i];
+        // 連線的狀態只在它所在的分片上讀寫
+        if (connection->shard == report->shard) {
+            report->connections_on_shard++;
+            report->ticks += connection->ticks;
+            report->received += connection->received;
+        }
+    }
+    g_mutex_lock(&demo_mutex);
+    report->done = TRUE;
+    g_cond_broadcast(&demo_cond);
+    g_mutex_unlock(&demo_mutex);
+    return G_SOURCE_REMOVE;
+}
+
+static void run_demo(guint n_shards) {
+    ShardedRuntime *runtime = sharded_runtime_new(n_shards);
+    Connection *connections = g_new0(Connection, DEMO_CONNECTIONS);
+    g_print("Started %u shards\n", runtime->n_shards);
+
+    for (guint i = 0; i < DEMO_CONNECTIONS; i++) {
+        connections[i].id = i;
+        connections[i].peer = &connections[(i + 1) % DEMO_CONNECTIONS];
+    }
+    // 先分配所有連線，再啟動計時器，轉送訊息時接收端的分片一定已經決定
+    for (guint i = 0; i < DEMO_CONNECTIONS; i++) {
+        connections[i].shard = sharded_runtime_assign(runtime);
+        g_print("Connection %u -> shard %u\n", i, connections[i].shard->index);
+    }
+    for (guint i = 0; i < DEMO_CONNECTIONS; i++) {
+        GSource *source = g_timeout_source_new(100 + i * 10);
+        g_source_set_callback(source, connection_tick, &connections[i], NULL);
+        g_source_attach(source, connections[i].shard->context);
+        g_source_unref(source);
+    }
+
+    g_mutex_lock(&demo_mutex);
+    while (g_atomic_int_get(&demo_remaining) > 0) {
+        g_cond_wait(&demo_cond, &demo_mutex);
+    }
+    g_mutex_unlock(&demo_mutex);
+
+    for (guint i = 0; i < runtime->n_shards; i++) {
+        LoopShard *shard = &runtime->shards[i];
+        ShardReport report = { connections, shard, 0, 0, 0, FALSE };
+        loop_shard_post(shard, collect_report, &report, NULL);
+        g_mutex_lock(&demo_mutex);
+        while (!report.done) g_cond_wait(&demo_cond, &demo_mutex);
+        g_mutex_unlock(&demo_mutex);
+        g_print("Shard %u (CPU %d): %u connections, %u ticks, %u messages received\n",
+                shard->index, shard->cpu, report.connections_on_shard, report.ticks, report.received);
+    }
+
+    sharded_runtime_free(runtime);
+    g_free(connections);
+    g_print("All shards stopped, exiting...\n");
+}
+
+// 量測：每個工作單位是一段固定的 CPU 運算
+#define BENCH_CONNECTIONS 256
+#define BENCH_EVENTS_PER_CONNECTION 2000
+#define BENCH_EVENTS_PER_DISPATCH 16
+
+typedef struct {
+    LoopShard *shard;
+    guint remaining;
+    guint64 result;
+} BenchConnection;
+
+static gint bench_remaining;
+static GMutex bench_mutex;
+static GCond bench_cond;
+
+static guint64 bench_work(guint64 x) {
+    for (guint i = 0; i < 2000; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+    }
+    return x;
+}
+
+static void bench_signal(gint *remaining) {
+    if (g_atomic_int_dec_and_test(remaining)) {
+        g_mutex_lock(&bench_mutex);
+        g_cond_signal(&bench_cond);
+        g_mutex_unlock(&bench_mutex);
+    }
+}
+
+static void bench_wait(gint *remaining) {
+    g_mutex_lock(&bench_mutex);
+    while (g_atomic_int_get(remaining) > 0) {
+        g_cond_wait(&bench_cond, &bench_mutex);
+    }
+    g_mutex_unlock(&bench_mutex);
+}
+
+// 每次 dispatch 處理一小批事件，讓同一分片上的連線輪流執行
+gboolean bench_connection_ready(gpointer data) {
+    BenchConnection *connection = data;
+    for (guint i = 0; i < BENCH_EVENTS_PER_DISPATCH && connection->remaining > 0; i++) {
+        connection->result = bench_work(connection->result + connection->remaining--);
+    }
+    if (connection->remaining > 0) return G_SOURCE_CONTINUE;
+
+    loop_shard_release(connection->shard);
+    bench_signal(&bench_remaining);
+    return G_SOURCE_REMOVE;
+}
+
+static gdouble bench_throughput(guint n_shards) {
+    ShardedRuntime *runtime = sharded_runtime_new(n_shards);
+    BenchConnection *connections = g_new0(BenchConnection, BENCH_CONNECTIONS);
+    bench_remaining = BENCH_CONNECTIONS;
+
+    gint64 start = g_get_monotonic_time();
+    for (guint i = 0; i < BENCH_CONNECTIONS; i++) {
+        connections[i].remaining = BENCH_EVENTS_PER_CONNECTION;
+        connections[i].result = i + 1;
+        GSource *source = g_idle_source_new();
+        g_source_set_callback(source, bench_connection_ready, &connections[i], NULL);
+        connections[i].shard = sharded_runtime_attach(runtime, source);
+        g_source_unref(source);
+    }
+    bench_wait(&bench_remaining);
+    gint64 elapsed = g_get_monotonic_time() - start;
+
+    sharded_runtime_free(runtime);
+    g_free(connections);
+    return (gdouble)BENCH_CONNECTIONS * BENCH_EVENTS_PER_CONNECTION / (elapsed / 1e6);
+}
+
+// 分片之間來回傳遞：a 與 b 輪流把訊息交給對方
+typedef struct {
+    LoopShard *a;
+    LoopShard *b;
+    guint remaining;
+    gint done;
+} PingPong;
+
+gboolean ping(gpointer data);
+
+gboolean pong(gpointer data) {
+    PingPong *state = data;
+    loop_shard_post(state->a, ping, state, NULL);
+    return G_SOURCE_REMOVE;
+}
+
+gboolean ping(gpointer data) {
+    PingPong *state = data;
+    if (state->remaining-- == 0) {
+        bench_signal(&state->done);
+        return G_SOURCE_REMOVE;
+    }
+    loop_shard_post(state->b, pong, state, NULL);
+    return G_SOURCE_REMOVE;
+}
+
+static gdouble bench_round_trip(void) {
+    ShardedRuntime *runtime = sharded_runtime_new(2);
+    const guint rounds = 100000;
+    PingPong state = { &runtime->shards[0], &runtime->shards[1], rounds, 1 };
+
+    gint64 start = g_get_monotonic_time();
+    loop_shard_post(state.a, ping, &state, NULL);
+    bench_wait(&state.done);
+    gint64 elapsed = g_get_monotonic_time() - start;
+
+    sharded_runtime_free(runtime);
+    return (gdouble)elapsed / rounds;
+}
+
+static void run_benchmark(guint n_shards) {
+    if (n_shards == 0) n_shards = g_get_num_processors();
+
+    g_print("%u connections x %u events\n", BENCH_CONNECTIONS, BENCH_EVENTS_PER_CONNECTION);
+    gdouble single = bench_throughput(1);
+    g_print("%2u shard:  %10.0f events/s\n", 1, single);
+    if (n_shards > 1) {
+        gdouble sharded = bench_throughput(n_shards);
+        g_print("%2u shards: %10.0f events/s (%.2fx)\n", n_shards, sharded, sharded / single);
+    }
+    g_print("Cross-shard round trip: %.2f us\n", bench_round_trip());
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && g_strcmp0(argv[1], "--benchmark") == 0) {
+        run_benchmark(argc > 2 ? (guint)atoi(argv[2]) : 0);
+        return 0;
+    }
+
+    run_demo(argc > 1 ? (guint)atoi(argv[1]) : 0);
+    return 0;
+}
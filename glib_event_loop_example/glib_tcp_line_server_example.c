@@ -0,0 +1,437 @@
+/**
+ * @file glib_tcp_line_server_example.c
+ * @brief 以分片事件迴圈服務大量連線的 TCP 行協定伺服器範例程式
+ *
+ * glib_io_event_example.c 只監聽標準輸入，一次只有一個使用者，
+ * 無法看出以 GLib 事件迴圈實作的服務在大量客戶端下的表現。
+ * 此程式把同樣的「讀一行、回一行」改成 TCP 伺服器：
+ * - 每個分片一個執行緒、一個 GMainContext 與一個以 SO_REUSEPORT 綁定同一個埠的 socket，
+ *   由核心把新連線分散到各分片，連線之後只在該分片上處理，不需要加鎖。
+ * - 每個連線是一個以 g_source_add_unix_fd() 監聽 socket 的 GSource，
+ *   有資料要寫時才以 g_source_modify_unix_fd() 加上 G_IO_OUT。
+ * - 讀取緩衝區中每一行的回覆以 iovec 指向原本的資料，一次喚醒的所有回覆以一次 writev() 送出；
+ *   送不完的部分才複製到寫入佇列。
+ * - 背壓：寫入佇列超過 WRITE_HIGH_WATERMARK 時停止讀取這個連線，
+ *   TCP 流量控制會讓客戶端慢下來；佇列降到 WRITE_LOW_WATERMARK 以下再恢復讀取。
+ *
+ * 協定：每一行是一個請求，伺服器回覆 "OK " 加上同一行；"QUIT" 會在回覆送完後關閉連線。
+ * 以 glib_tcp_load_generator.c 產生負載並量測延遲。
+ *
+ * 編譯方式：
+ * gcc -O2 -o glib_tcp_line_server_example glib_tcp_line_server_example.c `pkg-config --cflags --libs glib-2.0`
+ *
+ * 執行方式：
+ * ./glib_tcp_line_server_example [埠號] [分片數]
+ * （另一個終端機）./glib_tcp_load_generator 9000 100 10
+ *
+ * 預期輸出：
+ * Listening on port 9000 with 4 shards, press Ctrl+C to stop
+ * 100 connections, 152340 requests/s, 0 paused by backpressure
+ * ...
+ * Total: 1000 connections accepted, 1523400 requests
+ *
+ * @author: Nelson Chung
+ * @date: 2024.11.23
+ */
+
+#define _GNU_SOURCE
+#include <glib.h>
+#include <glib-unix.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define READ_BUFFER_SIZE (64 * 1024)        // 一行不能超過讀取緩衝區
+#define READS_PER_WAKEUP 4                  // 一次喚醒最多讀幾次，讓其他連線也有機會
+#define WRITE_HIGH_WATERMARK (256 * 1024)   // 寫入佇列超過此值時停止讀取
+#define WRITE_LOW_WATERMARK (64 * 1024)     // 寫入佇列低於此值時恢復讀取
+#define REPLY_IOV_MAX (IOV_MAX & ~1)        // 每個回覆用兩個 iovec
+
+static const gchar reply_prefix[] = "OK ";
+
+// 一個分片：一個執行緒、一個 GMainContext 與自己的監聽 socket
+typedef struct {
+    guint index;
+    GMainContext *context;
+    GMainLoop *loop;
+    GThread *thread;
+    int listen_fd;
+    // 以下統計只由分片執行緒寫入，主執行緒以 atomic 讀取
+    guint64 accepted;
+    guint64 requests;
+    guint64 paused;          // 因背壓停止讀取的次數
+    gint active;             // 目前的連線數
+} ServerShard;
+
+// 連線事件來源的結構體
+typedef struct {
+    GSource source;          // 基礎 GSource 結構
+    gpointer tag;            // g_source_add_unix_fd() 傳回的標籤
+    int fd;
+    ServerShard *shard;
+
+    gchar *in;               // 讀取緩衝區，大小 READ_BUFFER_SIZE
+    gsize in_start;          // 尚未處理的第一個位元組
+    gsize in_end;
+
+    struct iovec iov[REPLY_IOV_MAX]; // 尚未送出的回覆，指向讀取緩衝區
+    guint n_iov;
+
+    GByteArray *out;         // writev() 送不完的資料
+    gsize out_sent;
+    gboolean reading;        // 是否監聽 G_IO_IN
+    gboolean closing;        // 收到 QUIT，寫入佇列送完後關閉
+} Connection;
+
+static void add_counter(guint64 *counter, guint64 value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static guint64 read_counter(guint64 *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static gsize connection_backlog(Connection *conn) {
+    return conn->out->len - conn->out_sent;
+}
+
+/**
+ * @brief 以一次 writev() 送出收集的回覆
+ *
+ * 送不完的部分複製到寫入佇列。iovec 指向讀取緩衝區，搬動讀取緩衝區前必須先呼叫。
+ *
+ * @return 連線發生錯誤時傳回 FALSE
+ */
+static gboolean connection_flush_replies(Connection *conn) {
+    if (conn->n_iov == 0) return TRUE;
+
+    ssize_t sent = writev(conn->fd, conn->iov, conn->n_iov);
+    if (sent < 0) {
+        if (errno != EAGAIN && errno != EINTR) return FALSE;
+        sent = 0;
+    }
+    for (guint i = 0; i < conn->n_iov; i++) {
+        gsize length = conn->iov[i].iov_len;
+        if ((gsize)sent >= length) {
+            sent -= length;
+            continue;
+        }
+        g_byte_array_append(conn->out, (guint8 *)conn->iov[i].iov_base + sent, length - sent);
+        sent = 0;
+    }
+    conn->n_iov = 0;
+    return TRUE;
+}
+
+// 加入一個回覆；line 含換行字元
+static gboolean connection_queue_reply(Connection *conn, const gchar *line, gsize length) {
+    // 已經有排隊的資料時，之後的回覆也要排在後面
+    if (connection_backlog(conn) > 0) {
+        g_byte_array_append(conn->out, (const guint8 *)reply_prefix, sizeof(reply_prefix) - 1);
+        g_byte_array_append(conn->out, (const guint8 *)line, length);
+        return TRUE;
+    }
+    if (conn->n_iov == REPLY_IOV_MAX && !connection_flush_replies(conn)) return FALSE;
+    if (connection_backlog(conn) > 0) return connection_queue_reply(conn, line, length);
+
+    conn->iov[conn->n_iov].iov_base = (gpointer)reply_prefix;
+    conn->iov[conn->n_iov].iov_len = sizeof(reply_prefix) - 1;
+    conn->iov[conn->n_iov + 1].iov_base = (gpointer)line;
+    conn->iov[conn->n_iov + 1].iov_len = length;
+    conn->n_iov += 2;
+    return TRUE;
+}
+
+// 處理讀取緩衝區中所有完整的行
+static gboolean connection_process(Connection *conn, gsize scan_from) {
+    guint64 requests = 0;
+    gchar *newline;
+
+    while (!conn->closing &&
+           (newline = memchr(conn->in + scan_from, '\n', conn->in_end - scan_from)) != NULL) {
+        gchar *line = conn->in + conn->in_start;
+        gsize length = newline - line + 1;
+        gsize command_length = length > 1 && newline[-1] == '\r' ? length - 2 : length - 1;
+
+        if (command_length == 4 && memcmp(line, "QUIT", 4) == 0) {
+            // 之前的回覆要先送出或排入佇列，BYE 才會排在它們後面
+            if (!connection_flush_replies(conn)) return FALSE;
+            conn->closing = TRUE;
+            g_byte_array_append(conn->out, (const guint8 *)"BYE\n", 4);
+        } else if (!connection_queue_reply(conn, line, length)) {
+            return FALSE;
+        }
+        requests++;
+        conn->in_start = scan_from = newline - conn->in + 1;
+    }
+    add_counter(&conn->shard->requests, requests);
+    return TRUE;
+}
+
+// socket 可讀：讀入資料並回覆每一行
+static gboolean connection_read(Connection *conn) {
+    for (int i = 0; i < READS_PER_WAKEUP && !conn->closing; i++) {
+        gsize scan_from = conn->in_end;
+        ssize_t got = read(conn->fd, conn->in + conn->in_end, READ_BUFFER_SIZE - conn->in_end);
+        if (got == 0) return FALSE; // 對方關閉連線
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) break;
+            return FALSE;
+        }
+        conn->in_end += got;
+        if (!connection_process(conn, scan_from)) return FALSE;
+
+        // 回覆送出後才能搬動不完整的最後一行
+        if (!connection_flush_replies(conn)) return FALSE;
+        gsize pending = conn->in_end - conn->in_start;
+        if (pending == READ_BUFFER_SIZE) {
+            g_printerr("Connection %d: line too long, closing\n", conn->fd);
+            return FALSE;
+        }
+        memmove(conn->in, conn->in + conn->in_start, pending);
+        conn->in_start = 0;
+        conn->in_end = pending;
+
+        // 背壓：對方不讀取回覆時就不再讀取它的請求
+        if (connection_backlog(conn) > WRITE_HIGH_WATERMARK) {
+            conn->reading = FALSE;
+            add_counter(&conn->shard->paused, 1);
+            break;
+        }
+    }
+    return TRUE;
+}
+
+// socket 可寫：送出寫入佇列
+static gboolean connection_write(Connection *conn) {
+    while (connection_backlog(conn) > 0) {
+        ssize_t sent = write(conn->fd, conn->out->data + conn->out_sent, connection_backlog(conn));
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) break;
+            return FALSE;
+        }
+        conn->out_sent += sent;
+    }
+
+    if (connection_backlog(conn) == 0) {
+        g_byte_array_set_size(conn->out, 0);
+        conn->out_sent = 0;
+        if (conn->closing) return FALSE;
+    } else if (conn->out_sent > conn->out->len / 2) {
+        // 已送出的部分超過一半時才移除，避免每次都搬動
+        g_byte_array_remove_range(conn->out, 0, conn->out_sent);
+        conn->out_sent = 0;
+    }
+    if (!conn->reading && connection_backlog(conn) < WRITE_LOW_WATERMARK) {
+        conn->reading = TRUE;
+    }
+    return TRUE;
+}
+
+// 連線事件來源的回呼函式
+gboolean connection_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+    Connection *conn = (Connection *)source;
+    GIOCondition revents = g_source_query_unix_fd(source, conn->tag);
+
+    if (revents & G_IO_ERR) return G_SOURCE_REMOVE;
+    if ((revents & G_IO_OUT) && !connection_write(conn)) return G_SOURCE_REMOVE;
+    if ((revents & (G_IO_IN | G_IO_HUP)) && conn->reading && !connection_read(conn)) return G_SOURCE_REMOVE;
+
+    // 寫入佇列有資料時才監聽 G_IO_OUT；背壓時不監聽 G_IO_IN
+    if (conn->closing && connection_backlog(conn) > 0 && !connection_write(conn)) return G_SOURCE_REMOVE;
+    GIOCondition events = (conn->reading && !conn->closing ? G_IO_IN : 0) | (connection_backlog(conn) > 0 ? G_IO_OUT : 0);
+    g_source_modify_unix_fd(source, conn->tag, events);
+    return G_SOURCE_CONTINUE;
+}
+
+// 連線事件來源的結束函式
+void connection_finalize(GSource *source) {
+    Connection *conn = (Connection *)source;
+    close(conn->fd);
+    g_free(conn->in);
+    g_byte_array_free(conn->out, TRUE);
+    g_atomic_int_add(&conn->shard->active, -1);
+}
+
+// 沒有 prepare 與 check：socket 事件發生時才 dispatch
+static GSourceFuncs connection_funcs = {
+    .prepare = NULL,
+    .check = NULL,
+    .dispatch = connection_dispatch,
+    .finalize = connection_finalize,
+};
+
+static void connection_new(ServerShard *shard, int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    Connection *conn = (Connection *)g_source_new(&connection_funcs, sizeof(Connection));
+    conn->fd = fd;
+    conn->shard = shard;
+    conn->in = g_malloc(READ_BUFFER_SIZE);
+    conn->out = g_byte_array_new();
+    conn->reading = TRUE;
+    conn->tag = g_source_add_unix_fd(&conn->source, fd, G_IO_IN);
+    g_source_set_name(&conn->source, "Connection");
+    g_source_attach(&conn->source, shard->context);
+    g_source_unref(&conn->source); // 由 context 持有，連線結束時釋放
+    g_atomic_int_inc(&shard->active);
+}
+
+// 監聽 socket 可讀：接受所有等待中的連線
+gboolean accept_callback(gint fd, GIOCondition condition, gpointer user_data) {
+    ServerShard *shard = user_data;
+    guint64 accepted = 0;
+
+    for (;;) {
+        int client = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN) g_printerr("accept4 failed: %s\n", g_strerror(errno));
+            break;
+        }
+        connection_new(shard, client);
+        accepted++;
+    }
+    add_counter(&shard->accepted, accepted);
+    return G_SOURCE_CONTINUE;
+}
+
+/**
+ * @brief 建立監聽 socket；各分片以 SO_REUSEPORT 綁定同一個埠
+ *
+ * @param port 埠號，0 表示由系統指定，傳回時填入實際的埠號
+ * @return socket；失敗時傳回 -1
+ */
+static int listen_socket_new(guint16 *port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        g_printerr("socket failed: %s\n", g_strerror(errno));
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_port = htons(*port),
+                                   .sin_addr.s_addr = htonl(INADDR_ANY) };
+    socklen_t length = sizeof(address);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(fd, SOMAXCONN) < 0 ||
+        getsockname(fd, (struct sockaddr *)&address, &length) < 0) {
+        g_printerr("Cannot listen on port %u: %s\n", *port, g_strerror(errno));
+        close(fd);
+        return -1;
+    }
+    *port = ntohs(address.sin_port);
+    return fd;
+}
+
+gpointer shard_thread(gpointer data) {
+    ServerShard *shard = data;
+    g_main_context_push_thread_default(shard->context);
+    g_main_loop_run(shard->loop);
+    g_main_context_pop_thread_default(shard->context);
+    return NULL;
+}
+
+static gboolean quit_shard(gpointer data) {
+    ServerShard *shard = data;
+    g_main_loop_quit(shard->loop);
+    return G_SOURCE_REMOVE;
+}
+
+// 主執行緒：每秒印出統計
+typedef struct {
+    ServerShard *shards;
+    guint n_shards;
+    guint64 last_requests;
+    GMainLoop *loop;
+} ServerStats;
+
+gboolean stats_callback(gpointer user_data) {
+    ServerStats *stats = user_data;
+    guint64 requests = 0, paused = 0;
+    gint active = 0;
+    for (guint i = 0; i < stats->n_shards; i++) {
+        requests += read_counter(&stats->shards[i].requests);
+        paused += read_counter(&stats->shards[i].paused);
+        active += g_atomic_int_get(&stats->shards[i].active);
+    }
+    if (requests != stats->last_requests || active > 0) {
+        g_print("%d connections, %" G_GUINT64_FORMAT " requests/s, %" G_GUINT64_FORMAT " paused by backpressure\n",
+                active, requests - stats->last_requests, paused);
+    }
+    stats->last_requests = requests;
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean sigint_callback(gpointer user_data) {
+    ServerStats *stats = user_data;
+    g_main_loop_quit(stats->loop);
+    return G_SOURCE_REMOVE;
+}
+
+int main(int argc, char *argv[]) {
+    guint16 port = argc > 1 ? (guint16)atoi(argv[1]) : 9000;
+    guint n_shards = argc > 2 ? (guint)atoi(argv[2]) : 0;
+    if (n_shards == 0) n_shards = g_get_num_processors();
+
+    // 對方已關閉時 writev() 傳回 EPIPE，而不是結束整個程式
+    signal(SIGPIPE, SIG_IGN);
+
+    ServerShard *shards = g_new0(ServerShard, n_shards);
+    for (guint i = 0; i < n_shards; i++) {
+        ServerShard *shard = &shards[i];
+        shard->index = i;
+        shard->listen_fd = listen_socket_new(&port);
+        if (shard->listen_fd < 0) return 1;
+        shard->context = g_main_context_new();
+        shard->loop = g_main_loop_new(shard->context, FALSE);
+
+        GSource *listen_source = g_unix_fd_source_new(shard->listen_fd, G_IO_IN);
+        g_source_set_callback(listen_source, (GSourceFunc)accept_callback, shard, NULL);
+        g_source_attach(listen_source, shard->context);
+        g_source_unref(listen_source);
+    }
+    for (guint i = 0; i < n_shards; i++) {
+        gchar *name = g_strdup_printf("shard-%u", i);
+        shards[i].thread = g_thread_new(name, shard_thread, &shards[i]);
+        g_free(name);
+    }
+    g_print("Listening on port %u with %u shards, press Ctrl+C to stop\n", port, n_shards);
+
+    ServerStats stats = { shards, n_shards, 0, g_main_loop_new(NULL, FALSE) };
+    g_timeout_add_seconds(1, stats_callback, &stats);
+    g_unix_signal_add(SIGINT, sigint_callback, &stats);
+    g_main_loop_run(stats.loop);
+
+    guint64 accepted = 0, requests = 0;
+    for (guint i = 0; i < n_shards; i++) {
+        g_main_context_invoke(shards[i].context, quit_shard, &shards[i]);
+    }
+    for (guint i = 0; i < n_shards; i++) {
+        g_thread_join(shards[i].thread);
+        accepted += shards[i].accepted;
+        requests += shards[i].requests;
+        // 釋放 context 時一併關閉仍開著的連線
+        g_main_loop_unref(shards[i].loop);
+        g_main_context_unref(shards[i].context);
+        close(shards[i].listen_fd);
+    }
+    g_print("Total: %" G_GUINT64_FORMAT " connections accepted, %" G_GUINT64_FORMAT " requests\n", accepted, requests);
+
+    g_main_loop_unref(stats.loop);
+    g_free(shards);
+    return 0;
+}
@@ -0,0 +1,314 @@
+/**
+ * @file glib_tcp_load_generator.c
+ * @brief glib_tcp_line_server_example.c 的本機負載產生器
+ *
+ * 開啟指定數量的 TCP 連線，每個連線同時保持 pipeline 個未回覆的請求，
+ * 收到一個回覆就送出下一個請求（closed loop），持續指定的秒數。
+ * 連線平均分配到數個執行緒，每個執行緒以自己的 GMainContext 處理它的連線。
+ *
+ * 每個請求記錄送出時間，收到回覆時計算延遲，結束時合併所有執行緒的紀錄，
+ * 列出連線數、每秒請求數與延遲的百分位數。
+ *
+ * 編譯方式：
+ * gcc -O2 -o glib_tcp_load_generator glib_tcp_load_generator.c `pkg-config --cflags --libs glib-2.0`
+ *
+ * 執行方式：
+ * ./glib_tcp_load_generator [埠號] [連線數] [秒數] [pipeline] [執行緒數]
+ *
+ * 預期輸出：
+ * 100 connections, pipeline 1, 4 threads, 10 s against 127.0.0.1:9000
+ * 100 of 100 connections established
+ * 1523400 requests in 10.00 s: 152340 requests/s, 0 connection errors
+ * latency p50 24.1 us, p90 41.7 us, p99 88.3 us, p99.9 210.5 us, max 1830.2 us
+ *
+ * @author: Nelson Chung
+ * @date: 2024.11.23
+ */
+
+#include <glib.h>
+#include <glib-unix.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define CLIENT_BUFFER_SIZE (16 * 1024)
+#define MAX_PIPELINE 64
+
+static gint64 now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64)ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+typedef struct _ClientThread ClientThread;
+
+// 一個客戶端連線
+typedef struct {
+    ClientThread *thread;
+    int fd;
+    GSource *source;
+    guint id;
+    guint sequence;
+    gint64 sent_at[MAX_PIPELINE];  // 未回覆請求的送出時間，依送出順序排列的環狀佇列
+    guint outstanding_head;
+    guint outstanding;
+    gchar in[CLIENT_BUFFER_SIZE];
+    gsize in_len;
+} ClientConnection;
+
+// 一個執行緒與它負責的連線
+struct _ClientThread {
+    GThread *thread;
+    GMainContext *context;
+    GMainLoop *loop;
+    ClientConnection *connections;
+    guint n_connections;
+    guint pipeline;
+    guint seconds;
+    gboolean running;
+    GArray *latencies;       // 每個回覆的延遲（ns）
+    guint errors;
+};
+
+typedef struct {
+    struct sockaddr_in address;
+    guint connections;
+    guint seconds;
+    guint pipeline;
+    guint threads;
+} LoadConfig;
+
+/**
+ * @brief 送出 count 個請求
+ *
+ * 每個請求只有數十個位元組，未回覆的請求最多 MAX_PIPELINE 個，不會填滿 socket 緩衝區，
+ * 因此寫不完視為錯誤。
+ */
+static gboolean client_send(ClientConnection *conn, guint count) {
+    gchar buffer[MAX_PIPELINE * 64];
+    gsize length = 0;
+    gint64 now = now_ns();
+
+    for (guint i = 0; i < count; i++) {
+        length += g_snprintf(buffer + length, sizeof(buffer) - length,
+                             "GET conn-%u/item-%u\n", conn->id, conn->sequence++);
+        guint slot = (conn->outstanding_head + conn->outstanding) % MAX_PIPELINE;
+        conn->sent_at[slot] = now;
+        conn->outstanding++;
+    }
+
+    ssize_t sent = write(conn->fd, buffer, length);
+    if (sent != (ssize_t)length) {
+        g_printerr("Connection %u: write failed: %s\n", conn->id, sent < 0 ? g_strerror(errno) : "short write");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// 收到回覆：記錄延遲並送出同樣數量的新請求
+gboolean client_read_callback(gint fd, GIOCondition condition, gpointer user_data) {
+    ClientConnection *conn = user_data;
+    ClientThread *thread = conn->thread;
+
+    ssize_t got = read(fd, conn->in + conn->in_len, sizeof(conn->in) - conn->in_len);
+    if (got < 0 && (errno == EAGAIN || errno == EINTR)) return G_SOURCE_CONTINUE;
+    if (got <= 0) {
+        g_printerr("Connection %u: %s\n", conn->id, got == 0 ? "closed by server" : g_strerror(errno));
+        goto fail;
+    }
+    conn->in_len += got;
+
+    gint64 now = now_ns();
+    guint replies = 0;
+    gchar *start = conn->in;
+    gchar *newline;
+    while ((newline = memchr(start, '\n', conn->in + conn->in_len - start)) != NULL) {
+        if (conn->outstanding == 0) {
+            g_printerr("Connection %u: unexpected reply\n", conn->id);
+            goto fail;
+        }
+        guint32 latency = (guint32)MIN(now - conn->sent_at[conn->outstanding_head], G_MAXUINT32);
+        g_array_append_val(thread->latencies, latency);
+        conn->outstanding_head = (conn->outstanding_head + 1) % MAX_PIPELINE;
+        conn->outstanding--;
+        replies++;
+        start = newline + 1;
+    }
+    conn->in_len -= start - conn->in;
+    memmove(conn->in, start, conn->in_len);
+
+    // 所有回覆一次送出
+    if (thread->running && replies > 0 && !client_send(conn, replies)) goto fail;
+    return G_SOURCE_CONTINUE;
+
+fail:
+    thread->errors++;
+    g_source_unref(conn->source);
+    conn->source = NULL;
+    return G_SOURCE_REMOVE;
+}
+
+gboolean stop_callback(gpointer user_data) {
+    ClientThread *thread = user_data;
+    // 停止送出新請求；這一刻之後收到的回覆不列入統計
+    thread->running = FALSE;
+    g_main_loop_quit(thread->loop);
+    return G_SOURCE_REMOVE;
+}
+
+gpointer client_thread_main(gpointer data) {
+    ClientThread *thread = data;
+    g_main_context_push_thread_default(thread->context);
+    for (guint i = 0; i < thread->n_connections; i++) {
+        ClientConnection *conn = &thread->connections[i];
+        if (conn->source && !client_send(conn, thread->pipeline)) {
+            thread->errors++;
+            g_source_destroy(conn->source);
+            g_source_unref(conn->source);
+            conn->source = NULL;
+        }
+    }
+    // 建立連線花的時間不計入，從開始送出請求起算
+    GSource *timeout = g_timeout_source_new_seconds(thread->seconds);
+    g_source_set_callback(timeout, stop_callback, thread, NULL);
+    g_source_attach(timeout, thread->context);
+    g_source_unref(timeout);
+
+    g_main_loop_run(thread->loop);
+    g_main_context_pop_thread_default(thread->context);
+    return NULL;
+}
+
+// 以阻塞模式連線，之後改為非阻塞
+static int client_connect(const struct sockaddr_in *address) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        g_printerr("socket failed: %s\n", g_strerror(errno));
+        return -1;
+    }
+    if (connect(fd, (const struct sockaddr *)address, sizeof(*address)) < 0) {
+        g_printerr("connect failed: %s\n", g_strerror(errno));
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+static gint compare_latency(gconstpointer a, gconstpointer b) {
+    guint32 x = *(const guint32 *)a, y = *(const guint32 *)b;
+    return x < y ? -1 : x > y;
+}
+
+static gdouble percentile_us(GArray *sorted, gdouble p) {
+    if (sorted->len == 0) return 0.0;
+    guint index = MIN((guint)(p / 100.0 * sorted->len), sorted->len - 1);
+    return g_array_index(sorted, guint32, index) / 1000.0;
+}
+
+static void run_load(const LoadConfig *config) {
+    ClientThread *threads = g_new0(ClientThread, config->threads);
+    guint next_id = 0;
+    guint connected = 0;
+
+    for (guint t = 0; t < config->threads; t++) {
+        ClientThread *thread = &threads[t];
+        thread->context = g_main_context_new();
+        thread->loop = g_main_loop_new(thread->context, FALSE);
+        thread->pipeline = config->pipeline;
+        thread->running = TRUE;
+        thread->latencies = g_array_sized_new(FALSE, FALSE, sizeof(guint32), 1 << 20);
+        // 連線平均分配到各執行緒
+        thread->n_connections = config->connections / config->threads + (t < config->connections % config->threads);
+        thread->connections = g_new0(ClientConnection, thread->n_connections);
+
+        for (guint i = 0; i < thread->n_connections; i++) {
+            ClientConnection *conn = &thread->connections[i];
+            conn->thread = thread;
+            conn->id = next_id + i;
+            conn->fd = client_connect(&config->address);
+            if (conn->fd < 0) {
+                thread->errors++; // 連線失敗也算連線錯誤
+                continue;
+            }
+            connected++;
+            conn->source = g_unix_fd_source_new(conn->fd, G_IO_IN);
+            g_source_set_callback(conn->source, (GSourceFunc)client_read_callback, conn, NULL);
+            g_source_attach(conn->source, thread->context);
+        }
+        next_id += thread->n_connections;
+        thread->seconds = config->seconds;
+    }
+
+    g_print("%u of %u connections established\n", connected, config->connections);
+
+    gint64 start = now_ns();
+    for (guint t = 0; t < config->threads; t++) {
+        threads[t].thread = g_thread_new("load", client_thread_main, &threads[t]);
+    }
+
+    GArray *latencies = g_array_new(FALSE, FALSE, sizeof(guint32));
+    guint errors = 0;
+    for (guint t = 0; t < config->threads; t++) {
+        ClientThread *thread = &threads[t];
+        g_thread_join(thread->thread);
+        g_array_append_vals(latencies, thread->latencies->data, thread->latencies->len);
+        errors += thread->errors;
+    }
+    gdouble seconds = (now_ns() - start) / 1e9;
+
+    g_array_sort(latencies, compare_latency);
+    g_print("%u requests in %.2f s: %.0f requests/s, %u connection errors\n",
+            latencies->len, seconds, latencies->len / seconds, errors);
+    g_print("latency p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+            percentile_us(latencies, 50), percentile_us(latencies, 90), percentile_us(latencies, 99),
+            percentile_us(latencies, 99.9), percentile_us(latencies, 100));
+
+    for (guint t = 0; t < config->threads; t++) {
+        ClientThread *thread = &threads[t];
+        for (guint i = 0; i < thread->n_connections; i++) {
+            ClientConnection *conn = &thread->connections[i];
+            if (conn->source) {
+                g_source_destroy(conn->source);
+                g_source_unref(conn->source);
+            }
+            if (conn->fd >= 0) close(conn->fd);
+        }
+        g_free(thread->connections);
+        g_array_free(thread->latencies, TRUE);
+        g_main_loop_unref(thread->loop);
+        g_main_context_unref(thread->context);
+    }
+    g_array_free(latencies, TRUE);
+    g_free(threads);
+}
+
+int main(int argc, char *argv[]) {
+    LoadConfig config = {
+        .address = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) },
+        .connections = argc > 2 ? (guint)atoi(argv[2]) : 100,
+        .seconds = argc > 3 ? (guint)atoi(argv[3]) : 10,
+        .pipeline = argc > 4 ? (guint)atoi(argv[4]) : 1,
+        .threads = argc > 5 ? (guint)atoi(argv[5]) : MIN(4, g_get_num_processors()),
+    };
+    config.address.sin_port = htons(argc > 1 ? (guint16)atoi(argv[1]) : 9000);
+    config.pipeline = CLAMP(config.pipeline, 1, MAX_PIPELINE);
+    config.threads = CLAMP(config.threads, 1, MAX(config.connections, 1));
+
+    signal(SIGPIPE, SIG_IGN);
+    g_print("%u connections, pipeline %u, %u threads, %u s against 127.0.0.1:%u\n",
+            config.connections, config.pipeline, config.threads, config.seconds, ntohs(config.address.sin_port));
+    run_load(&config);
+    return 0;
+}
@@ -0,0 +1,538 @@
+/**
+ * @file glib_timer_wheel_source_example.c
+ * @brief 以單一 GSource 管理階層式計時輪（hierarchical timer wheel）的範例程式
+ *
+ * 此程式延伸 glib_custom_event_source_example.c 的 CustomSource，
+ * 以一個自訂事件來源管理任意數量的計時器。計時器放在 4 層、每層 256 格的
+ * 計時輪中（解析度 1 毫秒，可涵蓋約 49 天）：
+ * - 新增與取消計時器都是 O(1)：計時器以侵入式雙向鏈結串在格子上。
+ * - 一次喚醒會把所有到期的計時器一起 dispatch。
+ * - 每層有一張非空格子的位元圖，prepare 時可直接算出到下一個非空格子的時間，
+ *   閒置時也能一次跳過整段空白的格子。
+ *
+ * 相較之下，每個計時器各用一個 g_timeout_add 時，GLib 每次迴圈都要在
+ * prepare/check 中走訪所有來源，計時器一多成本就隨數量線性成長。
+ * 以 --benchmark 執行時，會在 1 萬到 100 萬個計時器下比較兩者。
+ *
+ * 編譯方式：
+ * gcc -O2 -o glib_timer_wheel_source_example glib_timer_wheel_source_example.c `pkg-config --cflags --libs glib-2.0`
+ *
+ * 執行方式：
+ * ./glib_timer_wheel_source_example
+ * ./glib_timer_wheel_source_example --benchmark [計時器數量 ...]
+ *
+ * 預期輸出：
+ * Timer 3 cancelled
+ * Timer 1 fired after 100 ms
+ * Timer 2 fired after 250 ms
+ * Timer 4 fired after 500 ms (1 of 3)
+ * Timer 4 fired after 1000 ms (2 of 3)
+ * Timer 4 fired after 1500 ms (3 of 3)
+ * All timers done, exiting...
+ *
+ * @author: Nelson Chung
+ * @date: 2024.11.23
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WHEEL_LEVELS 4
+#define WHEEL_BITS 8
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_MAX_DELAY ((G_GUINT64_CONSTANT(1) << (WHEEL_LEVELS * WHEEL_BITS)) - 1)
+#define WHEEL_TICK_USEC 1000 // 每格 1 毫秒
+
+#define TIMER_UNLINKED 0xff  // 計時器不在任何串列上
+#define TIMER_EXPIRED 0xfe   // 計時器在到期串列上，等待 dispatch
+
+typedef struct _WheelTimer WheelTimer;
+
+// 計時器回呼函式；回呼中可呼叫 timer_wheel_reschedule() 重新排程同一個計時器
+typedef void (*WheelTimerFunc)(WheelTimer *timer, gpointer user_data);
+
+// 計時器，以侵入式鏈結串在計時輪的格子上
+struct _WheelTimer {
+    WheelTimer *next;
+    WheelTimer **pprev;    // 指向前一個節點的 next（或格子的串列頭），移除時不必走訪
+    guint64 expires;       // 到期的 tick
+    guint8 level;          // 所在層級，或 TIMER_UNLINKED / TIMER_EXPIRED
+    guint8 index;          // 所在格子
+    gboolean firing;       // 回呼正在執行
+    WheelTimerFunc func;
+    gpointer user_data;
+};
+
+// 計時輪事件來源的結構體
+typedef struct {
+    GSource source;                                       // 基礎 GSource 結構
+    gint64 start_time;                                    // tick 0 的單調時間（微秒）
+    guint64 current_tick;                                 // 已處理到的 tick
+    WheelTimer *slots[WHEEL_LEVELS][WHEEL_SLOTS];         // 每一格的計時器串列
+    guint64 occupied[WHEEL_LEVELS][WHEEL_SLOTS / 64];     // 非空格子的位元圖
+    WheelTimer *expired;                                  // 已到期、等待 dispatch 的計時器
+    guint count;                                          // 排程中的計時器數量
+} TimerWheelSource;
+
+static void timer_list_add(WheelTimer **head, WheelTimer *timer) {
+    timer->next = *head;
+    if (*head) (*head)->pprev = &timer->next;
+    timer->pprev = head;
+    *head = timer;
+}
+
+/**
+ * @brief 將計時器從所在串列移除，O(1)
+ */
+static void timer_unlink(TimerWheelSource *wheel, WheelTimer *timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) timer->next->pprev = timer->pprev;
+
+    // 格子空了就清除位元圖
+    if (timer->level < WHEEL_LEVELS && wheel->slots[timer->level][timer->index] == NULL) {
+        wheel->occupied[timer->level][timer->index / 64] &= ~(G_GUINT64_CONSTANT(1) << (timer->index % 64));
+    }
+    timer->level = TIMER_UNLINKED;
+    timer->next = NULL;
+    timer->pprev = NULL;
+    wheel->count--;
+}
+
+/**
+ * @brief 依到期時間與目前 tick 的距離，把計時器放進對應的層級與格子，O(1)
+ *
+ * 距離小於 256 放第 0 層，小於 256^2 放第 1 層，依此類推；
+ * 格子由到期 tick 在該層的位元決定，輪轉到該格時再往下一層重新分配（cascade）。
+ */
+static void timer_link(TimerWheelSource *wheel, WheelTimer *timer) {
+    wheel->count++;
+    if (timer->expires <= wheel->current_tick) {
+        timer->level = TIMER_EXPIRED;
+        timer_list_add(&wheel->expired, timer);
+        return;
+    }
+
+    guint64 delta = timer->expires - wheel->current_tick;
+    guint level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >> ((level + 1) * WHEEL_BITS)) {
+        level++;
+    }
+    guint index = (timer->expires >> (level * WHEEL_BITS)) & WHEEL_MASK;
+
+    timer->level = level;
+    timer->index = index;
+    timer_list_add(&wheel->slots[level][index], timer);
+    wheel->occupied[level][index / 64] |= G_GUINT64_CONSTANT(1) << (index % 64);
+}
+
+/**
+ * @brief 把一格中的所有計時器依新的距離重新分配（cascade）或移到到期串列
+ */
+static void wheel_collect_slot(TimerWheelSource *wheel, guint level, guint index) {
+    WheelTimer *list = wheel->slots[level][index];
+    wheel->slots[level][index] = NULL;
+    wheel->occupied[level][index / 64] &= ~(G_GUINT64_CONSTANT(1) << (index % 64));
+
+    while (list) {
+        WheelTimer *timer = list;
+        list = timer->next;
+        wheel->count--;
+        timer_link(wheel, timer);
+    }
+}
+
+/**
+ * @brief 從 current_tick 之後到本輪結束，找出第一個非空的第 0 層格子
+ *
+ * @return 到該格的 tick 數；本輪沒有非空格子時，回傳到本輪結束（需要 cascade）的 tick 數
+ */
+static guint wheel_level0_gap(TimerWheelSource *wheel) {
+    guint start = (wheel->current_tick & WHEEL_MASK) + 1;
+    for (guint index = start; index < WHEEL_SLOTS; ) {
+        guint64 bits = wheel->occupied[0][index / 64] >> (index % 64);
+        if (bits) {
+            return index + __builtin_ctzll(bits) - start + 1;
+        }
+        index = (index / 64 + 1) * 64;
+    }
+    return WHEEL_SLOTS - start + 1;
+}
+
+/**
+ * @brief 將計時輪推進到 now_tick，把途中到期的計時器移到到期串列
+ *
+ * 以位元圖一次跳過空白的格子，所以閒置很久後推進的成本只和非空格子數有關。
+ */
+static void wheel_advance(TimerWheelSource *wheel, guint64 now_tick) {
+    if (wheel->count == 0) {
+        wheel->current_tick = MAX(wheel->current_tick, now_tick);
+        return;
+    }
+
+    while (wheel->current_tick < now_tick) {
+        guint64 step = MIN(wheel_level0_gap(wheel), now_tick - wheel->current_tick);
+        wheel->current_tick += step;
+        guint64 tick = wheel->current_tick;
+
+        // 第 0 層轉完一輪：把上一層對應的格子往下分配，必要時再往上一層
+        if ((tick & WHEEL_MASK) == 0) {
+            for (guint level = 1; level < WHEEL_LEVELS; level++) {
+                guint index = (tick >> (level * WHEEL_BITS)) & WHEEL_MASK;
+                wheel_collect_slot(wheel, level, index);
+                if (index != 0) break;
+            }
+        }
+        wheel_collect_slot(wheel, 0, tick & WHEEL_MASK);
+    }
+}
+
+static guint64 wheel_now_tick(TimerWheelSource *wheel) {
+    return (g_get_monotonic_time() - wheel->start_time) / WHEEL_TICK_USEC;
+}
+
+// 計時輪事件來源的準備函式：推進計時輪，並算出到下一個非空格子的時間
+gboolean timer_wheel_prepare(GSource *source, gint *timeout) {
+    TimerWheelSource *wheel = (TimerWheelSource *)source;
+    wheel_advance(wheel, wheel_now_tick(wheel));
+
+    if (wheel->expired) {
+        *timeout = 0;
+        return TRUE;
+    }
+    if (wheel->count == 0) {
+        *timeout = -1; // 沒有計時器時不需要喚醒
+        return FALSE;
+    }
+
+    gint64 due = wheel->start_time + (gint64)(wheel->current_tick + wheel_level0_gap(wheel)) * WHEEL_TICK_USEC;
+    *timeout = MAX((due - g_get_monotonic_time() + 999) / 1000, 0);
+    return FALSE;
+}
+
+// 計時輪事件來源的檢查函式
+gboolean timer_wheel_check(GSource *source) {
+    TimerWheelSource *wheel = (TimerWheelSource *)source;
+    wheel_advance(wheel, wheel_now_tick(wheel));
+    return wheel->expired != NULL;
+}
+
+// 計時輪事件來源的回呼函式：一次執行所有到期的計時器
+gboolean timer_wheel_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+    TimerWheelSource *wheel = (TimerWheelSource *)source;
+
+    // 每次從串列頭取出，回呼中取消其他到期的計時器也是安全的
+    while (wheel->expired) {
+        WheelTimer *timer = wheel->expired;
+        timer_unlink(wheel, timer);
+
+        timer->firing = TRUE;
+        if (timer->func) timer->func(timer, timer->user_data);
+        timer->firing = FALSE;
+
+        // 回呼中沒有重新排程的計時器到此結束
+        if (timer->level == TIMER_UNLINKED) {
+            g_free(timer);
+        }
+    }
+    return TRUE; // 計時輪事件來源一直保留
+}
+
+// 計時輪事件來源的結束函式：釋放所有尚未觸發的計時器
+void timer_wheel_finalize(GSource *source) {
+    TimerWheelSource *wheel = (TimerWheelSource *)source;
+    for (guint level = 0; level < WHEEL_LEVELS; level++) {
+        for (guint index = 0; index < WHEEL_SLOTS; index++) {
+            while (wheel->slots[level][index]) {
+                WheelTimer *timer = wheel->slots[level][index];
+                timer_unlink(wheel, timer);
+                g_free(timer);
+            }
+        }
+    }
+    while (wheel->expired) {
+        WheelTimer *timer = wheel->expired;
+        timer_unlink(wheel, timer);
+        g_free(timer);
+    }
+}
+
+static GSourceFuncs timer_wheel_funcs = {
+    .prepare = timer_wheel_prepare,
+    .check = timer_wheel_check,
+    .dispatch = timer_wheel_dispatch,
+    .finalize = timer_wheel_finalize,
+};
+
+/**
+ * @brief 建立計時輪事件來源，需要再以 g_source_attach() 附加到事件迴圈
+ */
+GSource* timer_wheel_source_new(void) {
+    TimerWheelSource *wheel = (TimerWheelSource *)g_source_new(&timer_wheel_funcs, sizeof(TimerWheelSource));
+    wheel->start_time = g_get_monotonic_time();
+    g_source_set_name(&wheel->source, "TimerWheelSource");
+    return &wheel->source;
+}
+
+/**
+ * @brief 新增一個在 delay_ms 毫秒後觸發一次的計時器，O(1)
+ *
+ * 延遲從現在算起，而不是從上次推進計時輪的時間。
+ *
+ * @return 計時器；觸發後即釋放，除非回呼中以 timer_wheel_reschedule() 重新排程
+ */
+WheelTimer* timer_wheel_add(GSource *source, guint64 delay_ms, WheelTimerFunc func, gpointer user_data) {
+    TimerWheelSource *wheel = (TimerWheelSource *)source;
+    WheelTimer *timer = g_new0(WheelTimer, 1);
+    timer->func = func;
+    timer->user_data = user_data;
+    timer->expires = wheel_now_tick(wheel) + MIN(MAX(delay_ms, 1), WHEEL_MAX_DELAY);
+    timer_link(wheel, timer);
+    return timer;
+}
+
+/**
+ * @brief 將計時器改為 delay_ms 毫秒後觸發，O(1)；也可在計時器自己的回呼中呼叫
+ *
+ * 適合每個連線的閒置逾時：每次有活動就重新排程，而不是取消再新增。
+ */
+void timer_wheel_reschedule(GSource *source, WheelTimer *timer, guint64 delay_ms) {
+    TimerWheelSource *wheel = (TimerWheelSource *)source;
+    if (timer->level != TIMER_UNLINKED) {
+        timer_unlink(wheel, timer);
+    }
+    timer->expires = wheel_now_tick(wheel) + MIN(MAX(delay_ms, 1), WHEEL_MAX_DELAY);
+    timer_link(wheel, timer);
+}
+
+/**
+ * @brief 取消並釋放計時器，O(1)
+ *
+ * 在計時器自己的回呼中呼叫時，只會取消重新排程，計時器於回呼結束後釋放。
+ */
+void timer_wheel_remove(GSource *source, WheelTimer *timer) {
+    TimerWheelSource *wheel = (TimerWheelSource *)source;
+    if (timer->level != TIMER_UNLINKED) {
+        timer_unlink(wheel, timer);
+    }
+    if (!timer->firing) {
+        g_free(timer);
+    }
+}
+
+guint timer_wheel_count(GSource *source) {
+    return ((TimerWheelSource *)source)->count;
+}
+
+/* ---------------- 範例 ---------------- */
+
+static GMainLoop *main_loop = NULL;
+static GSource *wheel_source = NULL;
+static gint64 demo_start = 0;
+static int remaining = 0;
+
+typedef struct {
+    int id;
+    int repeat;  // 重複觸發次數
+    int fired;
+    guint interval;
+} DemoTimer;
+
+void demo_timer_callback(WheelTimer *timer, gpointer user_data) {
+    DemoTimer *demo = user_data;
+    demo->fired++;
+    gint64 elapsed = (g_get_monotonic_time() - demo_start) / 1000;
+
+    if (demo->repeat > 1) {
+        g_print("Timer %d fired after %" G_GINT64_FORMAT " ms (%d of %d)\n", demo->id, elapsed, demo->fired, demo->repeat);
+    } else {
+        g_print("Timer %d fired after %" G_GINT64_FORMAT " ms\n", demo->id, elapsed);
+    }
+
+    // 重複的計時器在回呼中重新排程自己
+    if (demo->fired < demo->repeat) {
+        timer_wheel_reschedule(wheel_source, timer, demo->interval);
+        return;
+    }
+
+    if (--remaining == 0) {
+        g_print("All timers done, exiting...\n");
+        g_main_loop_quit(main_loop);
+    }
+}
+
+static void run_demo(void) {
+    static DemoTimer demos[] = {
+        { 1, 1, 0, 100 },
+        { 2, 1, 0, 250 },
+        { 3, 1, 0, 300 },
+        { 4, 3, 0, 500 },
+    };
+
+    main_loop = g_main_loop_new(NULL, FALSE);
+    wheel_source = timer_wheel_source_new();
+    g_source_attach(wheel_source, NULL);
+    demo_start = g_get_monotonic_time();
+
+    WheelTimer *timers[G_N_ELEMENTS(demos)];
+    for (guint i = 0; i < G_N_ELEMENTS(demos); i++) {
+        timers[i] = timer_wheel_add(wheel_source, demos[i].interval, demo_timer_callback, &demos[i]);
+        remaining++;
+    }
+
+    // 取消第 3 個計時器
+    timer_wheel_remove(wheel_source, timers[2]);
+    remaining--;
+    g_print("Timer 3 cancelled\n");
+
+    g_main_loop_run(main_loop);
+
+    g_source_destroy(wheel_source);
+    g_source_unref(wheel_source);
+    g_main_loop_unref(main_loop);
+}
+
+/* ---------------- 效能比較 ---------------- */
+
+typedef struct {
+    guint fired;
+    guint total;
+    gint64 lateness_sum;    // 實際觸發時間與到期時間的差距總和（微秒）
+    gint64 lateness_max;
+} BenchState;
+
+typedef struct {
+    BenchState *state;
+    gint64 due;
+} BenchTimer;
+
+static void bench_record(BenchTimer *timer) {
+    gint64 lateness = MAX(g_get_monotonic_time() - timer->due, 0);
+    timer->state->fired++;
+    timer->state->lateness_sum += lateness;
+    timer->state->lateness_max = MAX(timer->state->lateness_max, lateness);
+}
+
+void bench_wheel_callback(WheelTimer *timer, gpointer user_data) {
+    bench_record(user_data);
+}
+
+gboolean bench_timeout_callback(gpointer user_data) {
+    bench_record(user_data);
+    return FALSE;
+}
+
+static void noop_wheel_callback(WheelTimer *timer, gpointer user_data) {
+}
+
+static gboolean noop_timeout_callback(gpointer user_data) {
+    return FALSE;
+}
+
+// 計時器的延遲平均分布在 1 到 2000 毫秒
+static guint bench_delay(guint i) {
+    return (guint)((i * G_GUINT64_CONSTANT(7919)) % 2000) + 1;
+}
+
+static gdouble cpu_seconds(void) {
+    return (gdouble)clock() / CLOCKS_PER_SEC;
+}
+
+/**
+ * @brief 在獨立的 GMainContext 上比較計時輪與每個計時器一個 g_timeout 來源
+ */
+static void run_benchmark(guint count, gboolean use_wheel) {
+    GMainContext *context = g_main_context_new();
+    BenchState state = { 0, count, 0, 0 };
+    BenchTimer *timers = g_new(BenchTimer, count);
+    GSource *wheel = NULL;
+
+    if (use_wheel) {
+        wheel = timer_wheel_source_new();
+        g_source_attach(wheel, context);
+    }
+
+    // 排程與取消的成本：新增 count 個計時器後全部取消
+    gpointer *handles = g_new(gpointer, count);
+    gint64 start = g_get_monotonic_time();
+    for (guint i = 0; i < count; i++) {
+        if (use_wheel) {
+            handles[i] = timer_wheel_add(wheel, bench_delay(i), noop_wheel_callback, NULL);
+        } else {
+            GSource *source = g_timeout_source_new(bench_delay(i));
+            g_source_set_callback(source, noop_timeout_callback, NULL, NULL);
+            g_source_attach(source, context);
+            handles[i] = source;
+        }
+    }
+    gint64 scheduled = g_get_monotonic_time();
+    for (guint i = 0; i < count; i++) {
+        if (use_wheel) {
+            timer_wheel_remove(wheel, handles[i]);
+        } else {
+            g_source_destroy(handles[i]);
+            g_source_unref(handles[i]);
+        }
+    }
+    gint64 cancelled = g_get_monotonic_time();
+    g_free(handles);
+
+    // 觸發的成本：新增 count 個計時器並執行到全部觸發
+    gint64 base = g_get_monotonic_time();
+    for (guint i = 0; i < count; i++) {
+        timers[i].state = &state;
+        timers[i].due = base + (gint64)bench_delay(i) * 1000;
+        if (use_wheel) {
+            timer_wheel_add(wheel, bench_delay(i), bench_wheel_callback, &timers[i]);
+        } else {
+            GSource *source = g_timeout_source_new(bench_delay(i));
+            g_source_set_callback(source, bench_timeout_callback, &timers[i], NULL);
+            g_source_attach(source, context);
+            g_source_unref(source);
+        }
+    }
+
+    guint iterations = 0;
+    gdouble cpu_start = cpu_seconds();
+    gint64 run_start = g_get_monotonic_time();
+    while (state.fired < count) {
+        g_main_context_iteration(context, TRUE);
+        iterations++;
+    }
+    gint64 run_end = g_get_monotonic_time();
+    gdouble cpu = cpu_seconds() - cpu_start;
+
+    g_print("%-10s %8u timers: schedule %7.1f ns, cancel %7.1f ns, run %6.2f s wall / %6.2f s CPU, "
+            "%6u wakeups, lateness avg %.2f ms max %.2f ms\n",
+            use_wheel ? "wheel" : "g_timeout", count,
+            (gdouble)(scheduled - start) * 1000 / count, (gdouble)(cancelled - scheduled) * 1000 / count,
+            (run_end - run_start) / 1e6, cpu, iterations,
+            state.lateness_sum / 1000.0 / count, state.lateness_max / 1000.0);
+
+    if (wheel) {
+        g_source_destroy(wheel);
+        g_source_unref(wheel);
+    }
+    g_free(timers);
+    g_main_context_unref(context);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && g_strcmp0(argv[1], "--benchmark") == 0) {
+        static const guint default_counts[] = { 10000, 100000, 1000000 };
+        g_print("Timers fire 1-2000 ms after they are scheduled.\n");
+        for (int i = 2; i < argc || (argc == 2 && i < 2 + (int)G_N_ELEMENTS(default_counts)); i++) {
+            guint count = argc > 2 ? (guint)atoi(argv[i]) : default_counts[i - 2];
+            if (count == 0) continue;
+            run_benchmark(count, TRUE);
+            run_benchmark(count, FALSE);
+        }
+        return 0;
+    }
+
+    run_demo();
+    return 0;
+}
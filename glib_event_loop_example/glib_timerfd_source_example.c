@@ -0,0 +1,332 @@
+/**
+ * @file glib_timerfd_source_example.c
+ * @brief 以 Linux timerfd 驅動的自訂事件來源範例程式
+ *
+ * glib_custom_event_source_example.c 的 CustomSource 每次迴圈都在 prepare
+ * 中計算剩餘時間、在 check 中讀取時鐘，而且在 dispatch 時以「現在 + 間隔」
+ * 設定下一次觸發時間，回呼越慢，排程就漂移得越多。
+ *
+ * 此程式的 TimerfdSource 改用 timerfd，以 g_source_add_unix_fd() 交給 GLib 輪詢：
+ * - 沒有 prepare/check 函式，到期與否完全由核心判斷，poll 之外不花任何成本。
+ * - 以 TFD_TIMER_ABSTIME 設定絕對的單調時間期限（與 g_get_monotonic_time() 同一個時鐘）。
+ * - 週期由核心以原本的期限重新設定，回呼延遲不會累積成漂移；
+ *   錯過的次數會一併傳給回呼，而不是連續觸發補上。
+ *
+ * 執行時兩種來源以相同間隔各觸發 10 次，回呼中模擬 3 毫秒的工作，
+ * 印出每次觸發與理想排程的差距。以 --benchmark 執行時，比較兩者
+ * 每次觸發的喚醒次數與 CPU 時間。
+ *
+ * 編譯方式：
+ * gcc -O2 -o glib_timerfd_source_example glib_timerfd_source_example.c `pkg-config --cflags --libs glib-2.0`
+ *
+ * 執行方式：
+ * ./glib_timerfd_source_example
+ * ./glib_timerfd_source_example --benchmark [間隔毫秒] [觸發次數]
+ *
+ * 預期輸出：
+ * CustomSource  tick  1: +0.1 ms from schedule
+ * ...
+ * CustomSource  tick 10: +27.9 ms from schedule
+ * TimerfdSource tick  1: +0.1 ms from schedule
+ * ...
+ * TimerfdSource tick 10: +0.1 ms from schedule
+ * Deadline reached 0.1 ms late
+ *
+ * @author: Nelson Chung
+ * @date: 2024.11.23
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+// TimerfdSource 的回呼函式；expirations 是上次 dispatch 以來到期的次數
+typedef gboolean (*TimerfdSourceFunc)(guint64 expirations, gpointer user_data);
+
+// timerfd 事件來源的結構體
+typedef struct {
+    GSource source;      // 基礎 GSource 結構
+    int fd;              // timerfd；期限與間隔都由核心記錄，不另外保存
+} TimerfdSource;
+
+static void usec_to_timespec(gint64 usec, struct timespec *ts) {
+    ts->tv_sec = usec / G_USEC_PER_SEC;
+    ts->tv_nsec = (usec % G_USEC_PER_SEC) * 1000;
+}
+
+// timerfd 事件來源的回呼函式：讀出到期次數後交給回呼
+gboolean timerfd_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+    TimerfdSource *timerfd_source = (TimerfdSource *)source;
+    guint64 expirations = 0;
+
+    // 非阻塞讀取；重新設定期限後舊的到期會被清除，此時讀不到任何東西
+    if (read(timerfd_source->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return TRUE;
+    }
+
+    if (!callback) return TRUE;
+    return ((TimerfdSourceFunc)callback)(expirations, user_data);
+}
+
+// timerfd 事件來源的結束函式
+void timerfd_source_finalize(GSource *source) {
+    TimerfdSource *timerfd_source = (TimerfdSource *)source;
+    if (timerfd_source->fd >= 0) close(timerfd_source->fd);
+}
+
+// 沒有 prepare 與 check：GLib 只在 timerfd 可讀時 dispatch
+static GSourceFuncs timerfd_source_funcs = {
+    .prepare = NULL,
+    .check = NULL,
+    .dispatch = timerfd_source_dispatch,
+    .finalize = timerfd_source_finalize,
+};
+
+/**
+ * @brief 重新設定期限，可在回呼中呼叫
+ *
+ * @param deadline 以 g_get_monotonic_time() 表示的絕對期限（微秒）
+ * @param interval 之後每隔 interval 微秒觸發一次，0 表示只觸發一次
+ */
+gboolean timerfd_source_set_deadline(GSource *source, gint64 deadline, gint64 interval) {
+    TimerfdSource *timerfd_source = (TimerfdSource *)source;
+    struct itimerspec spec;
+
+    // it_value 全為 0 會停用計時器，已過去的期限改成最小的正值，立即觸發
+    usec_to_timespec(MAX(deadline, 1), &spec.it_value);
+    usec_to_timespec(MAX(interval, 0), &spec.it_interval);
+    if (timerfd_settime(timerfd_source->fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+        g_printerr("timerfd_settime failed: %s\n", g_strerror(errno));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * @brief 建立在 deadline 觸發、之後每隔 interval 微秒觸發一次的事件來源
+ *
+ * 回呼型別為 TimerfdSourceFunc，以 g_source_set_callback() 設定時轉型為 GSourceFunc。
+ *
+ * @return 事件來源，需要再以 g_source_attach() 附加；無法建立 timerfd 時傳回 NULL
+ */
+GSource* timerfd_source_new(gint64 deadline, gint64 interval) {
+    // g_get_monotonic_time() 在 Linux 上讀的就是 CLOCK_MONOTONIC
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        g_printerr("timerfd_create failed: %s\n", g_strerror(errno));
+        return NULL;
+    }
+
+    TimerfdSource *timerfd_source = (TimerfdSource *)g_source_new(&timerfd_source_funcs, sizeof(TimerfdSource));
+    timerfd_source->fd = fd;
+    g_source_add_unix_fd(&timerfd_source->source, fd, G_IO_IN);
+    g_source_set_name(&timerfd_source->source, "TimerfdSource");
+
+    if (!timerfd_source_set_deadline(&timerfd_source->source, deadline, interval)) {
+        g_source_unref(&timerfd_source->source);
+        return NULL;
+    }
+    return &timerfd_source->source;
+}
+
+/**
+ * @brief 建立從現在起每隔 interval_ms 毫秒觸發一次的事件來源
+ */
+GSource* timerfd_source_new_interval(guint interval_ms) {
+    gint64 interval = (gint64)MAX(interval_ms, 1) * 1000;
+    return timerfd_source_new(g_get_monotonic_time() + interval, interval);
+}
+
+/*
+ * 以下是 glib_custom_event_source_example.c 的 CustomSource，作為比較的基準。
+ * 為了計算成本，prepare 與 check 會累計呼叫次數。
+ */
+typedef struct {
+    GSource source;             // 基礎 GSource 結構
+    gint64 next_execution_time; // 下一次觸發的時間（以微秒為單位）
+    int interval;               // 事件間隔（以毫秒為單位）
+} CustomSource;
+
+static guint custom_source_polls = 0;
+
+gboolean custom_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+    CustomSource *custom_source = (CustomSource *)source;
+    gboolean result = callback ? ((TimerfdSourceFunc)callback)(1, user_data) : TRUE;
+
+    // 設定下一次觸發時間：從 dispatch 結束時算起，回呼花的時間會累積成漂移
+    custom_source->next_execution_time = g_get_monotonic_time() + (custom_source->interval * 1000);
+    return result;
+}
+
+gboolean custom_source_prepare(GSource *source, gint *timeout) {
+    CustomSource *custom_source = (CustomSource *)source;
+    gint64 current_time = g_get_monotonic_time();
+    custom_source_polls++;
+
+    if (current_time >= custom_source->next_execution_time) {
+        *timeout = 0;
+        return TRUE;
+    }
+
+    // 剩餘時間無條件捨去成毫秒：不到 1 毫秒時 timeout 為 0，迴圈會空轉到期限
+    *timeout = (custom_source->next_execution_time - current_time) / 1000;
+    return FALSE;
+}
+
+gboolean custom_source_check(GSource *source) {
+    CustomSource *custom_source = (CustomSource *)source;
+    custom_source_polls++;
+    return g_get_monotonic_time() >= custom_source->next_execution_time;
+}
+
+static GSourceFuncs custom_source_funcs = {
+    .prepare = custom_source_prepare,
+    .check = custom_source_check,
+    .dispatch = custom_source_dispatch,
+    .finalize = NULL,
+};
+
+static GSource* custom_source_new(guint interval_ms) {
+    CustomSource *custom_source = (CustomSource *)g_source_new(&custom_source_funcs, sizeof(CustomSource));
+    custom_source->interval = interval_ms;
+    custom_source->next_execution_time = g_get_monotonic_time() + (custom_source->interval * 1000);
+    g_source_set_name(&custom_source->source, "CustomSource");
+    return &custom_source->source;
+}
+
+// 示範與量測共用的狀態
+typedef struct {
+    const gchar *name;
+    gint64 start;           // 第 0 次的理想觸發時間
+    gint64 interval;        // 觸發間隔（微秒）
+    guint64 ticks;          // 已觸發的次數（含錯過的）
+    guint64 limit;          // 觸發到此次數後停止
+    gint64 lateness_sum;    // 每次觸發與理想排程的差距總和（微秒）
+    gint64 lateness_max;
+    gint work_usec;         // 回呼中模擬的工作時間
+    gboolean verbose;
+} TickState;
+
+gboolean tick_callback(guint64 expirations, gpointer user_data) {
+    TickState *state = user_data;
+    state->ticks += expirations;
+
+    // 理想排程是 start + ticks * interval，差距就是累積的漂移加上喚醒延遲
+    gint64 lateness = g_get_monotonic_time() - (state->start + (gint64)state->ticks * state->interval);
+    state->lateness_sum += lateness;
+    state->lateness_max = MAX(state->lateness_max, lateness);
+
+    if (state->verbose) {
+        g_print("%-13s tick %2" G_GUINT64_FORMAT ": %+.1f ms from schedule%s\n", state->name, state->ticks,
+                lateness / 1000.0, expirations > 1 ? " (missed ticks)" : "");
+    }
+    if (state->work_usec > 0) g_usleep(state->work_usec);
+
+    return state->ticks < state->limit;
+}
+
+gboolean deadline_callback(guint64 expirations, gpointer user_data) {
+    gint64 *deadline = user_data;
+    g_print("Deadline reached %.1f ms late\n", (g_get_monotonic_time() - *deadline) / 1000.0);
+    return FALSE; // 單次期限，觸發後移除
+}
+
+// 在獨立的 GMainContext 上執行一個計時來源直到它被移除，傳回迴圈的喚醒次數
+static guint run_source(GSource *source, TickState *state) {
+    GMainContext *context = g_main_context_new();
+    guint iterations = 0;
+
+    g_source_set_callback(source, (GSourceFunc)tick_callback, state, NULL);
+    g_source_attach(source, context);
+    while (!g_source_is_destroyed(source)) {
+        g_main_context_iteration(context, TRUE);
+        iterations++;
+    }
+    g_source_unref(source);
+    g_main_context_unref(context);
+    return iterations;
+}
+
+static void run_demo(void) {
+    const guint interval_ms = 100;
+
+    TickState custom = { "CustomSource", 0, interval_ms * 1000, 0, 10, 0, 0, 3000, TRUE };
+    GSource *source = custom_source_new(interval_ms);
+    custom.start = g_get_monotonic_time();
+    run_source(source, &custom);
+
+    TickState timerfd = { "TimerfdSource", 0, interval_ms * 1000, 0, 10, 0, 0, 3000, TRUE };
+    timerfd.start = g_get_monotonic_time();
+    source = timerfd_source_new(timerfd.start + timerfd.interval, timerfd.interval);
+    if (!source) return;
+    run_source(source, &timerfd);
+
+    // 絕對期限：在 250 毫秒後觸發一次
+    GMainContext *context = g_main_context_new();
+    gint64 deadline = g_get_monotonic_time() + 250 * 1000;
+    source = timerfd_source_new(deadline, 0);
+    if (!source) return;
+    g_source_set_callback(source, (GSourceFunc)deadline_callback, &deadline, NULL);
+    g_source_attach(source, context);
+    while (!g_source_is_destroyed(source)) {
+        g_main_context_iteration(context, TRUE);
+    }
+    g_source_unref(source);
+    g_main_context_unref(context);
+}
+
+static gdouble cpu_seconds(void) {
+    return (gdouble)clock() / CLOCKS_PER_SEC;
+}
+
+/**
+ * @brief 比較兩種來源在相同間隔下每次觸發的喚醒次數與 CPU 時間
+ */
+static void run_benchmark(guint interval_ms, guint ticks, gboolean use_timerfd) {
+    TickState state = { use_timerfd ? "timerfd" : "CustomSource", 0, (gint64)interval_ms * 1000, 0, ticks, 0, 0, 0, FALSE };
+    GSource *source;
+
+    custom_source_polls = 0;
+    state.start = g_get_monotonic_time();
+    if (use_timerfd) {
+        source = timerfd_source_new(state.start + state.interval, state.interval);
+        if (!source) return;
+    } else {
+        source = custom_source_new(interval_ms);
+    }
+
+    gdouble cpu_start = cpu_seconds();
+    guint iterations = run_source(source, &state);
+    gint64 run_end = g_get_monotonic_time();
+    gdouble cpu = cpu_seconds() - cpu_start;
+
+    g_print("%-12s %4u ms x %6" G_GUINT64_FORMAT ": %.2f wakeups/tick, %.2f prepare+check/tick, "
+            "%.2f us CPU/tick, lateness avg %.3f ms max %.3f ms, total drift %.3f ms\n",
+            state.name, interval_ms, state.ticks,
+            (gdouble)iterations / state.ticks, (gdouble)custom_source_polls / state.ticks,
+            cpu * 1e6 / state.ticks,
+            state.lateness_sum / 1000.0 / state.ticks, state.lateness_max / 1000.0,
+            (run_end - (state.start + (gint64)state.ticks * state.interval)) / 1000.0);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && g_strcmp0(argv[1], "--benchmark") == 0) {
+        guint interval_ms = argc > 2 ? (guint)atoi(argv[2]) : 1;
+        guint ticks = argc > 3 ? (guint)atoi(argv[3]) : 2000;
+        if (interval_ms == 0 || ticks == 0) {
+            g_printerr("Usage: %s --benchmark [interval-ms] [ticks]\n", argv[0]);
+            return 1;
+        }
+        run_benchmark(interval_ms, ticks, FALSE);
+        run_benchmark(interval_ms, ticks, TRUE);
+        return 0;
+    }
+
+    run_demo();
+    return 0;
+}